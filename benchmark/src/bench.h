@@ -0,0 +1,191 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/// Versione del formato JSON dei risultati, da incrementare a ogni modifica dei campi
+#define BENCH_SCHEMA_VERSION 1
+/// Millisecondi minimi di ogni ripetizione di una misura
+#define BENCH_DEFAULT_MIN_TIME_MS 200
+/// Numero predefinito di ripetizioni di ogni misura, viene riportata la mediana
+#define BENCH_DEFAULT_REPETITIONS 5
+
+
+/**
+ * Misura del tempo delle funzioni della libreria, nello stile di Google Benchmark
+ *
+ * Ogni misura viene ripetuta più volte con lo stesso numero di iterazioni, scelto in modo che una ripetizione duri
+ * almeno il tempo minimo, e viene riportata la mediana: un'interruzione del sistema operativo durante una ripetizione
+ * non sposta il risultato. I risultati si possono scrivere in JSON con sempre gli stessi campi nello stesso ordine,
+ * una misura per riga, in modo da confrontare con un diff i risultati di due versioni.
+ */
+namespace Bench {
+    using std::string;
+
+    /// Impedisce al compilatore di eliminare i calcoli il cui risultato non viene usato
+    inline volatile uint64_t sink;
+
+    /**
+     * Risultato di una misura
+     */
+    struct Result {
+        /// Nome della misura, nella forma gruppo/operazione
+        string name;
+        /// Iterazioni di ogni ripetizione
+        uint64_t iterations{};
+        /// Elementi elaborati da ogni iterazione (ad esempio i destinatari di un messaggio)
+        uint64_t items{};
+        /// Mediana dei nanosecondi per iterazione tra le ripetizioni
+        double median_ns{};
+        /// Minimo dei nanosecondi per iterazione tra le ripetizioni
+        double min_ns{};
+        /// Massimo dei nanosecondi per iterazione tra le ripetizioni
+        double max_ns{};
+    } typedef Result;
+
+    /**
+     * Impostazioni delle misure
+     */
+    struct Options {
+        /// Vengono eseguite solo le misure il cui nome contiene questa stringa (vuota per eseguirle tutte)
+        string filter;
+        /// Millisecondi minimi di ogni ripetizione
+        unsigned int min_time_ms = BENCH_DEFAULT_MIN_TIME_MS;
+        /// Numero di ripetizioni di ogni misura
+        unsigned int repetitions = BENCH_DEFAULT_REPETITIONS;
+    } typedef Options;
+
+    /**
+     * Esegue le misure e ne raccoglie i risultati
+     */
+    class Runner {
+    private:
+        /// Le impostazioni delle misure
+        Options options;
+        /// I risultati, nell'ordine in cui le misure sono state eseguite
+        std::vector<Result> results;
+
+        /**
+         * Esegue una funzione un certo numero di volte
+         * @return I nanosecondi impiegati
+         */
+        template<typename Function>
+        static double _time(Function &function, uint64_t iterations) {
+            uint64_t total = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; i++) {
+                total += function(i);
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            sink = total;
+
+            return (double) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        }
+
+    public:
+        explicit Runner(Options _options) : options(std::move(_options)) {}
+
+        /**
+         * Misura il tempo medio di una funzione
+         * @tparam Function Una funzione che riceve l'indice dell'iterazione (uint64_t) e restituisce un numero
+         * @param name Il nome della misura, nella forma gruppo/operazione
+         * @param items Gli elementi elaborati da ogni chiamata della funzione
+         * @param function La funzione da misurare
+         */
+        template<typename Function>
+        void run(const string &name, uint64_t items, Function function) {
+            if (name.find(options.filter) == string::npos)
+                return;
+
+            // Raddoppia le iterazioni finché non si può stimare quante ne servono per il tempo minimo
+            double target = options.min_time_ms * 1e6;
+            uint64_t iterations = 1;
+            double elapsed = _time(function, iterations);
+            while (elapsed < target / 10) {
+                iterations *= 2;
+                elapsed = _time(function, iterations);
+            }
+            iterations = std::max<uint64_t>(1, (uint64_t) ((double) iterations * target / elapsed));
+
+            std::vector<double> samples;
+            for (unsigned int i = 0; i < std::max(1u, options.repetitions); i++) {
+                samples.push_back(_time(function, iterations) / (double) iterations);
+            }
+            std::sort(samples.begin(), samples.end());
+
+            Result result;
+            result.name = name;
+            result.iterations = iterations;
+            result.items = items;
+            result.median_ns = samples[samples.size() / 2];
+            result.min_ns = samples.front();
+            result.max_ns = samples.back();
+            results.push_back(result);
+        }
+
+        /**
+         * @return I risultati delle misure eseguite
+         */
+        const std::vector<Result> &get_results() const { return results; }
+
+        /**
+         * Stampa i risultati in una tabella
+         * @param out Lo stream su cui stampare
+         */
+        void print_table(std::ostream &out) const {
+            char line[160];
+            snprintf(line, sizeof(line), "%-36s %14s %12s %12s %12s\n", "Benchmark", "Iterations", "ns/op", "ns/item",
+                     "spread %");
+            out << line;
+
+            for (const Result &result: results) {
+                double spread = result.median_ns > 0 ? (result.max_ns - result.min_ns) * 100 / result.median_ns : 0;
+                snprintf(line, sizeof(line), "%-36s %14llu %12.2f %12.2f %12.1f\n", result.name.c_str(),
+                         (unsigned long long) result.iterations, result.median_ns,
+                         result.median_ns / (double) result.items, spread);
+                out << line;
+            }
+        }
+
+        /**
+         * Scrive i risultati in JSON
+         * @brief I campi sono sempre gli stessi e nello stesso ordine, con una misura per riga e un numero fisso di
+         * decimali, quindi due esecuzioni si confrontano riga per riga
+         * @param out Lo stream su cui scrivere
+         * @param context Coppie chiave e valore che descrivono la build (ad esempio l'implementazione SIMD scelta)
+         */
+        void write_json(std::ostream &out, const std::vector<std::pair<string, string>> &context) const {
+            char line[320];
+
+            out << "{\n  \"schema\": " << BENCH_SCHEMA_VERSION << ",\n  \"context\": {";
+            for (size_t i = 0; i < context.size(); i++) {
+                out << (i > 0 ? ", " : "") << '"' << context[i].first << "\": \"" << context[i].second << '"';
+            }
+            out << "},\n  \"benchmarks\": [\n";
+
+            // I nomi delle misure sono costanti del programma, non serve gestire i caratteri speciali
+            for (size_t i = 0; i < results.size(); i++) {
+                const Result &result = results[i];
+                snprintf(line, sizeof(line),
+                         "    {\"name\": \"%s\", \"iterations\": %llu, \"items\": %llu, \"ns_per_op\": %.3f, "
+                         "\"ns_per_item\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f}%s\n",
+                         result.name.c_str(), (unsigned long long) result.iterations,
+                         (unsigned long long) result.items, result.median_ns,
+                         result.median_ns / (double) result.items, result.min_ns, result.max_ns,
+                         i + 1 < results.size() ? "," : "");
+                out << line;
+            }
+            out << "  ]\n}\n";
+        }
+    };
+}
+
+
+#endif  // BENCH_H
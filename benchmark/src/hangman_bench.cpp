@@ -0,0 +1,375 @@
+#include <array>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Hangman/protocol.h>
+#include <Hangman/simd.h>
+#include <Hangman/wire.h>
+#include <Hangman/frame_buffer.h>
+#include <Hangman/event_loop.h>
+#include <Hangman/timer_wheel.h>
+#include <Hangman/outbox.h>
+#include <Hangman/metrics.h>
+#include <Hangman/phrase_corpus.h>
+#include <Hangman/random.h>
+#include <Hangman/room.h>
+#include <Hangman/trace.h>
+
+#include "bench.h"
+
+
+/// Numero di frasi del corpus generato per le misure
+#define BENCH_CORPUS_PHRASES 20000
+/// Seme del generatore del corpus, lo stesso seme produce lo stesso corpus su ogni macchina
+#define BENCH_CORPUS_SEED 42
+/// Numero di code di invio della misura di diffusione di un messaggio
+#define BENCH_FANOUT_QUEUES 64
+/// Iterazioni dopo le quali le code di invio vengono svuotate, per non superare OUTBOX_HIGH_WATER_MARK
+#define BENCH_QUEUE_RESET 64
+/// Primo descrittore usato per i giocatori finti, le code di invio non scrivono mai sul socket
+#define BENCH_FIRST_SOCKFD 1000
+
+
+using namespace Server;
+
+
+/// Le lettere in ordine di frequenza, come le prova un giocatore
+static const char *letters_by_frequency = "ETAOINSHRDLUCMFWYPVBGKJQXZ";
+
+
+/**
+ * Stanza che espone le operazioni interne della partita alle misure
+ */
+class BenchRoom : public Room {
+public:
+    using Room::Room;
+
+    int apply_letter(Player *player, Client::LetterMessage &packet) { return _get_letter_from_player(player, packet); }
+
+    void broadcast_progress() { _broadcast_progress(true); }
+};
+
+
+/**
+ * Genera un testo con una frase per riga, sempre uguale a parità di seme
+ * @param phrases Il numero di frasi
+ * @return Il testo
+ */
+static std::string generate_phrases(uint32_t phrases) {
+    Random random(BENCH_CORPUS_SEED);
+    std::string text;
+
+    for (uint32_t i = 0; i < phrases; i++) {
+        uint32_t words = 1 + random.below(5);
+        for (uint32_t w = 0; w < words; w++) {
+            if (w > 0)
+                text += ' ';
+
+            uint32_t length = 3 + random.below(8);
+            for (uint32_t c = 0; c < length; c++) {
+                text += (char) ('a' + random.below(ALPHABET_LETTERS));
+            }
+        }
+        text += '\n';
+    }
+
+    return text;
+}
+
+
+/**
+ * Misure sulle frasi: caricamento del corpus, scelta, mascheramento e verifica della vittoria
+ */
+static void bench_corpus(Bench::Runner &runner, const std::string &text, const std::string &compiled_filename,
+                         const std::string &text_filename) {
+    runner.run("corpus/compile", BENCH_CORPUS_PHRASES, [&](uint64_t) {
+        std::istringstream input(text);
+        return PhraseCorpus::compile(input).size();
+    });
+
+    runner.run("corpus/open_compiled", 1, [&](uint64_t) {
+        PhraseCorpus corpus(compiled_filename);
+        return corpus.size();
+    });
+
+    runner.run("corpus/open_text", BENCH_CORPUS_PHRASES, [&](uint64_t) {
+        PhraseCorpus corpus(text_filename);
+        return corpus.size();
+    });
+
+    PhraseCorpus corpus(compiled_filename);
+    PhraseFilter filter;
+    filter.min_length = 10;
+    filter.max_length = 40;
+    filter.max_vowel_percent = 50;
+    ShuffleBag bag;
+    Random random(BENCH_CORPUS_SEED);
+
+    runner.run("corpus/pick", 1, [&](uint64_t) {
+        return corpus.pick(filter, bag, random);
+    });
+
+    // Le frasi su cui misurare maschera e vittoria, lette in ordine per non favorire la cache di una sola frase
+    std::vector<std::array<char, SHORTPHRASE_LENGTH>> phrases(256);
+    for (size_t i = 0; i < phrases.size(); i++) {
+        phrases[i].fill(0);
+        std::string_view phrase = corpus.phrase((uint32_t) (i * corpus.size() / phrases.size()));
+        memcpy(phrases[i].data(), phrase.data(), std::min(phrase.size(), (size_t) SHORTPHRASE_LENGTH - 1));
+    }
+
+    char masked[SHORTPHRASE_LENGTH];
+    PhraseMask hidden;
+    runner.run("mask/phrase", 1, [&](uint64_t i) {
+        Simd::mask_phrase(phrases[i % phrases.size()].data(), masked, SHORTPHRASE_LENGTH, hidden.words);
+        return (uint64_t) masked[1] + hidden.words[0];
+    });
+
+    // Ogni frase ha metà delle posizioni scoperte, come a metà di un round
+    std::vector<PhraseMask> hidden_masks(phrases.size()), revealed_masks(phrases.size());
+    for (size_t i = 0; i < phrases.size(); i++) {
+        Simd::mask_phrase(phrases[i].data(), masked, SHORTPHRASE_LENGTH, hidden_masks[i].words);
+        size_t revealed = 0;
+        hidden_masks[i].for_each([&](size_t position) {
+            if (revealed++ % 2 == 0)
+                revealed_masks[i].set(position);
+        });
+    }
+
+    runner.run("mask/win_check", 1, [&](uint64_t i) {
+        return (uint64_t) (revealed_masks[i % phrases.size()] == hidden_masks[i % phrases.size()]);
+    });
+}
+
+
+/**
+ * Misure sulla codifica e la decodifica dei messaggi
+ */
+static void bench_wire(Bench::Runner &runner) {
+    UpdateShortPhraseMessage update;
+    update.errors = 3;
+    strncat(update.short_phrase, "THE QUICK ____N F_X J_MPS ____ THE L_ZY D_G", SHORTPHRASE_LENGTH - 1);
+    auto server_message = std::bit_cast<Message>(update);
+
+    char bytes[WIRE_MAX_FRAME];
+    for (uint8_t version: {PROTOCOL_V1, PROTOCOL_V2}) {
+        runner.run("wire/encode_update_v" + std::to_string(version), 1, [&](uint64_t) {
+            return Wire::encode(server_message, version, bytes);
+        });
+    }
+
+    Client::LetterMessage letter;
+    letter.letter = 'E';
+    Client::ShortPhraseMessage guess;
+    strncat(guess.short_phrase, "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG", SHORTPHRASE_LENGTH - 1);
+
+    FrameBuffer buffer;
+    Client::Message decoded;
+    for (uint8_t version: {PROTOCOL_V1, PROTOCOL_V2}) {
+        auto client_message = std::bit_cast<Client::Message>(letter);
+        char letter_frame[WIRE_MAX_FRAME];
+        size_t letter_size = Wire::encode(client_message, version, letter_frame);
+
+        client_message = std::bit_cast<Client::Message>(guess);
+        char guess_frame[WIRE_MAX_FRAME];
+        size_t guess_size = Wire::encode(client_message, version, guess_frame);
+
+        // Ogni iterazione aggiunge i bytes come una ricezione e li estrae, il buffer resta vuoto tra un'iterazione e
+        // l'altra
+        runner.run("wire/decode_letter_v" + std::to_string(version), 1, [&](uint64_t) {
+            buffer.append(letter_frame, letter_size);
+            return (uint64_t) Wire::decode(buffer, version, decoded) + decoded.data[0];
+        });
+
+        runner.run("wire/decode_phrase_v" + std::to_string(version), 1, [&](uint64_t) {
+            buffer.append(guess_frame, guess_size);
+            return (uint64_t) Wire::decode(buffer, version, decoded) + decoded.data[0];
+        });
+    }
+}
+
+
+/**
+ * Misure sulla partita: nuovo round, tentativi delle lettere e invio degli aggiornamenti ai giocatori
+ */
+static void bench_room(Bench::Runner &runner, const std::shared_ptr<const PhraseCorpus> &corpus) {
+    EventLoop event_loop;
+    TimerWheel timers;
+    Outbox outbox(event_loop);
+    Metrics metrics;
+
+    // Nessuna lettera bloccata, così ogni round accetta tutte le lettere dell'alfabeto
+    RoomSettings settings;
+    settings.start_blocked_letters = "";
+    settings.blocked_attempts = 0;
+
+    // Il corpus non viene mai sostituito, la versione resta la stessa
+    uint64_t corpus_generation = 0;
+    BenchRoom room(1, "", corpus, corpus_generation, settings, BENCH_CORPUS_SEED, timers, outbox, metrics, [](int) {},
+                   [](Room *) {});
+
+    // Il giocatore non ha una coda di invio, quindi le risposte vengono scartate e si misura solo la partita
+    Player player;
+    player.sockfd = BENCH_FIRST_SOCKFD;
+    strncat(player.username, "bench", USERNAME_LENGTH - 1);
+    room.add_player(player);
+
+    runner.run("room/new_round", 1, [&](uint64_t) {
+        room.new_round();
+        return (uint64_t) room.get_players_connected();
+    });
+
+    // Un round intero: la frase nuova e tutte le lettere dell'alfabeto, in ordine di frequenza
+    Client::LetterMessage letter;
+    runner.run("room/letters_round", ALPHABET_LETTERS, [&](uint64_t) {
+        room.new_round();
+
+        uint64_t accepted = 0;
+        for (const char *c = letters_by_frequency; *c != '\0'; c++) {
+            letter.letter = *c;
+            accepted += room.apply_letter(&player, letter);
+        }
+        return accepted;
+    });
+    room.remove_player(player.sockfd);
+
+    // Una stanza piena, con un giocatore per ogni modo di ricevere gli aggiornamenti
+    const uint8_t versions[MAX_CLIENTS] = {PROTOCOL_V1, PROTOCOL_V2, PROTOCOL_V2};
+    const uint8_t capabilities[MAX_CLIENTS] = {0, 0, CAPABILITY_DELTA};
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Player full;
+        full.sockfd = BENCH_FIRST_SOCKFD + 1 + i;
+        full.version = versions[i];
+        full.capabilities = capabilities[i];
+        snprintf(full.username, USERNAME_LENGTH, "bench%d", i);
+        outbox.open(full.sockfd);
+        room.add_player(full);
+    }
+
+    // Le code non vengono mai inviate, vengono svuotate chiudendole e riaprendole
+    auto reset_queues = [&outbox](int first, int count) {
+        for (int sockfd = first; sockfd < first + count; sockfd++) {
+            outbox.close(sockfd);
+            outbox.open(sockfd);
+        }
+    };
+
+    runner.run("room/broadcast_progress", MAX_CLIENTS, [&](uint64_t i) {
+        if (i % BENCH_QUEUE_RESET == 0)
+            reset_queues(BENCH_FIRST_SOCKFD + 1, MAX_CLIENTS);
+
+        room.broadcast_progress();
+        return (uint64_t) outbox.get_queued_bytes();
+    });
+
+    // La diffusione di un messaggio già codificato a molte code, il costo per destinatario di ogni broadcast
+    int first_queue = BENCH_FIRST_SOCKFD + 1 + MAX_CLIENTS;
+    for (int sockfd = first_queue; sockfd < first_queue + BENCH_FANOUT_QUEUES; sockfd++) {
+        outbox.open(sockfd);
+    }
+
+    Message action;
+    action.action = NEW_GAME;
+    char bytes[WIRE_MAX_FRAME];
+    size_t size = Wire::encode(action, PROTOCOL_V2, bytes);
+
+    runner.run("outbox/fanout", BENCH_FANOUT_QUEUES, [&](uint64_t i) {
+        if (i % BENCH_QUEUE_RESET == 0)
+            reset_queues(first_queue, BENCH_FANOUT_QUEUES);
+
+        SharedBuffer buffer = Outbox::encode(bytes, size);
+        uint64_t queued = 0;
+        for (int sockfd = first_queue; sockfd < first_queue + BENCH_FANOUT_QUEUES; sockfd++) {
+            queued += outbox.send(sockfd, buffer);
+        }
+        return queued;
+    });
+
+    // Lo stesso messaggio inviato a ogni coda come messaggio per un solo destinatario, copiato nel buffer della coda
+    runner.run("outbox/unicast", BENCH_FANOUT_QUEUES, [&](uint64_t i) {
+        if (i % BENCH_QUEUE_RESET == 0)
+            reset_queues(first_queue, BENCH_FANOUT_QUEUES);
+
+        uint64_t queued = 0;
+        for (int sockfd = first_queue; sockfd < first_queue + BENCH_FANOUT_QUEUES; sockfd++) {
+            queued += outbox.send(sockfd, bytes, size);
+        }
+        return queued;
+    });
+}
+
+
+int main(int argc, char *argv[]) {
+    Bench::Options options;
+    std::string json_file;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "filter=", 7) == 0)
+            options.filter = argv[i] + 7;
+        else if (strncmp(argv[i], "min_time=", 9) == 0)
+            options.min_time_ms = (unsigned int) strtoul(argv[i] + 9, nullptr, 10);
+        else if (strncmp(argv[i], "repetitions=", 12) == 0)
+            options.repetitions = (unsigned int) strtoul(argv[i] + 12, nullptr, 10);
+        else if (strncmp(argv[i], "json=", 5) == 0)
+            json_file = argv[i] + 5;
+        else {
+            std::cerr << "Usage: " << argv[0] << " [filter=TEXT] [min_time=MS] [repetitions=N] [json=FILE|-]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    // Il corpus generato viene salvato sia come testo che compilato, per misurare entrambi i caricamenti
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::string text_filename = (directory / "hangman_bench_phrases.txt").string();
+    std::string compiled_filename = (directory / "hangman_bench_phrases.bin").string();
+
+    std::string text = generate_phrases(BENCH_CORPUS_PHRASES);
+    std::ofstream(text_filename, std::ios::binary) << text;
+
+    try {
+        PhraseCorpus::compile(text_filename, compiled_filename);
+    } catch (const std::exception &e) {
+        std::cerr << "Unable to compile the corpus: " << e.what() << std::endl;
+        return 1;
+    }
+
+    Bench::Runner runner(options);
+    bench_corpus(runner, text, compiled_filename, text_filename);
+    bench_wire(runner);
+    bench_room(runner, std::make_shared<const PhraseCorpus>(compiled_filename));
+
+    std::filesystem::remove(text_filename);
+    std::filesystem::remove(compiled_filename);
+
+    // Il contesto contiene solo ciò che cambia il significato dei numeri, non la data o la macchina
+    std::vector<std::pair<std::string, std::string>> context = {
+            {"simd", Simd::implementation()},
+            {"tracing", Tracer::enabled() ? "on" : "off"},
+            {"repetitions", std::to_string(options.repetitions)},
+            {"min_time_ms", std::to_string(options.min_time_ms)},
+    };
+
+    if (json_file == "-") {
+        runner.write_json(std::cout, context);
+        return 0;
+    }
+
+    runner.print_table(std::cout);
+    if (!json_file.empty()) {
+        std::ofstream out(json_file);
+        runner.write_json(out, context);
+        if (!out) {
+            std::cerr << "Unable to write " << json_file << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
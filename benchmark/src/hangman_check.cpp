@@ -0,0 +1,380 @@
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <Hangman/logger.h>
+#include <Hangman/phrase_corpus.h>
+#include <Hangman/random.h>
+#include <Hangman/timer_wheel.h>
+#include <Hangman/wire.h>
+
+
+using namespace Server;
+
+
+/// Numero di verifiche fallite
+static int failures = 0;
+
+
+/**
+ * Registra l'esito di una verifica, stampando quelle fallite
+ * @param condition Il risultato della verifica
+ * @param expression Il testo della verifica
+ * @param file Il file in cui si trova la verifica
+ * @param line La riga in cui si trova la verifica
+ */
+static void check(bool condition, const char *expression, const char *file, int line) {
+    if (condition)
+        return;
+
+    failures++;
+    std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+}
+
+/// Verifica una condizione e continua anche se è falsa, così un'esecuzione riporta tutte le verifiche fallite
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+
+/**
+ * Verifiche sulla ruota dei timer
+ */
+static void check_timer_wheel() {
+    // Tick da 1 ns: la ruota copre circa 16 ms, così si può simulare un'inattività più lunga della ruota
+    TimerWheel timers(std::chrono::nanoseconds(1));
+
+    // Un timer scade solo dopo la sua scadenza, uno cancellato non scade mai
+    int fired = 0, cancelled = 0;
+    auto scheduled = Clock::now();
+    timers.schedule(std::chrono::milliseconds(2), [&fired]() { fired++; });
+    TimerId id = timers.schedule(std::chrono::milliseconds(1), [&cancelled]() { cancelled++; });
+    CHECK(timers.size() == 2);
+    CHECK(timers.cancel(id));
+    CHECK(!timers.cancel(id));
+
+    timers.advance(scheduled + std::chrono::milliseconds(1));
+    CHECK(fired == 0);
+    timers.advance(scheduled + std::chrono::milliseconds(3));
+    CHECK(fired == 1);
+    CHECK(cancelled == 0);
+    CHECK(timers.size() == 0);
+    CHECK(timers.timeout_ms() == -1);
+
+    // Dopo un'inattività più lunga della ruota, senza chiamate ad advance(), la scadenza deve essere rispettata
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    fired = 0;
+    auto after_idle = Clock::now();
+    timers.schedule(std::chrono::milliseconds(5), [&fired]() { fired++; });
+    timers.advance(after_idle);
+    CHECK(fired == 0);
+    timers.advance(after_idle + std::chrono::milliseconds(4));
+    CHECK(fired == 0);
+    timers.advance(after_idle + std::chrono::milliseconds(6));
+    CHECK(fired == 1);
+
+    // Le funzioni chiamate alla scadenza possono programmare altri timer (la ruota è stata portata avanti fino a
+    // 6 ms da after_idle, si attende che l'orologio la raggiunga)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    fired = 0;
+    auto chained = Clock::now();
+    timers.schedule(std::chrono::milliseconds(1), [&]() {
+        fired++;
+        timers.schedule(std::chrono::milliseconds(8), [&fired]() { fired++; });
+    });
+    timers.advance(chained + std::chrono::milliseconds(2));
+    CHECK(fired == 1);
+    CHECK(timers.size() == 1);
+    timers.advance(Clock::now() + std::chrono::milliseconds(9));
+    CHECK(fired == 2);
+}
+
+
+/**
+ * Verifiche sul sacchetto delle frasi già uscite
+ */
+static void check_shuffle_bag() {
+    Random random(42);
+    ShuffleBag bag;
+
+    // In ogni giro tutte le posizioni escono una volta sola, anche dopo che il sacchetto è ricominciato
+    bag.reset(100);
+    for (int round = 0; round < 3; round++) {
+        std::vector<int> seen(bag.size());
+        for (uint32_t i = 0; i < bag.size(); i++) {
+            uint32_t position = bag.draw(random);
+            CHECK(position < bag.size());
+            if (position < bag.size())
+                seen[position]++;
+        }
+        for (int times: seen)
+            CHECK(times == 1);
+    }
+
+    // Un sacchetto svuotato a metà giro ricomincia con tutte le nuove posizioni
+    bag.draw(random);
+    bag.reset(1);
+    CHECK(bag.size() == 1);
+    CHECK(bag.draw(random) == 0);
+    CHECK(bag.draw(random) == 0);
+}
+
+/**
+ * Verifiche sul corpus delle frasi
+ */
+static void check_phrase_corpus() {
+    // Le frasi vengono normalizzate e quelle ripetute o vuote saltate
+    std::istringstream text("  ciao mondo \nCIAO MONDO\n\nzebra\nuna frase un po' piu' lunga\n");
+    std::vector<char> compiled = PhraseCorpus::compile(text);
+
+    const char *filename = "hangman_check.corpus";
+    std::ofstream(filename, std::ios::binary).write(compiled.data(), (std::streamsize) compiled.size());
+    {
+        PhraseCorpus corpus(filename);
+        CHECK(corpus.is_mapped());
+        CHECK(corpus.size() == 3);
+
+        bool found = false;
+        for (uint32_t i = 0; i < corpus.size(); i++)
+            found |= corpus.phrase(i) == "CIAO MONDO";
+        CHECK(found);
+
+        // Un filtro che nessuna frase rispetta seleziona tutte le frasi
+        PhraseFilter filter;
+        filter.min_length = 100;
+        CHECK(corpus.select(filter).empty());
+        Random random;
+        ShuffleBag bag;
+        CHECK(corpus.pick(filter, bag, random) < corpus.size());
+        CHECK(bag.size() == corpus.size());
+    }
+
+    // Una frase che esce dal testo viene limitata al testo invece di leggere fuori dalla mappatura
+    CorpusHeader header{};
+    memcpy(&header, compiled.data(), sizeof(header));
+    PhraseInfo info{};
+    memcpy(&info, compiled.data() + header.entries_offset, sizeof(info));
+    info.offset = (uint32_t) header.blob_size - 2;
+    info.length = 200;
+    memcpy(compiled.data() + header.entries_offset, &info, sizeof(info));
+    std::ofstream(filename, std::ios::binary).write(compiled.data(), (std::streamsize) compiled.size());
+    {
+        PhraseCorpus corpus(filename);
+        // Resta solo l'ultimo carattere prima del terminatore finale
+        CHECK(corpus.phrase(0).size() == 1);
+    }
+
+    // Un file che non è un corpus compilato valido viene rifiutato
+    compiled.resize(header.blob_offset + header.blob_size - 1);
+    std::ofstream(filename, std::ios::binary).write(compiled.data(), (std::streamsize) compiled.size());
+    bool rejected = false;
+    try {
+        PhraseCorpus corpus(filename);
+    } catch (const std::runtime_error &) {
+        rejected = true;
+    }
+    CHECK(rejected);
+
+    std::remove(filename);
+}
+
+
+/**
+ * Estrae con la decodifica v2 tutti i messaggi completi presenti nel buffer
+ * @tparam Message Server::Message o Client::Message
+ * @param buffer Il buffer con i bytes ricevuti
+ * @param decoded Dove aggiungere i messaggi estratti
+ * @return Il risultato dell'ultima decodifica, 0 o -1
+ */
+template<typename Message>
+static int decode_all(FrameBuffer &buffer, std::vector<Message> &decoded) {
+    Message message;
+    int res;
+    while ((res = Wire::decode(buffer, PROTOCOL_V2, message)) == 1)
+        decoded.push_back(message);
+    return res;
+}
+
+/**
+ * Codifica dei messaggi in v2 e verifica che vengano decodificati uguali, con i bytes divisi in due ricezioni in ogni
+ * punto possibile
+ * @tparam Message Server::Message o Client::Message
+ * @param messages I messaggi da codificare, uno dopo l'altro
+ */
+template<typename Message>
+static void check_round_trip(const std::vector<Message> &messages) {
+    std::string bytes;
+    for (const Message &message: messages) {
+        char frame[WIRE_MAX_FRAME];
+        bytes.append(frame, Wire::encode(message, PROTOCOL_V2, frame));
+    }
+
+    for (size_t split = 0; split <= bytes.size(); split++) {
+        FrameBuffer buffer;
+        std::vector<Message> decoded;
+        CHECK(buffer.append(bytes.data(), split));
+        CHECK(decode_all(buffer, decoded) == 0);
+        CHECK(buffer.append(bytes.data() + split, bytes.size() - split));
+        CHECK(decode_all(buffer, decoded) == 0);
+
+        CHECK(buffer.size() == 0);
+        CHECK(decoded.size() == messages.size());
+        for (size_t i = 0; i < decoded.size() && i < messages.size(); i++)
+            CHECK(memcmp(&decoded[i], &messages[i], sizeof(Message)) == 0);
+    }
+}
+
+/**
+ * Verifica che un messaggio v2 non valido venga rifiutato, con i bytes divisi in due ricezioni in ogni punto possibile
+ * @tparam Message Server::Message o Client::Message
+ * @param bytes Il messaggio
+ */
+template<typename Message>
+static void check_malformed(const std::string &bytes) {
+    for (size_t split = 0; split <= bytes.size(); split++) {
+        FrameBuffer buffer;
+        std::vector<Message> decoded;
+        CHECK(buffer.append(bytes.data(), split));
+        int res = decode_all(buffer, decoded);
+        if (res == 0) {
+            CHECK(buffer.append(bytes.data() + split, bytes.size() - split));
+            res = decode_all(buffer, decoded);
+        }
+
+        CHECK(res == -1);
+        CHECK(decoded.empty());
+    }
+}
+
+/**
+ * Verifiche sulla codifica dei messaggi v2
+ */
+static void check_wire() {
+    // Messaggi del server con tutti i campi compatti, anche pieni o vuoti
+    Server::UpdateShortPhraseMessage phrase;
+    phrase.errors = 3;
+    memset(phrase.short_phrase, 'A', SHORTPHRASE_LENGTH - 1);
+
+    Server::UpdateUserMessage users;
+    users.user_count = 3;
+    strcpy(users.usernames[0], "alice");
+    memset(users.usernames[2], 'z', USERNAME_LENGTH - 1);
+
+    Server::UpdateAttemptsMessage attempts;
+    attempts.attempts = 4;
+    attempts.errors = 2;
+    attempts.max_errors = 6;
+    attempts.sequence = 0x12345678;
+    memcpy(attempts.attempts_list, "AEIOU", 5);
+
+    Server::UpdateDeltaMessage delta;
+    delta.sequence = 0xFFFFFFFF;
+    delta.letter = 'E';
+    delta.errors = 1;
+    delta.revealed[0] = 0x81;
+    delta.revealed[5] = 0x10;
+
+    Server::OtherOneTurnMessage turn;
+    strcpy(turn.player_name, "bob");
+
+    Server::Message win;
+    win.action = Server::Action::WIN;
+
+    check_round_trip<Server::Message>({std::bit_cast<Server::Message>(phrase), std::bit_cast<Server::Message>(users),
+                                       std::bit_cast<Server::Message>(attempts), std::bit_cast<Server::Message>(delta),
+                                       std::bit_cast<Server::Message>(turn), win});
+
+    // Messaggi del client
+    Client::LetterMessage letter;
+    letter.letter = 'q';
+
+    Client::ShortPhraseMessage guess;
+    strcpy(guess.short_phrase, "CIAO MONDO");
+
+    Client::Message heartbeat;
+    heartbeat.action = Client::Action::HEARTBEAT;
+
+    check_round_trip<Client::Message>({std::bit_cast<Client::Message>(letter), std::bit_cast<Client::Message>(guess),
+                                       heartbeat});
+
+    // Lunghezza nulla, lunghezza oltre il massimo e azione sconosciuta
+    using namespace std::string_literals;
+    check_malformed<Client::Message>("\x00\x00"s);
+    check_malformed<Client::Message>("\xFF\xFF"s);
+    check_malformed<Client::Message>(std::string{(char) (MessageSize + 1), 0} + std::string(MessageSize + 1, 'A'));
+    check_malformed<Client::Message>("\x01\x00\x42"s);
+    check_malformed<Server::Message>("\x01\x00\x42"s);
+
+    // Campi compatti troncati
+    check_malformed<Client::Message>(std::string{1, 0, (char) Client::Action::LETTER});
+    check_malformed<Server::Message>(std::string{1, 0, (char) Server::Action::UPDATE_SHORTPHRASE});
+    check_malformed<Server::Message>(std::string{4, 0, (char) Server::Action::UPDATE_USER, 2, 5, 'a'});
+    check_malformed<Server::Message>(std::string{4, 0, (char) Server::Action::UPDATE_USER, 4, 0, 0});
+    check_malformed<Server::Message>(std::string{4, 0, (char) Server::Action::UPDATE_ATTEMPTS, 1, 2, 3});
+    check_malformed<Server::Message>(std::string{3, 0, (char) Server::Action::UPDATE_DELTA, 1, 0});
+}
+
+
+/// Un valore che registra un messaggio mentre viene scritto su uno stream
+struct LoggingValue {
+} typedef LoggingValue;
+
+static std::ostream &operator<<(std::ostream &out, const LoggingValue &) {
+    Log(LOG_LEVEL_INFO) << "inner message";
+    return out << "value";
+}
+
+/**
+ * Verifiche sui messaggi di log
+ */
+static void check_logger() {
+    const char *filename = "hangman_check.log";
+    std::remove(filename);
+    Logger::set_file(filename);
+
+    // Un messaggio registrato mentre se ne formatta un altro non deve sovrascriverlo
+    Log(LOG_LEVEL_INFO) << "outer message " << LoggingValue() << " end";
+    Log(LOG_LEVEL_INFO) << "next message";
+    std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS * 5));
+
+    std::ifstream file(filename);
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    CHECK(text.find("outer message value end") != std::string::npos);
+    CHECK(text.find("inner message") != std::string::npos);
+    CHECK(text.find("next message") != std::string::npos);
+
+    std::remove(filename);
+}
+
+
+int main(int argc, char *argv[]) {
+    // Argomento opzionale: esegue solo le verifiche il cui nome contiene il testo
+    const char *filter = argc > 1 ? argv[1] : "";
+
+    struct {
+        const char *name;
+        void (*function)();
+    } checks[] = {
+            {"timer_wheel", check_timer_wheel},
+            {"shuffle_bag", check_shuffle_bag},
+            {"phrase_corpus", check_phrase_corpus},
+            {"logger", check_logger},
+            {"wire", check_wire},
+    };
+
+    for (const auto &entry: checks) {
+        if (strstr(entry.name, filter) == nullptr)
+            continue;
+
+        int before = failures;
+        entry.function();
+        std::cout << (failures == before ? "ok     " : "FAILED ") << entry.name << std::endl;
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Hangman/protocol.h>
+#include <Hangman/simd.h>
+
+
+/// Numero di ripetizioni di ogni misura
+#define ITERATIONS 2000000
+/// Numero di buffer casuali con cui viene verificata ogni implementazione, per ogni dimensione
+#define VERIFY_ITERATIONS 200
+
+
+/// Impedisce al compilatore di eliminare i calcoli il cui risultato non viene usato
+static volatile size_t sink;
+
+
+/**
+ * Misura il tempo medio di una funzione
+ * @tparam Function Una funzione senza argomenti che restituisce un numero
+ * @param name Il nome da stampare
+ * @param function La funzione da misurare
+ * @return I nanosecondi per chiamata
+ */
+template<typename Function>
+static double measure(const char *name, Function function) {
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        total += function();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    sink = total;
+
+    double ns = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / ITERATIONS;
+    std::cout << "  " << name << ": " << ns << " ns\n";
+    return ns;
+}
+
+/**
+ * Stampa il confronto tra l'implementazione precedente e quella vettoriale
+ * @param before I nanosecondi dell'implementazione precedente
+ * @param after I nanosecondi dell'implementazione vettoriale
+ */
+static void report(double before, double after) {
+    std::cout << "  speedup: " << before / after << "x\n" << std::endl;
+}
+
+
+// Implementazioni precedenti, a singoli bytes
+
+static void mask_phrase_bytes(const char *phrase, char *masked, size_t size = SHORTPHRASE_LENGTH) {
+    bzero(masked, size);
+    for (size_t i = 0; i < size; i++) {
+        if (phrase[i] == ' ') {
+            masked[i] = ' ';
+        } else if (phrase[i] == '\0') {
+            continue;
+        } else {
+            masked[i] = '_';
+        }
+    }
+}
+
+static void trim_bytes(std::string &s) {
+    s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
+        return !std::isspace(ch);
+    }).base(), s.end());
+    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
+        return !std::isspace(ch);
+    }));
+}
+
+static bool equals_bytes(char *guess, const char *phrase) {
+    std::transform(guess, guess + strlen(guess), guess, ::toupper);
+    return strncmp(guess, phrase, SHORTPHRASE_LENGTH) == 0;
+}
+
+static void trim_simd(std::string &s) {
+    s.erase(s.size() - Simd::trailing_spaces(s.data(), s.size()));
+    s.erase(0, Simd::leading_spaces(s.data(), s.size()));
+}
+
+
+/**
+ * Genera un buffer casuale, con lettere, spazi bianchi, terminatori e bytes non ASCII
+ * @param random Il generatore da usare
+ * @param size Il numero di bytes
+ * @return Il buffer
+ */
+static std::string random_bytes(std::mt19937 &random, size_t size) {
+    std::string data(size, '\0');
+    for (char &c: data) {
+        switch (random() % 8) {
+            case 0: case 1: c = (char) ('a' + random() % 26); break;
+            case 2: c = (char) ('A' + random() % 26); break;
+            case 3: c = ' '; break;
+            case 4: c = "\t\n\v\f\r"[random() % 5]; break;
+            case 5: c = '\0'; break;
+            default: c = (char) (random() % 256); break;
+        }
+    }
+
+    // Spesso il buffer inizia o finisce con una serie di spazi, anche più lunga di un vettore
+    if (random() % 2 && size > 0)
+        std::fill_n(data.begin(), random() % (size + 1), ' ');
+    if (random() % 2 && size > 0)
+        std::fill_n(data.rbegin(), random() % (size + 1), '\t');
+    return data;
+}
+
+/**
+ * Confronta un'implementazione di simd.h con i cicli a singoli bytes, su buffer casuali di ogni dimensione fino a
+ * quella di una frase
+ * @param random Il generatore da usare
+ * @return Se tutti i risultati coincidono
+ */
+static bool verify_implementation(std::mt19937 &random) {
+    auto upper = [](std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (char) toupper(c); });
+        return s;
+    };
+    auto is_space = [](char c) { return std::isspace((unsigned char) c) != 0; };
+
+    for (size_t size = 0; size <= SHORTPHRASE_LENGTH; size++) {
+        for (int iteration = 0; iteration < VERIFY_ITERATIONS; iteration++) {
+            std::string data = random_bytes(random, size);
+
+            std::string folded = data;
+            Simd::to_upper(folded.data(), size);
+            if (folded != upper(data))
+                return false;
+
+            // Le posizioni nascoste sono quelle che la maschera sostituisce con '_'
+            std::string masked_bytes(size, '\0'), masked_simd(size, '\0');
+            uint64_t hidden[(SHORTPHRASE_LENGTH + 63) / 64 + 1];
+            mask_phrase_bytes(data.data(), masked_bytes.data(), size);
+            Simd::mask_phrase(data.data(), masked_simd.data(), size, hidden);
+            if (masked_simd != masked_bytes)
+                return false;
+            for (size_t i = 0; i < size; i++) {
+                if (((hidden[i / 64] >> (i % 64)) & 1) != (masked_bytes[i] == '_'))
+                    return false;
+            }
+
+            // Una copia con il case cambiato a caso, a volte con un byte diverso
+            std::string other = data;
+            for (char &c: other) {
+                if (random() % 2)
+                    c = (char) tolower((unsigned char) c);
+            }
+            if (size > 0 && random() % 2)
+                other[random() % size] = (char) (random() % 256);
+
+            bool equals_bytes = strncmp(upper(data).c_str(), upper(other).c_str(), size) == 0;
+            if (Simd::equals_upper(data.data(), other.data(), size) != equals_bytes)
+                return false;
+
+            auto leading = (size_t) (std::find_if_not(data.begin(), data.end(), is_space) - data.begin());
+            auto trailing = (size_t) (std::find_if_not(data.rbegin(), data.rend(), is_space) - data.rbegin());
+            if (Simd::leading_spaces(data.data(), size) != leading ||
+                Simd::trailing_spaces(data.data(), size) != trailing)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+int main(int argc, char *argv[]) {
+    // Con --verify confronta soltanto le implementazioni, senza misurarle
+    bool verify_only = argc > 1 && strcmp(argv[1], "--verify") == 0;
+
+    // Ogni implementazione supportata dalla CPU deve dare gli stessi risultati dei cicli a singoli bytes
+    std::string chosen = Simd::implementation();
+    std::mt19937 random(42);
+    for (const char *name: {"avx2", "sse2", "scalar"}) {
+        if (!Simd::use_implementation(name)) {
+            std::cout << "Skipping " << name << ": not supported" << std::endl;
+            continue;
+        }
+
+        if (!verify_implementation(random)) {
+            std::cerr << "Results do not match (" << name << ")" << std::endl;
+            return 1;
+        }
+        std::cout << "Verified " << name << std::endl;
+    }
+    Simd::use_implementation(chosen.c_str());
+
+    if (verify_only)
+        return 0;
+
+    std::cout << "\nSIMD implementation: " << Simd::implementation() << "\n" << std::endl;
+
+    // Una frase che occupa quasi tutto il buffer, il caso peggiore per i cicli a singoli bytes
+    char phrase[SHORTPHRASE_LENGTH]{};
+    const char *text = "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG WHILE THE HANGMAN WAITS FOR THE NEXT LETTER "
+                       "AND THE PLAYERS GUESS ONE BY ONE";
+    strncat(phrase, text, SHORTPHRASE_LENGTH - 1);
+
+    char lower[SHORTPHRASE_LENGTH]{};
+    for (int i = 0; i < SHORTPHRASE_LENGTH; i++)
+        lower[i] = (char) tolower(phrase[i]);
+
+    std::string padded = "   \t  " + std::string(phrase) + "  \r\n";
+
+    // Verifica che le due implementazioni diano gli stessi risultati prima di misurarle
+    char masked_bytes[SHORTPHRASE_LENGTH], masked_simd[SHORTPHRASE_LENGTH];
+    uint64_t hidden[(SHORTPHRASE_LENGTH + 63) / 64];
+    mask_phrase_bytes(phrase, masked_bytes);
+    Simd::mask_phrase(phrase, masked_simd, SHORTPHRASE_LENGTH, hidden);
+
+    std::string trimmed_bytes = padded, trimmed_simd = padded;
+    trim_bytes(trimmed_bytes);
+    trim_simd(trimmed_simd);
+
+    char guess[SHORTPHRASE_LENGTH];
+    memcpy(guess, lower, SHORTPHRASE_LENGTH);
+
+    if (memcmp(masked_bytes, masked_simd, SHORTPHRASE_LENGTH) != 0 || trimmed_bytes != trimmed_simd ||
+        !Simd::equals_upper(lower, phrase, SHORTPHRASE_LENGTH) || !equals_bytes(guess, phrase)) {
+        std::cerr << "Results do not match" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Phrase masking (" << SHORTPHRASE_LENGTH << " bytes)\n";
+    double before = measure("bytes", [&]() {
+        mask_phrase_bytes(phrase, masked_bytes);
+        return (size_t) masked_bytes[7];
+    });
+    double after = measure("simd", [&]() {
+        Simd::mask_phrase(phrase, masked_simd, SHORTPHRASE_LENGTH, hidden);
+        return (size_t) masked_simd[7];
+    });
+    report(before, after);
+
+    std::cout << "Case folding (" << SHORTPHRASE_LENGTH << " bytes)\n";
+    before = measure("bytes", [&]() {
+        memcpy(guess, lower, SHORTPHRASE_LENGTH);
+        std::transform(guess, guess + SHORTPHRASE_LENGTH, guess, ::toupper);
+        return (size_t) guess[5];
+    });
+    after = measure("simd", [&]() {
+        memcpy(guess, lower, SHORTPHRASE_LENGTH);
+        Simd::to_upper(guess, SHORTPHRASE_LENGTH);
+        return (size_t) guess[5];
+    });
+    report(before, after);
+
+    std::cout << "Guess comparison (" << SHORTPHRASE_LENGTH << " bytes)\n";
+    before = measure("bytes", [&]() {
+        memcpy(guess, lower, SHORTPHRASE_LENGTH);
+        return (size_t) equals_bytes(guess, phrase);
+    });
+    after = measure("simd", [&]() {
+        memcpy(guess, lower, SHORTPHRASE_LENGTH);
+        return (size_t) Simd::equals_upper(guess, phrase, SHORTPHRASE_LENGTH);
+    });
+    report(before, after);
+
+    std::cout << "Whitespace trimming (" << padded.size() << " bytes)\n";
+    before = measure("bytes", [&]() {
+        std::string s = padded;
+        trim_bytes(s);
+        return s.size();
+    });
+    after = measure("simd", [&]() {
+        std::string s = padded;
+        trim_simd(s);
+        return s.size();
+    });
+    report(before, after);
+
+    return 0;
+}
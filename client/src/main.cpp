@@ -3,6 +3,9 @@
 
 int main(int argc, char *argv[]) {
     Client::HangmanClient *client;
+    // Il terzo argomento opzionale è il nome della stanza in cui entrare
+    const char *room = argc > 3 ? argv[3] : "";
+
     // Chiede l'immissione dell'indirizzo ip del server, di default è 127.0.0.1
     if (argc == 2) {
         client = new Client::HangmanClient(argv[1], "9090");
@@ -15,5 +18,5 @@ int main(int argc, char *argv[]) {
         client = new Client::HangmanClient(ip, "9090");
     }
 
-    client->run(true);
+    client->run(true, room);
 }
@@ -42,7 +42,7 @@ namespace Client {
 #endif
     }
 
-    void HangmanClient::join(const char username[]) {
+    void HangmanClient::join(const char username[], const char room[]) {
         // Connessione al server
         if (connect(sockfd, (struct sockaddr *) &server_address, sizeof(server_address)) < 0) {
             throw std::runtime_error("Errore nella connessione al server");
@@ -51,6 +51,9 @@ namespace Client {
         // Invio username
         JoinMessage message;
         strncat(message.username, username, USERNAME_LENGTH - 1);
+        strncat(message.room, room, ROOMNAME_LENGTH - 1);
+        message.version = PROTOCOL_VERSION;
+        message.capabilities = PROTOCOL_CAPABILITIES;
         _send(message);
     }
 
@@ -60,7 +63,9 @@ namespace Client {
 
         // Riceve il messaggio dal server
         Server::Message raw_msg;
-        _receive(raw_msg);
+        if (!_receive(raw_msg)) {
+            throw std::runtime_error("Connessione con il server interrotta");
+        }
 
         // Converte il messaggio in un messaggio di tipo union
         ServerMessageUnion message = {raw_msg};
@@ -78,13 +83,20 @@ namespace Client {
                 break;
             }
             case Server::Action::UPDATE_SHORTPHRASE: {
+                phrase_state = message.update_short_phrase_message;
                 _printShortPhrase(&message.update_short_phrase_message);
                 break;
             }
             case Server::Action::UPDATE_ATTEMPTS: {
+                attempts_state = message.update_attempts_message;
+                resync_pending = false;
                 _printAttempts(&message.update_attempts_message);
                 break;
             }
+            case Server::Action::UPDATE_DELTA: {
+                _applyDelta(&message.update_delta_message);
+                break;
+            }
             case Server::Action::YOUR_TURN: {
                 _printYourTurn();
                 break;
@@ -119,6 +131,12 @@ namespace Client {
                 _send(heartbeat);
                 break;
             }
+            case Server::Action::PROTOCOL_ACCEPTED: {
+                // I messaggi successivi, in entrambe le direzioni, usano la versione confermata
+                version = Wire::negotiate(message.protocol_message.version);
+                capabilities = message.protocol_message.capabilities & PROTOCOL_CAPABILITIES;
+                break;
+            }
 
             default: {
                 break;
@@ -126,7 +144,7 @@ namespace Client {
         }
     }
 
-    void HangmanClient::run(bool verbose) {
+    void HangmanClient::run(bool verbose, const char room[]) {
         char username[USERNAME_LENGTH];
         std::cout << "Inserisci lo username: ";
         std::cin >> username;
@@ -135,7 +153,7 @@ namespace Client {
         clear_screen();
 
         try {
-            join(username);
+            join(username, room);
         } catch (const std::exception &e) {
             if (verbose)
                 std::cerr << e.what() << std::endl;
@@ -161,13 +179,26 @@ namespace Client {
     }
 
     template<typename TypeMessage>
-    bool HangmanClient::_send(TypeMessage &message) {
-        return send(sockfd, (char *) (&message), MessageSize, 0);
+    bool HangmanClient::_send(const TypeMessage &message) {
+        Message packet = std::bit_cast<Message>(message);
+
+        char bytes[WIRE_MAX_FRAME];
+        size_t size = Wire::encode(packet, version, bytes);
+        return send(sockfd, bytes, size, 0) == (ssize_t) size;
     }
 
-    template<typename TypeMessage>
-    bool HangmanClient::_receive(TypeMessage &message) {
-        return recv(sockfd, (char *) (&message), MessageSize, MSG_WAITALL);
+    bool HangmanClient::_receive(Server::Message &message) {
+        // Il server può inviare più messaggi in un solo segmento TCP oppure spezzarne uno in più segmenti
+        int res;
+        while ((res = Wire::decode(inbound, version, message)) == 0) {
+            ssize_t n = inbound.fill(sockfd);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+        }
+
+        return res > 0;
     }
 
     bool HangmanClient::_getLetter() {
@@ -287,7 +318,11 @@ namespace Client {
     }
 
     void HangmanClient::_waitAction() {
-        // Aspetta che ci siano dati disponibili da leggere sul socket della dimensione di un messaggio
+        // Un messaggio completo potrebbe essere già stato ricevuto insieme al precedente
+        if (Wire::frame_ready(inbound, version))
+            return;
+
+        // Aspetta che ci siano dati disponibili da leggere sul socket
         fd_set set;
         FD_ZERO(&set);
         FD_SET(sockfd, &set);
@@ -364,6 +399,32 @@ namespace Client {
         _printHangman(message->errors);
     }
 
+    void HangmanClient::_applyDelta(Server::UpdateDeltaMessage *message) {
+        // Un aggiornamento perso renderebbe lo stato sbagliato per il resto del round
+        if (message->sequence != attempts_state.sequence + 1) {
+            if (!resync_pending) {
+                Message resync;
+                resync.action = Action::RESYNC;
+                resync_pending = _send(resync);
+            }
+            return;
+        }
+
+        for (int i = 0; i < SHORTPHRASE_LENGTH; i++) {
+            if (message->revealed[i / 8] & (1 << (i % 8)))
+                phrase_state.short_phrase[i] = message->letter;
+        }
+
+        if (attempts_state.attempts < sizeof(attempts_state.attempts_list))
+            attempts_state.attempts_list[attempts_state.attempts++] = message->letter;
+        attempts_state.errors = message->errors;
+        attempts_state.sequence = message->sequence;
+        phrase_state.errors = message->errors;
+
+        _printShortPhrase(&phrase_state);
+        _printAttempts(&attempts_state);
+    }
+
     void HangmanClient::_printHangman(int mistakes){
         TerminalSize size = get_terminal_size();
         int x = (size.width / 2)+3;
@@ -1,10 +1,13 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include <bit>
 #include <iostream>
 #include <cstring>
 #include <sys/fcntl.h>
 #include "protocol.h"
+#include "frame_buffer.h"
+#include "wire.h"
 
 
 namespace Client {
@@ -14,6 +17,8 @@ namespace Client {
         Server::UpdateShortPhraseMessage update_short_phrase_message;
         Server::UpdateAttemptsMessage update_attempts_message;
         Server::OtherOneTurnMessage other_one_turn_message;
+        Server::ProtocolMessage protocol_message;
+        Server::UpdateDeltaMessage update_delta_message;
     } ServerMessageUnion;
 
 
@@ -49,6 +54,18 @@ namespace Client {
         uint8_t players_count = 0;
         /// Contiene se la partita è finita
         bool game_over = true;
+        /// Bytes ricevuti dal server e non ancora ricomposti in un messaggio
+        FrameBuffer inbound;
+        /// Versione del protocollo in uso, diventa quella richiesta solo dopo la conferma del server
+        uint8_t version{PROTOCOL_V1};
+        /// Funzionalità opzionali confermate dal server
+        uint8_t capabilities{};
+        /// Ultima frase ricevuta, a cui vengono applicati gli aggiornamenti incrementali
+        Server::UpdateShortPhraseMessage phrase_state;
+        /// Ultimi tentativi ricevuti, a cui vengono applicati gli aggiornamenti incrementali
+        Server::UpdateAttemptsMessage attempts_state;
+        /// Se è già stato chiesto lo stato completo al server e non è ancora arrivato
+        bool resync_pending = false;
 
         /**
          * Questa funzione si occupa di inviare un messaggio al server
@@ -61,20 +78,18 @@ namespace Client {
          * @note Il messaggio viene inviato in maniera bloccante
          */
         template<typename TypeMessage>
-        bool _send(TypeMessage &message);
+        bool _send(const TypeMessage &message);
 
         /**
          * Questa funzione si occupa di ricevere un messaggio dal server
-         * @tparam TypeMessage Un tipo di messaggio generico di 128 bytes. Quindi può essere un qualsiasi messaggio, anche del client
          * @param message Il messaggio passato per reference sui cui verrà scritto il messaggio ricevuto
          * @return Lo stato di ricezione del messaggio
          * @retval True se la ricezione è andata a buon fine
          * @retval False se la ricezione è fallita
          *
-         * @note Il messaggio viene inviato in maniera bloccante
+         * @note Il messaggio viene ricevuto in maniera bloccante, i bytes in eccesso restano per i messaggi successivi
          */
-        template<typename TypeMessage>
-        bool _receive(TypeMessage &message);
+        bool _receive(Server::Message &message);
 
     protected:
         /**
@@ -129,6 +144,13 @@ namespace Client {
          */
         void _printAttempts(Server::UpdateAttemptsMessage *message);
 
+        /**
+         * Questa funzione si occupa di applicare un aggiornamento incrementale allo stato della partita e di stamparlo
+         * @brief Se manca un aggiornamento precedente chiede al server lo stato completo
+         * @param message Il messaggio ricevuto dal server
+         */
+        void _applyDelta(Server::UpdateDeltaMessage *message);
+
         /**
          * Questa funzione si occupa di stampare a video il disegno dell'impiccato
          * @param mistakes Il numero di errori fatti
@@ -177,8 +199,9 @@ namespace Client {
         /**
          * Questa funzione si occupa di connettersi al server
          * @param username Lo username dell'utente
+         * @param room Il nome della stanza in cui entrare (vuoto per lasciare la scelta al server)
          */
-        void join(const char username[]);
+        void join(const char username[], const char room[] = "");
 
         /**
          * Questa funzione si occupa di gestire la partita per il client
@@ -188,8 +211,9 @@ namespace Client {
         /**
          * Questa funzione si occupa di gestire l'ingresso del client nel gioco e di gestire la partita
          * @param verbose Se true, verranno stampati i messaggi di errore
+         * @param room Il nome della stanza in cui entrare (vuoto per lasciare la scelta al server)
          */
-        void run(bool verbose = true);
+        void run(bool verbose = true, const char room[] = "");
 
         /**
          * Questa funzione si occupa di chiudere la connessione col server
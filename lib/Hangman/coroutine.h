@@ -0,0 +1,33 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <coroutine>
+#include <exception>
+
+
+namespace Server {
+    /**
+     * Coroutine senza valore di ritorno che parte subito e si distrugge da sola quando termina
+     *
+     * Non esiste un oggetto che la possieda: finché è sospesa, chi la riprenderà (ad esempio la stanza in attesa di un
+     * messaggio) ne conserva l'handle e può distruggerla per annullarla. Un intero turno di gioco costa così un solo
+     * frame allocato, invece di un thread bloccato in attesa del giocatore.
+     */
+    struct Task {
+        struct promise_type {
+            Task get_return_object() noexcept { return {}; }
+
+            std::suspend_never initial_suspend() noexcept { return {}; }
+
+            std::suspend_never final_suspend() noexcept { return {}; }
+
+            void return_void() noexcept {}
+
+            /// Un'eccezione non può risalire al loop di eventi, che non sa da quale coroutine provenga
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+}
+
+
+#endif  // COROUTINE_H
@@ -0,0 +1,119 @@
+#include "corpus_watcher.h"
+
+#include <chrono>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "logger.h"
+
+
+namespace Server {
+    CorpusWatcher::CorpusWatcher(const string &_filename,
+                                 std::function<void(std::shared_ptr<const PhraseCorpus>)> _on_reload)
+            : filename(_filename), on_reload(std::move(_on_reload)) {
+        std::filesystem::path path(filename);
+
+#ifdef __linux__
+        // Osserva la cartella invece del file: chi lo sostituisce con una rinomina crea un nuovo inode
+        std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : ".";
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd >= 0 && inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            close(inotify_fd);
+            inotify_fd = -1;
+        }
+#endif
+
+        std::error_code error;
+        last_write = std::filesystem::last_write_time(path, error);
+
+        thread = std::thread([this]() {
+            while (_wait_change()) {
+                _reload();
+            }
+        });
+    }
+
+    CorpusWatcher::~CorpusWatcher() {
+        stopping = true;
+        if (thread.joinable())
+            thread.join();
+
+#ifdef __linux__
+        if (inotify_fd >= 0)
+            close(inotify_fd);
+#endif
+    }
+
+    bool CorpusWatcher::_wait_change() {
+        std::filesystem::path path(filename);
+
+#ifdef __linux__
+        if (inotify_fd >= 0) {
+            alignas(struct inotify_event) char buffer[4096];
+            bool changed = false;
+
+            while (!stopping) {
+                struct pollfd pfd{inotify_fd, POLLIN, 0};
+                int ready = poll(&pfd, 1, changed ? CORPUS_RELOAD_DELAY_MS : CORPUS_WATCH_INTERVAL_MS);
+
+                // Nessun'altra modifica entro il ritardo: il file è stato scritto per intero
+                if (ready == 0 && changed)
+                    return true;
+                if (ready <= 0)
+                    continue;
+
+                ssize_t length;
+                while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+                    for (char *pointer = buffer; pointer < buffer + length;) {
+                        auto *event = (struct inotify_event *) pointer;
+                        if (event->len > 0 && path.filename() == event->name)
+                            changed = true;
+
+                        pointer += sizeof(struct inotify_event) + event->len;
+                    }
+                }
+            }
+
+            return false;
+        }
+#endif
+
+        // Senza inotify controlla periodicamente la data di modifica
+        while (!stopping) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(CORPUS_WATCH_INTERVAL_MS));
+
+            std::error_code error;
+            auto current_write = std::filesystem::last_write_time(path, error);
+            if (!error && current_write != last_write) {
+                last_write = current_write;
+                std::this_thread::sleep_for(std::chrono::milliseconds(CORPUS_RELOAD_DELAY_MS));
+                return !stopping;
+            }
+        }
+
+        return false;
+    }
+
+    void CorpusWatcher::_reload() {
+        auto start = std::chrono::steady_clock::now();
+
+        std::shared_ptr<const PhraseCorpus> corpus;
+        try {
+            corpus = std::make_shared<const PhraseCorpus>(filename);
+        } catch (const std::exception &e) {
+            Log(LOG_LEVEL_WARNING) << "Phrases not reloaded from " << filename << ": " << e.what();
+            return;
+        }
+
+        uint32_t count = corpus->size();
+        on_reload(std::move(corpus));
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        Log(LOG_LEVEL_INFO) << "Phrases reloaded from " << filename << ": " << count << " phrases in "
+                            << (double) elapsed.count() / 1000 << " ms";
+    }
+}
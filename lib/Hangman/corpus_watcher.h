@@ -0,0 +1,78 @@
+#ifndef CORPUS_WATCHER_H
+#define CORPUS_WATCHER_H
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "phrase_corpus.h"
+
+
+/// Millisecondi di attesa dopo una modifica del file, per caricarlo una sola volta quando viene scritto in più passi
+#define CORPUS_RELOAD_DELAY_MS 200
+/// Millisecondi tra due controlli della richiesta di arresto (e della data di modifica, dove non c'è inotify)
+#define CORPUS_WATCH_INTERVAL_MS 1000
+
+
+namespace Server {
+    /**
+     * Questa classe ricarica le frasi quando il loro file viene modificato
+     *
+     * Un thread in background osserva il file (con inotify su Linux, altrimenti controllando la data di modifica), carica
+     * la nuova versione e la passa a on_reload(), che la distribuisce ai server; la versione precedente viene liberata
+     * quando l'ultimo server smette di usarla. Se la nuova versione non è valida viene segnalato l'errore e i server
+     * continuano a usare quella precedente.
+     * @note Un corpus compilato è mappato in memoria, quindi va sostituito con una rinomina (come fa corpus_compiler) e
+     * non riscritto sopra quello in uso
+     */
+    class CorpusWatcher {
+    private:
+        /// Il file osservato
+        string filename;
+        /// Chiamata dal thread del watcher con ogni nuova versione delle frasi
+        std::function<void(std::shared_ptr<const PhraseCorpus>)> on_reload;
+        /// Il thread che osserva il file
+        std::thread thread;
+        /// Chiede al thread di terminare
+        std::atomic<bool> stopping{};
+        /// Descrittore di inotify, -1 se non disponibile
+        int inotify_fd{-1};
+        /// Data dell'ultima modifica vista, usata quando inotify non è disponibile
+        std::filesystem::file_time_type last_write;
+
+        /**
+         * Attende che il file venga modificato
+         * @return false se è stato chiesto l'arresto del watcher
+         */
+        bool _wait_change();
+
+        /**
+         * Carica la nuova versione del file, la passa a on_reload() e riporta il tempo impiegato
+         */
+        void _reload();
+
+    public:
+        /**
+         * Costruttore della classe CorpusWatcher
+         * @brief Avvia il thread che osserva il file
+         * @param _filename Il file delle frasi, compilato oppure di testo
+         * @param _on_reload Chiamata con ogni nuova versione delle frasi, da un thread diverso da quelli dei server
+         */
+        CorpusWatcher(const string &_filename, std::function<void(std::shared_ptr<const PhraseCorpus>)> _on_reload);
+
+        /**
+         * Distruttore della classe CorpusWatcher
+         * @brief Arresta il thread e attende che termini
+         */
+        ~CorpusWatcher();
+
+        CorpusWatcher(const CorpusWatcher &) = delete;
+        CorpusWatcher &operator=(const CorpusWatcher &) = delete;
+    };
+}
+
+
+#endif  // CORPUS_WATCHER_H
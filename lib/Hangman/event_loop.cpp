@@ -0,0 +1,487 @@
+#include "event_loop.h"
+
+#include <cerrno>
+#include <stdexcept>
+
+#include "logger.h"
+#include "trace.h"
+
+
+namespace Server {
+#ifdef __linux__
+    /// Converte una maschera di EventType nella maschera di epoll corrispondente
+    static uint32_t to_epoll(uint32_t events) {
+        uint32_t res = EPOLLRDHUP;
+        if (events & EVENT_READ)
+            res |= EPOLLIN;
+        if (events & EVENT_WRITE)
+            res |= EPOLLOUT;
+        return res;
+    }
+
+    EventLoop::EventLoop(IoBackend backend) {
+#ifdef HANGMAN_IO_URING
+        if (backend == IO_BACKEND_URING) {
+            try {
+                uring = std::make_unique<Uring>();
+                return;
+            } catch (const std::exception &e) {
+                // Kernel troppo vecchio o io_uring disabilitato: il server funziona comunque con epoll
+                Log(LOG_LEVEL_WARNING) << e.what() << ", verrà usato epoll";
+            }
+        }
+#else
+        (void) backend;
+#endif
+
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd < 0) {
+            throw std::runtime_error("Errore nella creazione del loop di eventi");
+        }
+
+        epoll_events.resize(64);
+    }
+
+    EventLoop::~EventLoop() {
+        if (epollfd >= 0)
+            ::close(epollfd);
+    }
+
+    IoBackend EventLoop::get_backend() const {
+#ifdef HANGMAN_IO_URING
+        if (uring)
+            return IO_BACKEND_URING;
+#endif
+        return IO_BACKEND_EPOLL;
+    }
+
+    uint64_t EventLoop::get_syscalls() const {
+#ifdef HANGMAN_IO_URING
+        if (uring)
+            return syscalls + uring->get_enters();
+#endif
+        return syscalls;
+    }
+
+    void EventLoop::add(int fd, uint32_t events) {
+#ifdef HANGMAN_IO_URING
+        if (uring) {
+            _watch(fd, URING_OP_POLL, events);
+            return;
+        }
+#endif
+
+        struct epoll_event ev{};
+        ev.events = to_epoll(events);
+        ev.data.fd = fd;
+
+        syscalls++;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            throw std::runtime_error("Errore nella registrazione del descrittore nel loop di eventi");
+        }
+    }
+
+    void EventLoop::add_listener(int fd) {
+#ifdef HANGMAN_IO_URING
+        if (uring) {
+            _watch(fd, URING_OP_ACCEPT, EVENT_READ);
+            return;
+        }
+#endif
+
+        add(fd, EVENT_READ);
+    }
+
+    void EventLoop::add_connection(int fd) {
+#ifdef HANGMAN_IO_URING
+        if (uring) {
+            _watch(fd, URING_OP_RECV, EVENT_READ);
+            return;
+        }
+#endif
+
+        add(fd, EVENT_READ);
+    }
+
+    void EventLoop::modify(int fd, uint32_t events) {
+#ifdef HANGMAN_IO_URING
+        if (uring) {
+            // Con io_uring le connessioni non attendono mai di essere scrivibili, gli invii sono richieste a sé
+            auto watch = watches.find(fd);
+            if (watch == watches.end() || watch->second.op != URING_OP_POLL || watch->second.events == events)
+                return;
+
+            _cancel(fd, watch->second);
+            _watch(fd, URING_OP_POLL, events);
+            return;
+        }
+#endif
+
+        struct epoll_event ev{};
+        ev.events = to_epoll(events);
+        ev.data.fd = fd;
+
+        syscalls++;
+        epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    void EventLoop::remove(int fd) {
+#ifdef HANGMAN_IO_URING
+        if (uring) {
+            // I completamenti ancora in arrivo per questo descrittore verranno scartati
+            auto watch = watches.find(fd);
+            if (watch == watches.end())
+                return;
+
+            _cancel(fd, watch->second);
+            watches.erase(watch);
+            return;
+        }
+#endif
+
+        syscalls++;
+        epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    void EventLoop::release(int fd) {
+#ifdef HANGMAN_IO_URING
+        if (uring) {
+            auto watch = watches.find(fd);
+            if (watch == watches.end())
+                return;
+
+            // La ricezione multishot potrebbe aver già preso dei dati dal socket: il descrittore resta registrato
+            // finché il kernel non segnala la fine della ricezione, così quei dati non vengono scartati
+            if (watch->second.op == URING_OP_RECV) {
+                if (!watch->second.released) {
+                    _cancel(fd, watch->second);
+                    watch->second.released = true;
+                }
+                return;
+            }
+        }
+#endif
+
+        remove(fd);
+        released.push_back(fd);
+    }
+
+    const std::vector<Event> &EventLoop::wait(int timeout_ms) {
+        TRACE_SCOPE("EventLoop::wait");
+
+        ready.clear();
+
+        // I descrittori rilasciati vengono segnalati subito, senza attendere altri eventi
+        for (int fd: released) {
+            ready.push_back({fd, EVENT_RELEASED});
+        }
+        if (!released.empty())
+            timeout_ms = 0;
+        released.clear();
+
+#ifdef HANGMAN_IO_URING
+        if (uring) {
+            // Gli eventi della chiamata precedente sono stati gestiti, i loro buffer possono tornare al kernel
+            for (uint16_t id: used_buffers) {
+                uring->recycle(id);
+            }
+            used_buffers.clear();
+
+            // Invia le richieste accodate durante il ciclo e attende i completamenti con una sola chiamata
+            if (uring->submit_and_wait(timeout_ms))
+                return ready;
+
+            uring->for_each_cqe([this](const struct io_uring_cqe &cqe) { _on_completion(cqe); });
+            return ready;
+        }
+#endif
+
+        syscalls++;
+        int n = epoll_wait(epollfd, epoll_events.data(), (int) epoll_events.size(), timeout_ms);
+        if (n < 0) {
+            // Un segnale ha interrotto l'attesa, il chiamante ricalcolerà le scadenze
+            if (errno == EINTR)
+                return ready;
+            throw std::runtime_error("Errore nell'attesa degli eventi");
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint32_t flags = epoll_events[i].events;
+            uint32_t events = 0;
+
+            if (flags & EPOLLIN)
+                events |= EVENT_READ;
+            if (flags & EPOLLOUT)
+                events |= EVENT_WRITE;
+            if (flags & (EPOLLHUP | EPOLLRDHUP))
+                events |= EVENT_HANGUP;
+            if (flags & EPOLLERR)
+                events |= EVENT_ERROR;
+
+            ready.push_back({epoll_events[i].data.fd, events});
+        }
+
+        // Se il buffer è stato riempito, lo ingrandisce per la prossima chiamata
+        if (n == (int) epoll_events.size())
+            epoll_events.resize(epoll_events.size() * 2);
+
+        return ready;
+    }
+#ifdef HANGMAN_IO_URING
+    /// Costruisce lo user_data di una richiesta: operazione, generazione (24 bit) e descrittore
+    static uint64_t user_data(uint8_t op, uint32_t generation, int fd) {
+        return (uint64_t) op << 56 | (uint64_t) (generation & 0xFFFFFF) << 32 | (uint32_t) fd;
+    }
+
+    void EventLoop::_watch(int fd, UringOp op, uint32_t events) {
+        Watch watch{op, next_generation++, events, false};
+        watches[fd] = watch;
+        _arm(fd, watch);
+    }
+
+    void EventLoop::_arm(int fd, const Watch &watch) {
+        struct io_uring_sqe *sqe = uring->get_sqe();
+        sqe->fd = fd;
+        sqe->user_data = user_data(watch.op, watch.generation, fd);
+
+        switch (watch.op) {
+            case URING_OP_ACCEPT: {
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+                sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+                break;
+            }
+            case URING_OP_RECV: {
+                // Il kernel sceglie il buffer al momento della ricezione, dall'anello di Uring
+                sqe->opcode = IORING_OP_RECV;
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = URING_BUFFER_GROUP;
+                break;
+            }
+            default: {
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->len = IORING_POLL_ADD_MULTI;
+                sqe->poll32_events = (watch.events & EVENT_READ ? POLLIN : 0) |
+                                     (watch.events & EVENT_WRITE ? POLLOUT : 0) | POLLRDHUP;
+                break;
+            }
+        }
+    }
+
+    void EventLoop::_cancel(int fd, const Watch &watch) {
+        struct io_uring_sqe *sqe = uring->get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = user_data(watch.op, watch.generation, fd);
+        sqe->user_data = user_data(URING_OP_CANCEL, 0, fd);
+    }
+
+    bool EventLoop::send(int fd, const struct msghdr *message, std::shared_ptr<void> keepalive) {
+        auto watch = watches.find(fd);
+        if (watch == watches.end())
+            return false;
+
+        // La generazione è quella della connessione, così il completamento di un socket già chiuso viene scartato
+        uint64_t id = user_data(URING_OP_SEND, watch->second.generation, fd);
+
+        struct io_uring_sqe *sqe = uring->get_sqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t) message;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = id;
+
+        sends[id] = std::move(keepalive);
+        return true;
+    }
+
+    void EventLoop::_on_completion(const struct io_uring_cqe &cqe) {
+        auto op = (uint8_t) (cqe.user_data >> 56);
+        auto generation = (uint32_t) (cqe.user_data >> 32) & 0xFFFFFF;
+        auto fd = (int) (uint32_t) cqe.user_data;
+        bool more = cqe.flags & IORING_CQE_F_MORE;
+
+        if (op == URING_OP_SEND)
+            sends.erase(cqe.user_data);
+        if (op == URING_OP_CANCEL)
+            return;
+
+        // Il descrittore è stato rimosso (o chiuso e riusato): il completamento non gli appartiene più
+        auto watch = watches.find(fd);
+        if (watch == watches.end() || (watch->second.generation & 0xFFFFFF) != generation) {
+            if (cqe.flags & IORING_CQE_F_BUFFER)
+                uring->recycle(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            return;
+        }
+
+        switch (op) {
+            case URING_OP_POLL: {
+                uint32_t events = 0;
+                if (cqe.res < 0) {
+                    events |= EVENT_ERROR;
+                } else {
+                    if (cqe.res & POLLIN)
+                        events |= EVENT_READ;
+                    if (cqe.res & POLLOUT)
+                        events |= EVENT_WRITE;
+                    if (cqe.res & (POLLHUP | POLLRDHUP))
+                        events |= EVENT_HANGUP;
+                    if (cqe.res & POLLERR)
+                        events |= EVENT_ERROR;
+                }
+
+                ready.push_back({fd, events});
+                if (!more && cqe.res >= 0)
+                    _arm(fd, watch->second);
+                break;
+            }
+            case URING_OP_ACCEPT: {
+                if (cqe.res >= 0)
+                    ready.push_back({fd, EVENT_ACCEPT, nullptr, 0, cqe.res});
+
+                // Un errore come EMFILE termina l'accept multishot, ma il socket di ascolto resta valido
+                if (!more && cqe.res != -EINVAL && cqe.res != -EBADF)
+                    _arm(fd, watch->second);
+                break;
+            }
+            case URING_OP_RECV: {
+                bool released = watch->second.released;
+                if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                    auto id = (uint16_t) (cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    used_buffers.push_back(id);
+                    ready.push_back({fd, EVENT_DATA, uring->buffer(id), (size_t) cqe.res});
+
+                    if (!more && !released)
+                        _arm(fd, watch->second);
+                } else if (cqe.res == -ENOBUFS && (released || !used_buffers.empty())) {
+                    // Tutti i buffer sono in uso: la ricezione riparte quando la prossima wait() li restituisce
+                    if (!released)
+                        _arm(fd, watch->second);
+                } else if (cqe.res == 0) {
+                    ready.push_back({fd, EVENT_HANGUP});
+                } else if (cqe.res != -ECANCELED) {
+                    ready.push_back({fd, EVENT_ERROR});
+                }
+
+                // Dopo release() l'ultimo completamento della ricezione chiude il descrittore per questo loop, i dati
+                // non ancora ricevuti restano nel socket per il loop successivo
+                if (released && !more) {
+                    if (cqe.res > 0 || cqe.res == -ECANCELED || cqe.res == -ENOBUFS)
+                        ready.push_back({fd, EVENT_RELEASED});
+                    watches.erase(watch);
+                }
+                break;
+            }
+            case URING_OP_SEND: {
+                ready.push_back({fd, EVENT_SENT, nullptr, 0, cqe.res});
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+#endif
+#else
+    /// Converte una maschera di EventType nella maschera di poll() corrispondente
+    static short to_poll(uint32_t events) {
+        short res = 0;
+        if (events & EVENT_READ)
+            res |= POLLIN;
+        if (events & EVENT_WRITE)
+            res |= POLLOUT;
+        return res;
+    }
+
+    EventLoop::EventLoop(IoBackend backend) {
+        (void) backend;
+    }
+
+    EventLoop::~EventLoop() = default;
+
+    IoBackend EventLoop::get_backend() const {
+        return IO_BACKEND_EPOLL;
+    }
+
+    uint64_t EventLoop::get_syscalls() const {
+        return syscalls;
+    }
+
+    void EventLoop::add_listener(int fd) {
+        add(fd, EVENT_READ);
+    }
+
+    void EventLoop::add_connection(int fd) {
+        add(fd, EVENT_READ);
+    }
+
+    void EventLoop::add(int fd, uint32_t events) {
+        struct pollfd pfd{};
+        pfd.fd = fd;
+        pfd.events = to_poll(events);
+
+        poll_fds.push_back(pfd);
+    }
+
+    void EventLoop::modify(int fd, uint32_t events) {
+        for (auto &pfd: poll_fds) {
+            if (pfd.fd == fd) {
+                pfd.events = to_poll(events);
+                return;
+            }
+        }
+    }
+
+    void EventLoop::remove(int fd) {
+        for (size_t i = 0; i < poll_fds.size(); i++) {
+            if (poll_fds[i].fd == fd) {
+                poll_fds.erase(poll_fds.begin() + (long) i);
+                return;
+            }
+        }
+    }
+
+    void EventLoop::release(int fd) {
+        remove(fd);
+        released.push_back(fd);
+    }
+
+    const std::vector<Event> &EventLoop::wait(int timeout_ms) {
+        TRACE_SCOPE("EventLoop::wait");
+
+        ready.clear();
+
+        // I descrittori rilasciati vengono segnalati subito, senza attendere altri eventi
+        for (int fd: released) {
+            ready.push_back({fd, EVENT_RELEASED});
+        }
+        if (!released.empty())
+            timeout_ms = 0;
+        released.clear();
+
+        syscalls++;
+        int n = poll(poll_fds.data(), poll_fds.size(), timeout_ms);
+        if (n <= 0)
+            return ready;
+
+        for (auto &pfd: poll_fds) {
+            if (pfd.revents == 0)
+                continue;
+
+            uint32_t events = 0;
+            if (pfd.revents & POLLIN)
+                events |= EVENT_READ;
+            if (pfd.revents & POLLOUT)
+                events |= EVENT_WRITE;
+            if (pfd.revents & POLLHUP)
+                events |= EVENT_HANGUP;
+            if (pfd.revents & (POLLERR | POLLNVAL))
+                events |= EVENT_ERROR;
+
+            ready.push_back({pfd.fd, events});
+        }
+
+        return ready;
+    }
+#endif
+}
@@ -0,0 +1,272 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "protocol.h"
+#include "uring.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+
+namespace Server {
+    /// Orologio monotono usato per tutte le scadenze del server
+    typedef std::chrono::steady_clock Clock;
+
+    /// Tipi di evento che il loop può segnalare per un descrittore
+    enum EventType : uint32_t {
+        /// Il descrittore ha dei dati da leggere (o una connessione da accettare)
+        EVENT_READ = 1 << 0,
+        /// Il descrittore può essere scritto senza bloccare
+        EVENT_WRITE = 1 << 1,
+        /// Il peer ha chiuso la connessione
+        EVENT_HANGUP = 1 << 2,
+        /// Si è verificato un errore sul descrittore
+        EVENT_ERROR = 1 << 3,
+        /// Sono stati ricevuti dei dati, che si trovano in Event::data (solo con io_uring)
+        EVENT_DATA = 1 << 4,
+        /// È stata accettata una connessione, il cui socket si trova in Event::result (solo con io_uring)
+        EVENT_ACCEPT = 1 << 5,
+        /// Si è concluso un invio, il cui risultato si trova in Event::result (solo con io_uring)
+        EVENT_SENT = 1 << 6,
+        /// Il descrittore passato a release() non è più osservato, i dati ricevuti prima sono già stati segnalati
+        EVENT_RELEASED = 1 << 7,
+    };
+
+    /// Meccanismo usato dal loop per le operazioni sui socket
+    enum IoBackend {
+        /// Il loop segnala quando un socket è pronto, letture e scritture vengono fatte dal chiamante
+        IO_BACKEND_EPOLL,
+        /// Il loop esegue letture, scritture e accept tramite io_uring e ne segnala il completamento
+        IO_BACKEND_URING,
+    };
+
+    /**
+     * Rappresenta un evento restituito da EventLoop::wait()
+     */
+    struct Event {
+        /// Descrittore su cui si è verificato l'evento
+        int fd;
+        /// Maschera di EventType
+        uint32_t events;
+        /// Dati ricevuti con EVENT_DATA, validi fino alla chiamata successiva a wait()
+        const char *data{};
+        /// Numero di bytes ricevuti con EVENT_DATA
+        size_t size{};
+        /// Socket accettato con EVENT_ACCEPT oppure bytes inviati (o -errno) con EVENT_SENT
+        int result{};
+    } typedef Event;
+
+
+    /**
+     * Loop di eventi basato sulla disponibilità dei descrittori
+     *
+     * Su Linux usa epoll, sugli altri sistemi ricade su poll().
+     * Il thread che chiama wait() viene risvegliato solo quando uno dei descrittori registrati è pronto o quando
+     * scade il timeout, quindi un server inattivo non consuma CPU.
+     *
+     * Con IO_BACKEND_URING il loop usa invece io_uring: le connessioni hanno una ricezione multishot sempre attiva, il
+     * socket di ascolto un'accept multishot e gli invii vengono accodati con send(). Tutte le richieste del ciclo
+     * vengono inviate al kernel dalla stessa io_uring_enter che attende i completamenti, quindi un turno di gioco non
+     * richiede altre chiamate di sistema. Se io_uring non è disponibile il loop ricade su epoll.
+     * @note Questa classe non è thread-safe
+     */
+    class EventLoop {
+    private:
+#ifdef HANGMAN_IO_URING
+        /// Operazione a cui si riferisce un completamento di io_uring
+        enum UringOp : uint8_t {
+            URING_OP_POLL = 1,
+            URING_OP_ACCEPT,
+            URING_OP_RECV,
+            URING_OP_SEND,
+            URING_OP_CANCEL,
+        };
+
+        /// Operazione multishot attiva su un descrittore registrato con io_uring
+        struct Watch {
+            /// Operazione da riarmare quando il kernel la termina
+            UringOp op;
+            /// Distingue i completamenti di un descrittore chiuso da quelli del descrittore riusato con lo stesso numero
+            uint32_t generation;
+            /// Maschera di EventType osservata (solo per URING_OP_POLL)
+            uint32_t events;
+            /// Se la ricezione è stata annullata da release() e il loop attende il suo ultimo completamento
+            bool released;
+        } typedef Watch;
+
+        /// Istanza di io_uring (nullptr se il loop usa epoll)
+        std::unique_ptr<Uring> uring;
+        /// Operazioni attive indicizzate per descrittore
+        std::unordered_map<int, Watch> watches;
+        /// Generazione da assegnare al prossimo descrittore registrato
+        uint32_t next_generation{1};
+        /// Buffer di ricezione consegnati con l'ultima wait(), restituiti al kernel con la successiva
+        std::vector<uint16_t> used_buffers;
+        /// Dati degli invii in corso, tenuti in vita fino al completamento
+        std::unordered_map<uint64_t, std::shared_ptr<void>> sends;
+
+        /**
+         * Accoda la richiesta dell'operazione multishot di un descrittore
+         * @param fd Il descrittore
+         * @param watch L'operazione da richiedere
+         */
+        void _arm(int fd, const Watch &watch);
+
+        /**
+         * Accoda l'annullamento dell'operazione multishot di un descrittore
+         * @param fd Il descrittore
+         * @param watch L'operazione da annullare
+         */
+        void _cancel(int fd, const Watch &watch);
+
+        /**
+         * Registra un descrittore in io_uring
+         * @param fd Il descrittore
+         * @param op L'operazione multishot da mantenere attiva
+         * @param events La maschera di EventType osservata (solo per URING_OP_POLL)
+         */
+        void _watch(int fd, UringOp op, uint32_t events);
+
+        /**
+         * Trasforma un completamento di io_uring in un evento
+         * @param cqe Il completamento
+         */
+        void _on_completion(const struct io_uring_cqe &cqe);
+#endif
+        /// Numero di chiamate di sistema fatte dal loop (esclusa io_uring_enter, contata da Uring)
+        uint64_t syscalls{};
+#ifdef __linux__
+        /// Descrittore dell'istanza di epoll (-1 se il loop usa io_uring)
+        int epollfd{-1};
+        /// Buffer in cui epoll scrive gli eventi pronti
+        std::vector<struct epoll_event> epoll_events;
+#else
+        /// Descrittori registrati nel formato richiesto da poll()
+        std::vector<struct pollfd> poll_fds;
+#endif
+        /// Eventi pronti restituiti dall'ultima chiamata a wait()
+        std::vector<Event> ready;
+        /// Descrittori già rimossi da release(), segnalati con EVENT_RELEASED dalla prossima wait()
+        std::vector<int> released;
+
+    public:
+        /**
+         * Costruttore della classe EventLoop
+         * @param backend Il meccanismo da usare, se non è disponibile viene usato IO_BACKEND_EPOLL
+         * @throws std::runtime_error Se non è possibile creare l'istanza del loop
+         */
+        explicit EventLoop(IoBackend backend = IO_BACKEND_EPOLL);
+
+        /**
+         * Distruttore della classe EventLoop
+         * @brief Chiude l'istanza del loop, ma non i descrittori registrati
+         */
+        ~EventLoop();
+
+        EventLoop(const EventLoop &) = delete;
+        EventLoop &operator=(const EventLoop &) = delete;
+
+        /**
+         * Registra un descrittore nel loop
+         * @param fd Il descrittore da registrare
+         * @param events La maschera di EventType da osservare
+         * @throws std::runtime_error Se non è possibile registrare il descrittore
+         */
+        void add(int fd, uint32_t events = EVENT_READ);
+
+        /**
+         * Registra un socket di ascolto
+         * @brief Con epoll segnala EVENT_READ quando c'è una connessione da accettare, con io_uring la accetta e la
+         * segnala con EVENT_ACCEPT
+         * @param fd Il socket, su cui deve essere già stata chiamata listen() prima della prossima wait()
+         */
+        void add_listener(int fd);
+
+        /**
+         * Registra il socket di una connessione
+         * @brief Con epoll segnala EVENT_READ quando ci sono dati da leggere, con io_uring li riceve e li segnala con
+         * EVENT_DATA; in entrambi i casi la chiusura viene segnalata con EVENT_HANGUP
+         * @param fd Il socket
+         */
+        void add_connection(int fd);
+
+        /**
+         * Cambia gli eventi osservati per un descrittore già registrato
+         * @param fd Il descrittore da modificare
+         * @param events La nuova maschera di EventType da osservare
+         */
+        void modify(int fd, uint32_t events);
+
+        /**
+         * Rimuove un descrittore dal loop
+         * @note Deve essere chiamata prima di chiudere il descrittore
+         * @param fd Il descrittore da rimuovere
+         */
+        void remove(int fd);
+
+        /**
+         * Smette di osservare un descrittore senza perdere i dati già ricevuti, per affidarlo a un altro loop
+         * @brief Con epoll il descrittore viene rimosso subito, con io_uring la ricezione multishot viene annullata ma
+         * i dati che ha già preso dal socket vengono ancora segnalati con EVENT_DATA. In entrambi i casi la fine viene
+         * segnalata con EVENT_RELEASED (dalla prossima wait() o da una successiva), dopo la quale il descrittore non
+         * riceve più eventi e può essere registrato in un altro loop
+         * @note Se il peer chiude la connessione prima della fine viene segnalato EVENT_HANGUP invece di EVENT_RELEASED
+         * @param fd Il descrittore da rilasciare
+         */
+        void release(int fd);
+
+        /**
+         * Attende che almeno uno dei descrittori registrati sia pronto
+         * @param timeout_ms Il tempo massimo di attesa in millisecondi (-1 per attendere all'infinito)
+         * @return Gli eventi pronti, validi fino alla chiamata successiva
+         */
+        const std::vector<Event> &wait(int timeout_ms);
+
+#ifdef HANGMAN_IO_URING
+        /**
+         * Accoda l'invio di un messaggio su una connessione (solo con io_uring)
+         * @brief La richiesta viene inviata al kernel dalla prossima wait(), il completamento viene segnalato con
+         * EVENT_SENT
+         * @param fd Il socket, registrato con add_connection()
+         * @param message Il messaggio da inviare
+         * @param keepalive Proprietario del messaggio e dei dati a cui si riferisce, rilasciato al completamento
+         * @return Se l'invio è stato accodato
+         */
+        bool send(int fd, const struct msghdr *message, std::shared_ptr<void> keepalive);
+#endif
+
+        /**
+         * @return Il meccanismo effettivamente in uso
+         */
+        IoBackend get_backend() const;
+
+        /**
+         * @return Il numero di chiamate di sistema fatte dal loop fino ad ora
+         */
+        uint64_t get_syscalls() const;
+    };
+
+
+    /**
+     * Calcola il timeout da passare a EventLoop::wait() per risvegliarsi entro una certa scadenza
+     * @param deadline La scadenza da rispettare
+     * @return I millisecondi mancanti alla scadenza arrotondati per eccesso (0 se è già passata)
+     */
+    inline int timeout_until(Clock::time_point deadline) {
+        auto remaining = deadline - Clock::now();
+        if (remaining <= Clock::duration::zero())
+            return 0;
+
+        return (int) std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+    }
+}
+
+
+#endif  // EVENT_LOOP_H
@@ -0,0 +1,102 @@
+#include "frame_buffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "trace.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+
+FrameBuffer::FrameBuffer(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    data.resize(size);
+}
+
+ssize_t FrameBuffer::fill(int sockfd) {
+    TRACE_SCOPE("FrameBuffer::fill");
+
+    // Un buffer pieno non deve essere scambiato per una connessione chiusa, che farebbe restituire 0 alla recv
+    if (available() == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    size_t mask = data.size() - 1;
+    size_t tail = (head + count) & mask;
+
+    // Lo spazio libero può essere diviso in due parti: dalla coda alla fine della memoria e dall'inizio alla testa
+    size_t first = std::min(available(), data.size() - tail);
+    size_t second = available() - first;
+
+    ssize_t n;
+#ifndef _WIN32
+    struct iovec parts[2];
+    parts[0].iov_base = data.data() + tail;
+    parts[0].iov_len = first;
+    parts[1].iov_base = data.data();
+    parts[1].iov_len = second;
+
+    n = readv(sockfd, parts, second > 0 ? 2 : 1);
+#else
+    (void) second;
+    n = recv(sockfd, data.data() + tail, (int) first, 0);
+#endif
+
+    if (n > 0)
+        count += n;
+
+    return n;
+}
+
+bool FrameBuffer::append(const char *bytes, size_t size) {
+    if (size > available())
+        return false;
+
+    size_t mask = data.size() - 1;
+    size_t tail = (head + count) & mask;
+
+    // I bytes possono finire a cavallo della fine della memoria
+    size_t first = std::min(size, data.size() - tail);
+    memcpy(data.data() + tail, bytes, first);
+    memcpy(data.data(), bytes + first, size - first);
+
+    count += size;
+    return true;
+}
+
+bool FrameBuffer::peek(void *frame, size_t size) const {
+    if (count < size)
+        return false;
+
+    // Il messaggio può trovarsi a cavallo della fine della memoria
+    size_t first = std::min(size, data.size() - head);
+    memcpy(frame, data.data() + head, first);
+    memcpy((char *) frame + first, data.data(), size - first);
+
+    return true;
+}
+
+void FrameBuffer::consume(size_t size) {
+    size = std::min(size, count);
+    head = (head + size) & (data.size() - 1);
+    count -= size;
+
+    // Un buffer vuoto riparte dall'inizio, così le letture successive non vengono spezzate
+    if (count == 0)
+        head = 0;
+}
+
+bool FrameBuffer::next(void *frame, size_t size) {
+    if (!peek(frame, size))
+        return false;
+
+    consume(size);
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "protocol.h"
+
+
+/// Capacità predefinita (in bytes) del buffer di ricezione di una connessione
+#define FRAME_BUFFER_CAPACITY 4096
+
+
+/**
+ * Buffer circolare che ricompone i messaggi ricevuti da una connessione TCP
+ *
+ * TCP è un flusso di bytes: una singola recv può restituire mezzo messaggio oppure più messaggi insieme. Il buffer
+ * accumula i bytes ricevuti e restituisce i messaggi solo quando sono completi, quindi una lettura parziale non è mai
+ * un errore e una sola recv può svuotare molti messaggi.
+ * @note Questa classe non è thread-safe
+ */
+class FrameBuffer {
+private:
+    /// Memoria del buffer, la sua dimensione è una potenza di due
+    std::vector<char> data;
+    /// Posizione del primo byte non ancora consumato
+    size_t head{};
+    /// Numero di bytes presenti nel buffer
+    size_t count{};
+
+public:
+    /**
+     * Costruttore della classe FrameBuffer
+     * @param capacity La capacità minima del buffer in bytes, arrotondata alla potenza di due successiva
+     */
+    explicit FrameBuffer(size_t capacity = FRAME_BUFFER_CAPACITY);
+
+    /**
+     * Legge dal socket tutti i bytes che possono entrare nello spazio libero, con una sola recv
+     * @param sockfd Il socket da cui leggere
+     * @return Il valore restituito dalla recv
+     * @retval >0 Il numero di bytes letti
+     * @retval 0 La connessione è stata chiusa
+     * @retval -1 Errore nella lettura (errno indica quale) oppure buffer pieno
+     */
+    ssize_t fill(int sockfd);
+
+    /**
+     * Aggiunge in coda dei bytes già ricevuti, ad esempio da io_uring
+     * @param bytes I bytes da aggiungere
+     * @param size Il numero di bytes
+     * @return Se c'era abbastanza spazio libero (altrimenti il buffer non viene modificato)
+     */
+    bool append(const char *bytes, size_t size);
+
+    /**
+     * Copia i primi bytes del buffer senza consumarli
+     * @param frame Dove copiare i bytes
+     * @param size Il numero di bytes da copiare
+     * @return Se nel buffer c'erano abbastanza bytes
+     */
+    bool peek(void *frame, size_t size) const;
+
+    /**
+     * Scarta i primi bytes del buffer
+     * @param size Il numero di bytes da scartare, non superiore a size()
+     */
+    void consume(size_t size);
+
+    /**
+     * Estrae un messaggio completo dal buffer
+     * @param frame Dove copiare il messaggio
+     * @param size La dimensione del messaggio
+     * @return Se nel buffer c'era un messaggio completo
+     */
+    bool next(void *frame, size_t size = MessageSize);
+
+    /**
+     * @return Il numero di bytes ricevuti e non ancora consumati
+     */
+    size_t size() const { return count; }
+
+    /**
+     * @return Il numero di bytes che possono ancora essere ricevuti
+     */
+    size_t available() const { return data.size() - count; }
+
+    /**
+     * Scarta tutti i bytes presenti nel buffer
+     */
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+};
+
+
+#endif  // FRAME_BUFFER_H
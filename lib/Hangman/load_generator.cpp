@@ -0,0 +1,503 @@
+#include "load_generator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "wire.h"
+
+
+namespace Client {
+    namespace {
+        /// Le lettere in ordine di frequenza nella lingua, come le prova un giocatore
+        const char *letters_by_frequency = "ETAOINSHRDLCUMWFGYPBVKJXQZ";
+        /// Le lettere che il server blocca nei primi tentativi del round, come in HangmanClient
+        const char *blocked_letters = "AEIOU";
+        /// Numero di tentativi per cui le lettere bloccate non si possono usare, come in HangmanClient
+        const unsigned int blocked_attempts = 3;
+
+        /**
+         * Scrive una riga del resoconto con i percentili di un istogramma, in millisecondi
+         * @param out Lo stream su cui scrivere
+         * @param name Il nome della misura
+         * @param histogram L'istogramma, in nanosecondi
+         */
+        void write_percentiles(std::ostream &out, const char *name, const Server::Histogram &histogram) {
+            char line[160];
+            auto ms = [&histogram](double quantile) { return (double) histogram.value_at_quantile(quantile) / 1e6; };
+
+            snprintf(line, sizeof(line), "  %-10s %9llu %9.3f %9.3f %9.3f %9.3f %9.3f\n", name,
+                     (unsigned long long) histogram.get_count(), ms(0.5), ms(0.9), ms(0.99), ms(0.999), ms(1));
+            out << line;
+        }
+    }
+
+    LoadGenerator::LoadGenerator(const LoadSettings &_settings) : settings(_settings), random(_settings.seed) {
+        server_address.sin_family = AF_INET;
+        server_address.sin_port = htons(settings.port);
+        if (inet_pton(AF_INET, settings.address.c_str(), &server_address.sin_addr) != 1) {
+            throw std::runtime_error("Indirizzo del server non valido");
+        }
+
+        // Tutta la rete 127.0.0.0/8 è di loopback
+        if ((ntohl(server_address.sin_addr.s_addr) >> 24) != 127) {
+            throw std::runtime_error("Il generatore di carico può collegarsi solo a un indirizzo di loopback");
+        }
+
+        if (settings.think_max_ms < settings.think_min_ms)
+            settings.think_max_ms = settings.think_min_ms;
+
+        bots.resize(settings.bots);
+        bot_by_sockfd.reserve(settings.bots);
+    }
+
+    LoadGenerator::~LoadGenerator() {
+        for (auto &bot: bots) {
+            if (bot.sockfd >= 0) {
+                event_loop.remove(bot.sockfd);
+                ::close(bot.sockfd);
+            }
+        }
+    }
+
+    void LoadGenerator::run(std::ostream &progress, const volatile sig_atomic_t *interrupted) {
+        started = Clock::now();
+        stopping = false;
+
+        timers.schedule(std::chrono::seconds(settings.duration), [this]() { stopping = true; });
+        timers.schedule(std::chrono::milliseconds(LOADGEN_PROGRESS_INTERVAL_MS), [this, &progress]() {
+            _progress(progress);
+        });
+        _ramp();
+
+        while (!stopping && (interrupted == nullptr || *interrupted == 0)) {
+            const std::vector<Server::Event> &events = event_loop.wait(timers.timeout_ms());
+
+            for (const auto &event: events) {
+                auto entry = bot_by_sockfd.find(event.fd);
+                if (entry != bot_by_sockfd.end())
+                    _on_event(bots[entry->second], event);
+            }
+
+            timers.advance(Clock::now());
+        }
+    }
+
+    void LoadGenerator::_ramp() {
+        // L'avvio graduale evita di riempire la coda di listen del server, che scarterebbe le connessioni in eccesso
+        connect_budget += settings.connect_rate * LOADGEN_RAMP_INTERVAL_MS / 1000.0;
+        while (connect_budget >= 1 && launched < bots.size()) {
+            _connect(bots[launched++]);
+            connect_budget--;
+        }
+
+        if (launched < bots.size())
+            timers.schedule(std::chrono::milliseconds(LOADGEN_RAMP_INTERVAL_MS), [this]() { _ramp(); });
+    }
+
+    void LoadGenerator::_connect(Bot &bot) {
+        bot.connect_started = Clock::now();
+
+        bot.sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (bot.sockfd < 0) {
+            bot.state = BOT_CLOSED;
+            stats.connect_failures.add();
+            return;
+        }
+
+        fcntl(bot.sockfd, F_SETFL, O_NONBLOCK);
+        int nodelay = 1;
+        setsockopt(bot.sockfd, IPPROTO_TCP, TCP_NODELAY, (char *) &nodelay, sizeof(nodelay));
+
+        // La connessione prosegue in background, il loop segnala il socket scrivibile quando è stabilita
+        if (connect(bot.sockfd, (struct sockaddr *) &server_address, sizeof(server_address)) < 0 &&
+            errno != EINPROGRESS) {
+            ::close(bot.sockfd);
+            bot.sockfd = -1;
+            bot.state = BOT_CLOSED;
+            stats.connect_failures.add();
+            return;
+        }
+
+        bot.state = BOT_CONNECTING;
+        bot_by_sockfd[bot.sockfd] = &bot - bots.data();
+        event_loop.add(bot.sockfd, Server::EVENT_READ | Server::EVENT_WRITE);
+    }
+
+    void LoadGenerator::_on_event(Bot &bot, const Server::Event &event) {
+        if (bot.state == BOT_CONNECTING) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(bot.sockfd, SOL_SOCKET, SO_ERROR, (char *) &error, &length);
+            if (error != 0) {
+                _close(bot, stats.connect_failures);
+                return;
+            }
+
+            _on_connected(bot);
+            if (bot.state == BOT_CLOSED)
+                return;
+        }
+
+        if ((event.events & Server::EVENT_WRITE) && !_flush(bot))
+            return;
+
+        // Prima vengono letti i dati rimasti, poi si gestisce l'eventuale chiusura
+        if ((event.events & (Server::EVENT_READ | Server::EVENT_HANGUP | Server::EVENT_ERROR)) && !_receive(bot))
+            return;
+
+        if (event.events & Server::EVENT_ERROR)
+            _close(bot, stats.errors);
+    }
+
+    void LoadGenerator::_on_connected(Bot &bot) {
+        stats.connected.add();
+        bot.state = BOT_JOINING;
+        event_loop.modify(bot.sockfd, Server::EVENT_READ);
+
+        // Il messaggio di ingresso è sempre in formato v1, la versione viene confermata dal server
+        JoinMessage message;
+        snprintf(message.username, USERNAME_LENGTH, "bot%zu", (size_t) (&bot - bots.data()));
+        strncat(message.room, settings.room.c_str(), ROOMNAME_LENGTH - 1);
+        message.version = settings.version;
+        message.capabilities = settings.capabilities;
+        _send(bot, message);
+    }
+
+    bool LoadGenerator::_receive(Bot &bot) {
+        while (true) {
+            ssize_t n = bot.inbound.fill(bot.sockfd);
+            int error = errno;
+            if (n == 0) {
+                _close(bot, stats.server_closed);
+                return false;
+            }
+            if (n < 0 && error == EINTR)
+                continue;
+            if (n < 0 && error != EAGAIN && error != EWOULDBLOCK && error != ENOBUFS) {
+                _close(bot, error == ECONNRESET ? stats.server_closed : stats.errors);
+                return false;
+            }
+            if (n > 0)
+                stats.bytes_received.add(n);
+
+            // Ogni messaggio può cambiare la versione usata per decodificare i successivi
+            Server::Message message;
+            int res;
+            while ((res = Wire::decode(bot.inbound, bot.version, message)) > 0) {
+                stats.messages_received.add();
+                _on_message(bot, message);
+                if (bot.state == BOT_CLOSED)
+                    return false;
+            }
+
+            if (res < 0) {
+                _close(bot, stats.errors);
+                return false;
+            }
+
+            // Un buffer pieno è stato appena svuotato dalla decodifica, quindi si può leggere ancora
+            if (n < 0 && error != ENOBUFS)
+                return true;
+        }
+    }
+
+    void LoadGenerator::_on_message(Bot &bot, const Server::Message &message) {
+        Clock::time_point now = Clock::now();
+        if (bot.state == BOT_JOINING) {
+            bot.state = BOT_PLAYING;
+            stats.joined.add();
+            stats.join_latency.record(now - bot.connect_started);
+        }
+
+        switch (message.action) {
+            case Server::PROTOCOL_ACCEPTED: {
+                auto protocol = std::bit_cast<Server::ProtocolMessage>(message);
+                bot.version = Wire::negotiate(protocol.version);
+                bot.capabilities = protocol.capabilities & settings.capabilities;
+                break;
+            }
+            case Server::NEW_GAME: {
+                bot.used_letters = 0;
+                bot.attempts = 0;
+                break;
+            }
+            case Server::UPDATE_SHORTPHRASE: {
+                auto update = std::bit_cast<Server::UpdateShortPhraseMessage>(message);
+                memcpy(bot.phrase, update.short_phrase, SHORTPHRASE_LENGTH);
+                bot.phrase[SHORTPHRASE_LENGTH - 1] = '\0';
+                break;
+            }
+            case Server::UPDATE_ATTEMPTS: {
+                auto update = std::bit_cast<Server::UpdateAttemptsMessage>(message);
+
+                bot.used_letters = 0;
+                bot.attempts = std::min<unsigned int>(update.attempts, sizeof(update.attempts_list));
+                for (unsigned int i = 0; i < bot.attempts; i++) {
+                    if (update.attempts_list[i] >= 'A' && update.attempts_list[i] <= 'Z')
+                        bot.used_letters |= 1u << (update.attempts_list[i] - 'A');
+                }
+                bot.sequence = update.sequence;
+                bot.resync_pending = false;
+                break;
+            }
+            case Server::UPDATE_DELTA: {
+                auto update = std::bit_cast<Server::UpdateDeltaMessage>(message);
+                _apply_delta(bot, update);
+                break;
+            }
+            case Server::SEND_LETTER:
+            case Server::SEND_SHORT_PHRASE: {
+                _think(bot, message.action);
+                break;
+            }
+            case Server::LETTER_ACCEPTED:
+            case Server::LETTER_REJECTED: {
+                if (bot.pending == Server::SEND_LETTER) {
+                    stats.letter_latency.record(now - bot.request_sent);
+                    bot.pending = Server::GENERIC;
+                }
+                break;
+            }
+            case Server::SHORT_PHRASE_ACCEPTED:
+            case Server::SHORT_PHRASE_REJECTED: {
+                if (bot.pending == Server::SEND_SHORT_PHRASE) {
+                    stats.phrase_latency.record(now - bot.request_sent);
+                    bot.pending = Server::GENERIC;
+                }
+                break;
+            }
+            case Server::HEARTBEAT: {
+                Message heartbeat;
+                heartbeat.action = HEARTBEAT;
+                if (_send(bot, heartbeat))
+                    stats.heartbeats.add();
+                break;
+            }
+            case Server::WIN: {
+                stats.wins.add();
+                break;
+            }
+            case Server::LOSE: {
+                stats.losses.add();
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    void LoadGenerator::_apply_delta(Bot &bot, const Server::UpdateDeltaMessage &message) {
+        // Un aggiornamento perso renderebbe lo stato sbagliato per il resto del round
+        if (message.sequence != bot.sequence + 1) {
+            if (!bot.resync_pending) {
+                Message resync;
+                resync.action = RESYNC;
+                bot.resync_pending = _send(bot, resync);
+                stats.resyncs.add();
+            }
+            return;
+        }
+
+        for (int i = 0; i < SHORTPHRASE_LENGTH; i++) {
+            if (message.revealed[i / 8] & (1 << (i % 8)))
+                bot.phrase[i] = message.letter;
+        }
+
+        if (message.letter >= 'A' && message.letter <= 'Z')
+            bot.used_letters |= 1u << (message.letter - 'A');
+        bot.attempts++;
+        bot.sequence = message.sequence;
+    }
+
+    char LoadGenerator::_choose_letter(Bot &bot) {
+        uint32_t excluded = bot.used_letters;
+        if (bot.attempts < blocked_attempts) {
+            for (const char *c = blocked_letters; *c != '\0'; c++)
+                excluded |= 1u << (*c - 'A');
+        }
+
+        char candidates[26];
+        unsigned int count = 0;
+        for (const char *c = letters_by_frequency; *c != '\0'; c++) {
+            if (!(excluded & (1u << (*c - 'A'))))
+                candidates[count++] = *c;
+        }
+
+        // Con tutte le lettere già provate il server rifiuterà il tentativo, ma il turno deve comunque avere risposta
+        if (count == 0)
+            return letters_by_frequency[0];
+
+        if (settings.strategy == BOT_STRATEGY_RANDOM)
+            return candidates[random.below(count)];
+        return candidates[0];
+    }
+
+    void LoadGenerator::_think(Bot &bot, Server::Action action) {
+        timers.cancel(bot.think_timer);
+
+        unsigned int delay = settings.think_min_ms + random.below(settings.think_max_ms - settings.think_min_ms + 1);
+        Bot *target = &bot;
+        bot.think_timer = timers.schedule(std::chrono::milliseconds(delay), [this, target, action]() {
+            target->think_timer = 0;
+            if (target->state == BOT_PLAYING)
+                _play(*target, action);
+        });
+    }
+
+    void LoadGenerator::_play(Bot &bot, Server::Action action) {
+        bool sent;
+        if (action == Server::SEND_LETTER) {
+            LetterMessage message;
+            message.letter = _choose_letter(bot);
+            sent = _send(bot, message);
+            stats.letters.add();
+        } else {
+            // Il giocatore propone la frase come la conosce: se mancano delle lettere verrà rifiutata, ma il turno
+            // termina subito invece di attendere SHORT_PHRASE_TIMEOUT
+            ShortPhraseMessage message;
+            memcpy(message.short_phrase, bot.phrase, sizeof(message.short_phrase) - 1);
+            message.short_phrase[sizeof(message.short_phrase) - 1] = '\0';
+            sent = _send(bot, message);
+            stats.phrases.add();
+        }
+
+        if (sent) {
+            bot.pending = action;
+            bot.request_sent = Clock::now();
+        }
+    }
+
+    template<typename TypeMessage>
+    bool LoadGenerator::_send(Bot &bot, const TypeMessage &message) {
+        if (bot.state == BOT_CLOSED)
+            return false;
+
+        auto packet = std::bit_cast<Message>(message);
+
+        char bytes[WIRE_MAX_FRAME];
+        size_t size = Wire::encode(packet, bot.version, bytes);
+        bot.outbound.append(bytes, size);
+        stats.messages_sent.add();
+
+        return _flush(bot);
+    }
+
+    bool LoadGenerator::_flush(Bot &bot) {
+        while (!bot.outbound.empty()) {
+            ssize_t n = ::send(bot.sockfd, bot.outbound.data(), bot.outbound.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            // Il resto viene inviato quando il socket torna scrivibile
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!bot.waiting_writable)
+                    event_loop.modify(bot.sockfd, Server::EVENT_READ | Server::EVENT_WRITE);
+                bot.waiting_writable = true;
+                return true;
+            }
+
+            if (n < 0) {
+                _close(bot, errno == EPIPE || errno == ECONNRESET ? stats.server_closed : stats.errors);
+                return false;
+            }
+
+            stats.bytes_sent.add(n);
+            bot.outbound.erase(0, n);
+        }
+
+        if (bot.waiting_writable)
+            event_loop.modify(bot.sockfd, Server::EVENT_READ);
+        bot.waiting_writable = false;
+        return true;
+    }
+
+    void LoadGenerator::_close(Bot &bot, Server::Counter &reason) {
+        if (bot.state == BOT_CLOSED)
+            return;
+
+        reason.add();
+        timers.cancel(bot.think_timer);
+        bot.think_timer = 0;
+        bot.state = BOT_CLOSED;
+
+        event_loop.remove(bot.sockfd);
+        bot_by_sockfd.erase(bot.sockfd);
+        ::close(bot.sockfd);
+        bot.sockfd = -1;
+    }
+
+    void LoadGenerator::_progress(std::ostream &out) {
+        double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+        uint64_t closed = stats.server_closed.get() + stats.errors.get();
+
+        char line[200];
+        snprintf(line, sizeof(line), "[%6.1fs] joined %llu/%u, closed %llu, letters %llu, sent %llu, received %llu\n",
+                 elapsed, (unsigned long long) stats.joined.get(), settings.bots, (unsigned long long) closed,
+                 (unsigned long long) stats.letters.get(), (unsigned long long) stats.messages_sent.get(),
+                 (unsigned long long) stats.messages_received.get());
+        out << line << std::flush;
+
+        timers.schedule(std::chrono::milliseconds(LOADGEN_PROGRESS_INTERVAL_MS), [this, &out]() { _progress(out); });
+    }
+
+    void LoadGenerator::print_report(std::ostream &out) const {
+        double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+        if (elapsed <= 0)
+            elapsed = 1;
+
+        char line[200];
+        auto rate = [elapsed](const Server::Counter &counter) { return (double) counter.get() / elapsed; };
+
+        snprintf(line, sizeof(line), "Load test: %u bots against %s:%u for %.1f s\n", settings.bots,
+                 settings.address.c_str(), settings.port, elapsed);
+        out << line;
+
+        out << "\nConnections\n";
+        snprintf(line, sizeof(line), "  connected %llu, joined %llu, connect failures %llu\n",
+                 (unsigned long long) stats.connected.get(), (unsigned long long) stats.joined.get(),
+                 (unsigned long long) stats.connect_failures.get());
+        out << line;
+        snprintf(line, sizeof(line), "  disconnected by server %llu, errors %llu\n",
+                 (unsigned long long) stats.server_closed.get(), (unsigned long long) stats.errors.get());
+        out << line;
+
+        out << "\nThroughput\n";
+        snprintf(line, sizeof(line), "  messages sent %llu (%.1f/s), received %llu (%.1f/s)\n",
+                 (unsigned long long) stats.messages_sent.get(), rate(stats.messages_sent),
+                 (unsigned long long) stats.messages_received.get(), rate(stats.messages_received));
+        out << line;
+        snprintf(line, sizeof(line), "  bytes sent %llu (%.1f KiB/s), received %llu (%.1f KiB/s)\n",
+                 (unsigned long long) stats.bytes_sent.get(), rate(stats.bytes_sent) / 1024,
+                 (unsigned long long) stats.bytes_received.get(), rate(stats.bytes_received) / 1024);
+        out << line;
+        snprintf(line, sizeof(line), "  letters %llu (%.1f/s), phrases %llu, heartbeats %llu, resyncs %llu\n",
+                 (unsigned long long) stats.letters.get(), rate(stats.letters),
+                 (unsigned long long) stats.phrases.get(), (unsigned long long) stats.heartbeats.get(),
+                 (unsigned long long) stats.resyncs.get());
+        out << line;
+        snprintf(line, sizeof(line), "  round results received: %llu wins, %llu losses\n",
+                 (unsigned long long) stats.wins.get(), (unsigned long long) stats.losses.get());
+        out << line;
+
+        out << "\nLatency (ms)\n";
+        snprintf(line, sizeof(line), "  %-10s %9s %9s %9s %9s %9s %9s\n", "", "count", "p50", "p90", "p99", "p99.9",
+                 "max");
+        out << line;
+        write_percentiles(out, "join", stats.join_latency);
+        write_percentiles(out, "letter", stats.letter_latency);
+        write_percentiles(out, "phrase", stats.phrase_latency);
+    }
+}
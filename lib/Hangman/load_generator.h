@@ -0,0 +1,354 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <csignal>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#endif
+
+#include "protocol.h"
+#include "frame_buffer.h"
+#include "event_loop.h"
+#include "timer_wheel.h"
+#include "metrics.h"
+#include "random.h"
+
+
+/// Connessioni aperte al secondo durante l'avvio dei giocatori simulati, per non riempire la coda di listen del server
+#define LOADGEN_CONNECT_RATE 500
+/// Intervallo (in millisecondi) con cui vengono aperte le nuove connessioni durante l'avvio
+#define LOADGEN_RAMP_INTERVAL_MS 10
+/// Intervallo (in millisecondi) tra due righe di avanzamento
+#define LOADGEN_PROGRESS_INTERVAL_MS 1000
+/// Capacità del buffer di ricezione di un giocatore simulato, basta per diversi aggiornamenti della partita
+#define LOADGEN_INBOUND_CAPACITY 2048
+
+
+namespace Client {
+    using std::string;
+    using Server::Clock;
+
+    /**
+     * Modo in cui un giocatore simulato sceglie la lettera da provare
+     */
+    enum BotStrategy {
+        /// Le lettere in ordine di frequenza nella lingua, come un giocatore umano
+        BOT_STRATEGY_FREQUENCY,
+        /// Una lettera a caso tra quelle non ancora provate
+        BOT_STRATEGY_RANDOM,
+    } typedef BotStrategy;
+
+
+    /**
+     * Impostazioni del generatore di carico
+     */
+    struct LoadSettings {
+        /// Indirizzo del server, deve essere un indirizzo di loopback
+        string address = "127.0.0.1";
+        /// Porta del server
+        uint16_t port = 9090;
+        /// Numero di giocatori simulati
+        unsigned int bots = 1000;
+        /// Connessioni aperte al secondo durante l'avvio
+        unsigned int connect_rate = LOADGEN_CONNECT_RATE;
+        /// Durata della prova in secondi, a partire dalla prima connessione
+        unsigned int duration = 30;
+        /// Tempo minimo (in millisecondi) prima di rispondere a una richiesta del server
+        unsigned int think_min_ms = 50;
+        /// Tempo massimo (in millisecondi) prima di rispondere a una richiesta del server, sotto LETTER_TIMEOUT
+        unsigned int think_max_ms = 500;
+        /// Modo in cui i giocatori scelgono le lettere
+        BotStrategy strategy = BOT_STRATEGY_FREQUENCY;
+        /// Versione del protocollo richiesta nel messaggio di ingresso (0 per comportarsi come un client v1)
+        uint8_t version = PROTOCOL_VERSION;
+        /// Funzionalità opzionali richieste nel messaggio di ingresso
+        uint8_t capabilities = PROTOCOL_CAPABILITIES;
+        /// Nome della stanza in cui entrare (vuoto per lasciare la scelta al server)
+        string room;
+        /// Seme del generatore dei tempi di attesa e delle lettere casuali
+        uint64_t seed = 1;
+    } typedef LoadSettings;
+
+
+    /**
+     * Fase della connessione di un giocatore simulato
+     */
+    enum BotState {
+        /// Connessione non ancora aperta
+        BOT_IDLE,
+        /// In attesa che la connessione venga stabilita
+        BOT_CONNECTING,
+        /// Messaggio di ingresso inviato, in attesa del primo messaggio del server
+        BOT_JOINING,
+        /// Nella stanza, risponde alle richieste del server
+        BOT_PLAYING,
+        /// Connessione chiusa
+        BOT_CLOSED,
+    } typedef BotState;
+
+
+    /**
+     * Un giocatore simulato, con lo stato minimo per giocare come HangmanClient
+     */
+    struct Bot {
+        /// Socket della connessione (-1 se non è aperta)
+        int sockfd{-1};
+        /// Fase della connessione
+        BotState state{BOT_IDLE};
+        /// Bytes ricevuti e non ancora decodificati
+        FrameBuffer inbound{LOADGEN_INBOUND_CAPACITY};
+        /// Bytes codificati che il socket non ha ancora accettato
+        string outbound;
+        /// Se il loop di eventi segnala quando il socket torna scrivibile
+        bool waiting_writable{};
+        /// Versione del protocollo in uso, v1 fino alla conferma del server
+        uint8_t version{PROTOCOL_V1};
+        /// Funzionalità opzionali confermate dal server
+        uint8_t capabilities{};
+        /// Istante in cui è stata avviata la connessione
+        Clock::time_point connect_started{};
+        /// Istante in cui è stata inviata la lettera o la frase di cui si attende la risposta
+        Clock::time_point request_sent{};
+        /// Richiesta del server (SEND_LETTER o SEND_SHORT_PHRASE) a cui risponde il tentativo in attesa di esito, GENERIC
+        /// se non ce n'è uno
+        Server::Action pending{Server::GENERIC};
+        /// Timer che invia la risposta dopo il tempo di attesa (0 se non ce n'è uno programmato)
+        Server::TimerId think_timer{};
+        /// Frase mascherata come la conosce il giocatore
+        char phrase[SHORTPHRASE_LENGTH]{};
+        /// Lettere già provate nel round, il bit i corrisponde alla lettera 'A' + i
+        uint32_t used_letters{};
+        /// Tentativi fatti nel round
+        unsigned int attempts{};
+        /// Numero di sequenza dell'ultimo aggiornamento applicato
+        uint32_t sequence{};
+        /// Se è stato chiesto lo stato completo dopo aver perso un aggiornamento
+        bool resync_pending{};
+    } typedef Bot;
+
+
+    /**
+     * Misure raccolte durante la prova
+     * @brief Le durate sono in nanosecondi e sono misurate dal lato del client, quindi comprendono il tragitto sul
+     * loopback e il tempo che il messaggio ha atteso nel loop del server
+     */
+    struct LoadStats {
+        /// Tempo dall'avvio della connessione al primo messaggio del server
+        Server::Histogram join_latency;
+        /// Tempo dall'invio di una lettera alla risposta del server
+        Server::Histogram letter_latency;
+        /// Tempo dall'invio di una frase alla risposta del server
+        Server::Histogram phrase_latency;
+
+        /// Connessioni stabilite
+        Server::Counter connected;
+        /// Giocatori che hanno ricevuto il primo messaggio del server
+        Server::Counter joined;
+        /// Connessioni che non è stato possibile stabilire
+        Server::Counter connect_failures;
+        /// Connessioni chiuse dal server
+        Server::Counter server_closed;
+        /// Connessioni chiuse per un errore del socket o un messaggio non valido
+        Server::Counter errors;
+        /// Messaggi inviati
+        Server::Counter messages_sent;
+        /// Messaggi ricevuti
+        Server::Counter messages_received;
+        /// Bytes inviati
+        Server::Counter bytes_sent;
+        /// Bytes ricevuti
+        Server::Counter bytes_received;
+        /// Lettere inviate
+        Server::Counter letters;
+        /// Frasi inviate
+        Server::Counter phrases;
+        /// Risposte agli heartbeat
+        Server::Counter heartbeats;
+        /// Richieste dello stato completo dopo un aggiornamento perso
+        Server::Counter resyncs;
+        /// Vittorie ricevute, una per ogni giocatore della stanza
+        Server::Counter wins;
+        /// Sconfitte ricevute, una per ogni giocatore della stanza
+        Server::Counter losses;
+    } typedef LoadStats;
+
+
+    /**
+     * Generatore di carico: simula migliaia di giocatori da un solo processo
+     *
+     * Tutte le connessioni sono gestite da un solo thread con il loop di eventi del server: i socket sono non
+     * bloccanti e le attese dei giocatori (il tempo per pensare alla lettera o alla frase) sono timer sulla ruota, quindi
+     * un giocatore simulato costa qualche kilobyte e nessun thread. Ogni giocatore entra in una stanza,
+     * risponde agli heartbeat e gioca i propri turni come HangmanClient, senza terminale.
+     * Per evitare di caricare per errore un server di produzione, il generatore si collega solo a indirizzi di loopback.
+     * @note Questa classe non è thread-safe
+     */
+    class LoadGenerator {
+    private:
+        /// Le impostazioni della prova
+        LoadSettings settings;
+        /// Indirizzo del server
+        struct sockaddr_in server_address{};
+        /// Loop di eventi su cui sono registrati i socket dei giocatori
+        Server::EventLoop event_loop;
+        /// Ruota dei timer, per i tempi di attesa e l'avvio graduale delle connessioni
+        Server::TimerWheel timers;
+        /// I giocatori simulati, creati tutti all'inizio in modo che i loro indirizzi non cambino
+        std::vector<Bot> bots;
+        /// Indice del giocatore di ogni socket
+        std::unordered_map<int, size_t> bot_by_sockfd;
+        /// Generatore dei tempi di attesa e delle lettere casuali
+        Server::Random random;
+        /// Misure raccolte
+        LoadStats stats;
+        /// Numero di giocatori di cui è stata avviata la connessione
+        unsigned int launched{};
+        /// Connessioni che l'avvio graduale può ancora aprire, accumulate a ogni intervallo
+        double connect_budget{};
+        /// Istante della prima connessione
+        Clock::time_point started{};
+        /// Se la prova è terminata
+        bool stopping{};
+
+        /**
+         * Avvia la connessione di un giocatore
+         * @param bot Il giocatore
+         */
+        void _connect(Bot &bot);
+
+        /**
+         * Apre le connessioni permesse dall'avvio graduale e programma l'intervallo successivo
+         */
+        void _ramp();
+
+        /**
+         * Gestisce un evento sul socket di un giocatore
+         * @param bot Il giocatore
+         * @param event L'evento
+         */
+        void _on_event(Bot &bot, const Server::Event &event);
+
+        /**
+         * Invia il messaggio di ingresso dopo che la connessione è stata stabilita
+         * @param bot Il giocatore
+         */
+        void _on_connected(Bot &bot);
+
+        /**
+         * Legge dal socket e gestisce tutti i messaggi completi
+         * @param bot Il giocatore
+         * @return Se la connessione è ancora aperta
+         */
+        bool _receive(Bot &bot);
+
+        /**
+         * Gestisce un messaggio del server
+         * @param bot Il giocatore
+         * @param message Il messaggio
+         */
+        void _on_message(Bot &bot, const Server::Message &message);
+
+        /**
+         * Aggiorna lo stato della partita con un aggiornamento incrementale, come HangmanClient
+         * @param bot Il giocatore
+         * @param message L'aggiornamento
+         */
+        void _apply_delta(Bot &bot, const Server::UpdateDeltaMessage &message);
+
+        /**
+         * Sceglie la lettera da provare secondo la strategia, evitando quelle già provate e quelle bloccate
+         * @param bot Il giocatore
+         * @return La lettera
+         */
+        char _choose_letter(Bot &bot);
+
+        /**
+         * Risponde a una richiesta del server dopo un tempo di attesa casuale
+         * @param bot Il giocatore
+         * @param action La richiesta (SEND_LETTER o SEND_SHORT_PHRASE)
+         */
+        void _think(Bot &bot, Server::Action action);
+
+        /**
+         * Invia la lettera o la frase richiesta dal server
+         * @param bot Il giocatore
+         * @param action La richiesta (SEND_LETTER o SEND_SHORT_PHRASE)
+         */
+        void _play(Bot &bot, Server::Action action);
+
+        /**
+         * Codifica e invia un messaggio, accodando quello che il socket non accetta subito
+         * @tparam TypeMessage Un tipo di messaggio del client da 128 bytes
+         * @param bot Il giocatore
+         * @param message Il messaggio
+         * @return Se il messaggio è stato inviato o accodato
+         */
+        template<typename TypeMessage>
+        bool _send(Bot &bot, const TypeMessage &message);
+
+        /**
+         * Invia i bytes accodati
+         * @param bot Il giocatore
+         * @return Se la connessione è ancora aperta
+         */
+        bool _flush(Bot &bot);
+
+        /**
+         * Chiude la connessione di un giocatore
+         * @param bot Il giocatore
+         * @param reason Il contatore del motivo della chiusura
+         */
+        void _close(Bot &bot, Server::Counter &reason);
+
+        /**
+         * Stampa una riga con l'avanzamento della prova e programma la successiva
+         * @param out Lo stream su cui stampare
+         */
+        void _progress(std::ostream &out);
+
+    public:
+        /**
+         * Costruttore della classe LoadGenerator
+         * @param _settings Le impostazioni della prova
+         * @throws std::runtime_error Se l'indirizzo non è valido o non è di loopback
+         */
+        explicit LoadGenerator(const LoadSettings &_settings);
+
+        /**
+         * Distruttore della classe LoadGenerator
+         * @brief Chiude le connessioni ancora aperte
+         */
+        ~LoadGenerator();
+
+        LoadGenerator(const LoadGenerator &) = delete;
+        LoadGenerator &operator=(const LoadGenerator &) = delete;
+
+        /**
+         * Esegue la prova per la durata impostata
+         * @param progress Lo stream su cui stampare l'avanzamento, una riga al secondo
+         * @param interrupted Flag impostato da un gestore di segnali per terminare la prova prima della fine (nullptr
+         * se la prova non si può interrompere)
+         */
+        void run(std::ostream &progress, const volatile sig_atomic_t *interrupted = nullptr);
+
+        /**
+         * Stampa il resoconto della prova: throughput, percentili delle latenze e disconnessioni
+         * @param out Lo stream su cui stampare
+         */
+        void print_report(std::ostream &out) const;
+
+        /**
+         * @return Le misure raccolte
+         */
+        const LoadStats &get_stats() const { return stats; }
+    };
+}
+
+
+#endif  // LOAD_GENERATOR_H
@@ -0,0 +1,476 @@
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+
+namespace Server {
+    namespace {
+        /// Nomi dei livelli, allineati alla stessa larghezza
+        const char *const LEVEL_NAMES[] = {"DEBUG  ", "INFO   ", "WARNING", "ERROR  "};
+
+        /**
+         * @return L'istante corrente, in nanosecondi dall'epoca Unix
+         */
+        int64_t now_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+
+        /**
+         * Buffer di uno stream che scrive in un'area di memoria fissa e tronca quello che non ci sta
+         */
+        class FixedStreamBuffer : public std::streambuf {
+        public:
+            /**
+             * Imposta l'area in cui scrivere
+             * @param begin L'inizio dell'area (nullptr per scartare tutto)
+             * @param size La dimensione dell'area
+             */
+            void reset(char *begin, size_t size) {
+                setp(begin, begin + size);
+                overflowed = false;
+            }
+
+            /**
+             * @return I bytes scritti dall'ultima chiamata a reset()
+             */
+            size_t length() const { return pptr() - pbase(); }
+
+            /**
+             * @return Se dall'ultima chiamata a reset() qualcosa non è stato scritto per mancanza di spazio
+             */
+            bool truncated() const { return overflowed; }
+
+        protected:
+            int_type overflow(int_type character) override {
+                if (!traits_type::eq_int_type(character, traits_type::eof()))
+                    overflowed = true;
+                return traits_type::eof();
+            }
+
+        private:
+            /// Se qualcosa non è stato scritto per mancanza di spazio
+            bool overflowed{};
+        };
+
+
+        /**
+         * Buffer circolare dei messaggi di un thread, con un solo scrittore (il thread) e un solo lettore (LogWriter)
+         */
+        struct LogRing {
+            /// I messaggi, il prossimo viene scritto in posizione reserved % LOG_RING_RECORDS
+            LogRecord records[LOG_RING_RECORDS];
+            /// Numero di messaggi consegnati dal thread
+            std::atomic<uint64_t> head{};
+            /// Numero di messaggi riservati dal thread, supera head finché ci sono messaggi in formattazione; usato solo
+            /// dal thread
+            uint64_t reserved{};
+            /// Numero di messaggi letti dal thread di scrittura
+            std::atomic<uint64_t> tail{};
+            /// Messaggi scartati perché il buffer era pieno
+            std::atomic<uint64_t> dropped{};
+            /// Messaggi scartati per il limite al secondo
+            std::atomic<uint64_t> limited{};
+            /// Messaggi troncati perché più lunghi di un LogRecord
+            std::atomic<uint64_t> truncated{};
+            /// Messaggi che il thread può ancora registrare prima del limite, usato solo dal thread
+            double tokens{LOG_RATE_BURST};
+            /// Istante dell'ultimo aggiornamento di tokens, usato solo dal thread
+            std::chrono::steady_clock::time_point refilled_at{std::chrono::steady_clock::now()};
+        } typedef LogRing;
+
+
+        /**
+         * Il thread di scrittura, con il registro dei buffer di tutti i thread
+         * @note Non viene mai distrutto: i thread che registrano messaggi durante l'uscita del programma continuano a
+         * usare il proprio buffer, che semplicemente non viene più svuotato
+         */
+        class LogWriter {
+        public:
+            /// Livello minimo dei messaggi da scrivere
+            std::atomic<LogLevel> level{LOG_LEVEL_INFO};
+
+        private:
+            /// Protegge rings
+            std::mutex registry_mutex;
+            /// I buffer di tutti i thread che hanno registrato almeno un messaggio
+            std::vector<std::unique_ptr<LogRing>> rings;
+            /// Protegge file
+            std::mutex file_mutex;
+            /// Il file su cui scrivere (nullptr per lo standard output e lo standard error)
+            FILE *file{};
+            /// Chiede al thread di terminare
+            std::atomic<bool> stopping{};
+            /// Messaggi scartati già segnalati
+            uint64_t reported_dropped{};
+            /// Messaggi troncati già segnalati
+            uint64_t reported_truncated{};
+            /// Il thread che scrive i messaggi
+            std::thread thread;
+
+            /**
+             * Raccoglie i messaggi di tutti i buffer e li scrive
+             */
+            void _drain() {
+                std::vector<LogRing *> snapshot;
+                {
+                    std::lock_guard<std::mutex> lock(registry_mutex);
+                    for (auto &ring: rings) {
+                        snapshot.push_back(ring.get());
+                    }
+                }
+
+                std::vector<LogRecord> batch;
+                uint64_t dropped = 0, truncated = 0;
+                for (LogRing *ring: snapshot) {
+                    uint64_t head = ring->head.load(std::memory_order_acquire);
+                    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+                    for (; tail < head; tail++) {
+                        batch.push_back(ring->records[tail % LOG_RING_RECORDS]);
+                    }
+
+                    // Il thread può riusare i posti solo dopo che i messaggi sono stati copiati
+                    ring->tail.store(tail, std::memory_order_release);
+                    dropped += ring->dropped.load(std::memory_order_relaxed) +
+                               ring->limited.load(std::memory_order_relaxed);
+                    truncated += ring->truncated.load(std::memory_order_relaxed);
+                }
+
+                if (batch.empty() && dropped == reported_dropped && truncated == reported_truncated)
+                    return;
+
+                // I buffer dei thread sono ordinati ciascuno per conto proprio, l'output lo è per istante
+                std::stable_sort(batch.begin(), batch.end(), [](const LogRecord &a, const LogRecord &b) {
+                    return a.timestamp < b.timestamp;
+                });
+
+                std::string out, err;
+                for (const LogRecord &record: batch) {
+                    _format(file != nullptr || record.level < LOG_LEVEL_WARNING ? out : err, record.timestamp,
+                            record.level, std::string_view(record.text, record.length));
+                }
+
+                if (dropped > reported_dropped) {
+                    std::string message = std::to_string(dropped - reported_dropped) + " log messages dropped";
+                    _format(file != nullptr ? out : err, now_ns(), LOG_LEVEL_WARNING, message);
+                    reported_dropped = dropped;
+                }
+                if (truncated > reported_truncated) {
+                    std::string message = std::to_string(truncated - reported_truncated) + " log messages truncated";
+                    _format(file != nullptr ? out : err, now_ns(), LOG_LEVEL_WARNING, message);
+                    reported_truncated = truncated;
+                }
+
+                // Una sola scrittura per destinazione e per giro
+                std::lock_guard<std::mutex> lock(file_mutex);
+                FILE *out_file = file != nullptr ? file : stdout;
+                if (!out.empty()) {
+                    fwrite(out.data(), 1, out.size(), out_file);
+                    fflush(out_file);
+                }
+                if (!err.empty()) {
+                    fwrite(err.data(), 1, err.size(), stderr);
+                    fflush(stderr);
+                }
+            }
+
+            /**
+             * Aggiunge un messaggio al testo da scrivere, preceduto dall'istante e dal livello
+             * @param out Il testo da scrivere
+             * @param timestamp L'istante del messaggio, in nanosecondi dall'epoca Unix
+             * @param level Il livello del messaggio
+             * @param text Il testo del messaggio
+             */
+            static void _format(std::string &out, int64_t timestamp, LogLevel level, std::string_view text) {
+                time_t seconds = (time_t) (timestamp / 1000000000);
+                struct tm utc{};
+#ifdef _WIN32
+                gmtime_s(&utc, &seconds);
+#else
+                gmtime_r(&seconds, &utc);
+#endif
+
+                char prefix[48];
+                size_t length = strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &utc);
+                snprintf(prefix + length, sizeof(prefix) - length, ".%03d %s ",
+                         (int) (timestamp / 1000000 % 1000), LEVEL_NAMES[level]);
+
+                // Le righe vuote alla fine servivano a separare i messaggi sul terminale, qui li separa già il prefisso
+                while (!text.empty() && text.back() == '\n')
+                    text.remove_suffix(1);
+
+                // Le righe successive alla prima sono allineate al testo della prima
+                size_t prefix_length = strlen(prefix);
+                out += prefix;
+                while (true) {
+                    size_t end = text.find('\n');
+                    out += text.substr(0, end);
+                    out += '\n';
+                    if (end == std::string_view::npos)
+                        break;
+
+                    text.remove_prefix(end + 1);
+                    out.append(prefix_length, ' ');
+                }
+            }
+
+        public:
+            LogWriter() : thread([this]() {
+#ifndef _WIN32
+                // I segnali destinati al processo devono arrivare ai thread che li attendono, non a questo
+                sigset_t signals;
+                sigfillset(&signals);
+                pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+#endif
+
+                while (!stopping.load(std::memory_order_relaxed)) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+                    _drain();
+                }
+
+                // Scrive i messaggi registrati prima della richiesta di terminare
+                _drain();
+            }) {
+                // All'uscita del programma il thread scrive i messaggi rimasti prima di terminare
+                std::atexit([]() { instance().stop(); });
+            }
+
+            /**
+             * @return L'unica istanza, creata al primo utilizzo
+             */
+            static LogWriter &instance() {
+                static auto *writer = new LogWriter();
+                return *writer;
+            }
+
+            /**
+             * Arresta il thread dopo aver scritto i messaggi rimasti
+             */
+            void stop() {
+                stopping.store(true, std::memory_order_relaxed);
+                if (thread.joinable())
+                    thread.join();
+            }
+
+            /**
+             * Crea il buffer di un thread
+             * @return Il buffer, che non viene mai liberato
+             */
+            LogRing *add_ring() {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                rings.push_back(std::make_unique<LogRing>());
+                return rings.back().get();
+            }
+
+            /**
+             * Sostituisce il file su cui scrivere
+             * @param _file Il nuovo file
+             */
+            void set_file(FILE *_file) {
+                std::lock_guard<std::mutex> lock(file_mutex);
+                if (file != nullptr)
+                    fclose(file);
+                file = _file;
+            }
+
+            /**
+             * @return I messaggi scartati da tutti i thread
+             */
+            uint64_t dropped() {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                uint64_t total = 0;
+                for (auto &ring: rings) {
+                    total += ring->dropped.load(std::memory_order_relaxed) + ring->limited.load(std::memory_order_relaxed);
+                }
+
+                return total;
+            }
+
+            /**
+             * @return I messaggi troncati da tutti i thread
+             */
+            uint64_t truncated() {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                uint64_t total = 0;
+                for (auto &ring: rings) {
+                    total += ring->truncated.load(std::memory_order_relaxed);
+                }
+
+                return total;
+            }
+        };
+
+
+        /**
+         * @return Il buffer del thread corrente, creato al primo utilizzo
+         */
+        LogRing &local_ring() {
+            thread_local LogRing *ring = LogWriter::instance().add_ring();
+            return *ring;
+        }
+
+        /**
+         * Stream su cui formattare un messaggio, riusato per evitare di costruirne uno per messaggio
+         */
+        struct LogStream {
+            /// Il buffer dello stream, punta al testo del messaggio
+            FixedStreamBuffer buffer;
+            /// Lo stream
+            std::ostream stream{&buffer};
+        } typedef LogStream;
+
+        /// Uno stream per ogni profondità, più uno per i messaggi scartati perché troppo interni
+        thread_local LogStream local_streams[LOG_MAX_NESTING + 1];
+        /// Numero di messaggi in formattazione nel thread corrente
+        thread_local unsigned int local_depth = 0;
+        /// Se il thread corrente ha riservato dei messaggi non ancora consegnati
+        thread_local bool local_pending = false;
+
+        /**
+         * Riserva un messaggio nel buffer del thread corrente
+         * @param level Il livello del messaggio
+         * @return Il messaggio riservato, nullptr se deve essere scartato
+         */
+        LogRecord *reserve(LogLevel level) {
+            LogWriter &writer = LogWriter::instance();
+            if (level < writer.level.load(std::memory_order_relaxed))
+                return nullptr;
+
+            LogRing &ring = local_ring();
+
+            // Limite al secondo: ogni messaggio consuma un gettone, i gettoni si ricaricano con il tempo
+            auto now = std::chrono::steady_clock::now();
+            ring.tokens = std::min<double>(LOG_RATE_BURST, ring.tokens + LOG_RATE_LIMIT *
+                    std::chrono::duration<double>(now - ring.refilled_at).count());
+            ring.refilled_at = now;
+            if (ring.tokens < 1) {
+                ring.limited.store(ring.limited.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            ring.tokens -= 1;
+
+            // Un buffer pieno non deve mai bloccare il thread: il messaggio viene scartato e conteggiato, come quelli
+            // troppo interni per avere uno stream
+            if (ring.reserved - ring.tail.load(std::memory_order_acquire) >= LOG_RING_RECORDS ||
+                local_depth > LOG_MAX_NESTING) {
+                ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            LogRecord &record = ring.records[ring.reserved++ % LOG_RING_RECORDS];
+            local_pending = true;
+            record.timestamp = now_ns();
+            record.level = level;
+            return &record;
+        }
+
+        /**
+         * @param depth La profondità del messaggio tra quelli in formattazione nel thread
+         * @return Lo stream del thread corrente per i messaggi a quella profondità
+         */
+        LogStream &local_stream(unsigned int depth) {
+            return local_streams[std::min<unsigned int>(depth, LOG_MAX_NESTING)];
+        }
+
+        /**
+         * Prepara lo stream del thread corrente per un nuovo messaggio
+         * @param depth La profondità del messaggio tra quelli in formattazione nel thread
+         * @param record Il messaggio in cui scrivere (nullptr per scartare il testo)
+         * @return Lo stream
+         */
+        std::ostream &prepare_stream(unsigned int depth, LogRecord *record) {
+            LogStream &local = local_stream(depth);
+            if (record != nullptr)
+                local.buffer.reset(record->text, sizeof(record->text));
+            else
+                local.buffer.reset(nullptr, 0);
+
+            // Lo stream è condiviso da tutti i messaggi del thread, quindi riparte dalla formattazione predefinita
+            local.stream.clear();
+            local.stream.flags(std::ios_base::dec | std::ios_base::skipws);
+            local.stream.precision(6);
+            local.stream.fill(' ');
+            return local.stream;
+        }
+    }
+
+    Log::Log(LogLevel level) : depth(local_depth++), record(reserve(level)), out(prepare_stream(depth, record)) {}
+
+    Log::~Log() {
+        local_depth--;
+        if (record != nullptr) {
+            FixedStreamBuffer &buffer = local_stream(depth).buffer;
+            record->length = (uint16_t) buffer.length();
+
+            // Un messaggio troncato finisce con il segno al posto degli ultimi caratteri, per non sembrare completo
+            if (buffer.truncated()) {
+                constexpr size_t marker_length = sizeof(LOG_TRUNCATION_MARKER) - 1;
+                memcpy(record->text + sizeof(record->text) - marker_length, LOG_TRUNCATION_MARKER, marker_length);
+                LogRing &ring = local_ring();
+                ring.truncated.store(ring.truncated.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+
+        // I messaggi vengono consegnati al thread di scrittura quando è finito il più esterno: prima il thread di
+        // scrittura leggerebbe anche i posti dei messaggi ancora in formattazione
+        if (local_depth == 0 && local_pending) {
+            LogRing &ring = local_ring();
+            ring.head.store(ring.reserved, std::memory_order_release);
+            local_pending = false;
+        }
+    }
+
+    void Logger::set_level(LogLevel level) {
+        LogWriter::instance().level.store(level, std::memory_order_relaxed);
+    }
+
+    LogLevel Logger::get_level() {
+        return LogWriter::instance().level.load(std::memory_order_relaxed);
+    }
+
+    void Logger::set_file(const string &filename) {
+        FILE *file = fopen(filename.c_str(), "a");
+        if (file == nullptr) {
+            throw std::runtime_error("Impossibile aprire il file di log " + filename);
+        }
+
+        LogWriter::instance().set_file(file);
+    }
+
+    bool Logger::parse_level(const string &name, LogLevel &level) {
+        const char *names[] = {"debug", "info", "warning", "error"};
+        for (uint8_t i = 0; i <= LOG_LEVEL_ERROR; i++) {
+            if (name == names[i]) {
+                level = (LogLevel) i;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    uint64_t Logger::get_dropped() {
+        return LogWriter::instance().dropped();
+    }
+
+    uint64_t Logger::get_truncated() {
+        return LogWriter::instance().truncated();
+    }
+}
@@ -0,0 +1,161 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+
+/// Dimensione di un messaggio nel buffer di un thread, i messaggi più lunghi vengono troncati
+#define LOG_RECORD_SIZE 512
+/// Aggiunto in fondo ai messaggi troncati
+#define LOG_TRUNCATION_MARKER " [...]"
+/// Numero di messaggi nel buffer di ogni thread, quelli che non ci stanno vengono scartati
+#define LOG_RING_RECORDS 512
+/// Millisecondi tra due svuotamenti dei buffer da parte del thread di scrittura
+#define LOG_FLUSH_INTERVAL_MS 20
+/// Messaggi al secondo che ogni thread può registrare a regime
+#define LOG_RATE_LIMIT 1000
+/// Messaggi che ogni thread può registrare di seguito prima che intervenga il limite
+#define LOG_RATE_BURST 2000
+/// Messaggi che un thread può formattare uno dentro l'altro, quelli più interni vengono scartati
+#define LOG_MAX_NESTING 4
+
+
+namespace Server {
+    using std::string;
+
+    /**
+     * Livelli di importanza dei messaggi
+     */
+    enum LogLevel : uint8_t {
+        /// Dettagli utili solo durante lo sviluppo
+        LOG_LEVEL_DEBUG,
+        /// Andamento normale del server
+        LOG_LEVEL_INFO,
+        /// Problemi da cui il server si è ripreso da solo
+        LOG_LEVEL_WARNING,
+        /// Errori che hanno interrotto un'operazione
+        LOG_LEVEL_ERROR,
+    } typedef LogLevel;
+
+
+    /**
+     * Un messaggio nel buffer di un thread, già formattato
+     */
+    struct LogRecord {
+        /// Istante in cui è stato registrato, in nanosecondi dall'epoca Unix
+        int64_t timestamp;
+        /// Numero di bytes di text usati
+        uint16_t length;
+        /// Livello del messaggio
+        LogLevel level;
+        /// Testo del messaggio, senza terminatore
+        char text[LOG_RECORD_SIZE - sizeof(int64_t) - sizeof(uint16_t) - sizeof(LogLevel)];
+    } typedef LogRecord;
+
+
+    /**
+     * Un messaggio in corso di scrittura
+     *
+     * Si usa come uno stream: Log(LOG_LEVEL_INFO) << "Server port: " << port; il messaggio viene formattato
+     * direttamente nel buffer circolare del thread e consegnato al thread di scrittura alla distruzione, senza lock e
+     * senza chiamate di sistema. Se il buffer è pieno, o il thread ha superato il limite di messaggi al secondo, il
+     * messaggio viene scartato e conteggiato; un messaggio troppo lungo viene troncato, segnato con
+     * LOG_TRUNCATION_MARKER e conteggiato.
+     * Un messaggio può essere registrato mentre se ne formatta un altro (ad esempio da un operator<<): ognuno ha il
+     * proprio posto e il proprio stream, e i messaggi interni vengono consegnati insieme a quello più esterno.
+     */
+    class Log {
+    private:
+        /// Numero di messaggi già in formattazione nel thread quando è stato creato questo
+        unsigned int depth;
+        /// Il messaggio riservato nel buffer (nullptr se il messaggio viene scartato)
+        LogRecord *record;
+        /// Lo stream su cui formattare il messaggio, riusato da tutti i messaggi del thread alla stessa profondità
+        std::ostream &out;
+
+    public:
+        /**
+         * Costruttore della classe Log
+         * @brief Riserva il posto per il messaggio nel buffer del thread corrente
+         * @param level Il livello del messaggio, se è sotto il livello minimo il messaggio viene ignorato
+         */
+        explicit Log(LogLevel level);
+
+        /**
+         * Distruttore della classe Log
+         * @brief Consegna il messaggio al thread di scrittura, se non è contenuto in un altro messaggio
+         */
+        ~Log();
+
+        Log(const Log &) = delete;
+        Log &operator=(const Log &) = delete;
+
+        /**
+         * @return Lo stream su cui formattare il messaggio, per le funzioni che scrivono su uno std::ostream
+         */
+        std::ostream &stream() { return out; }
+
+        template<typename T>
+        Log &operator<<(const T &value) {
+            out << value;
+            return *this;
+        }
+    };
+
+
+    /**
+     * Scrive i messaggi di tutti i thread da un thread dedicato
+     *
+     * Ogni thread ha un proprio buffer circolare con un solo scrittore e un solo lettore, quindi registrare un messaggio
+     * non blocca mai il loop di gioco: un terminale lento o una pipe piena rallentano solo il thread di scrittura, che
+     * a ogni giro raccoglie i messaggi di tutti i buffer, li ordina per istante e li scrive con una sola chiamata.
+     * Senza un file, i messaggi di livello WARNING o superiore vanno sullo standard error e gli altri sullo standard
+     * output.
+     * @note Il thread di scrittura parte al primo messaggio e scrive i messaggi rimasti all'uscita del programma
+     */
+    class Logger {
+    public:
+        /**
+         * Imposta il livello minimo dei messaggi da scrivere
+         * @note Può essere chiamata da qualsiasi thread
+         * @param level Il livello minimo
+         */
+        static void set_level(LogLevel level);
+
+        /**
+         * @return Il livello minimo dei messaggi da scrivere
+         */
+        static LogLevel get_level();
+
+        /**
+         * Scrive i messaggi su un file invece che sullo standard output
+         * @param filename Il nome del file, a cui vengono aggiunti i messaggi
+         * @throws std::runtime_error Se non è possibile aprire il file
+         */
+        static void set_file(const string &filename);
+
+        /**
+         * Converte il nome di un livello
+         * @param name Il nome del livello (debug, info, warning o error)
+         * @param level Dove scrivere il livello
+         * @return Se il nome è valido
+         */
+        static bool parse_level(const string &name, LogLevel &level);
+
+        /**
+         * @return I messaggi scartati dalla creazione, perché un buffer era pieno o per il limite al secondo
+         */
+        static uint64_t get_dropped();
+
+        /**
+         * @return I messaggi troncati dalla creazione, perché più lunghi di LOG_RECORD_SIZE
+         */
+        static uint64_t get_truncated();
+    };
+}
+
+
+#endif  // LOGGER_H
@@ -0,0 +1,262 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include "protocol.h"
+#include "trace.h"
+
+
+namespace Server {
+    namespace {
+        /**
+         * Scrive le righe HELP e TYPE di una metrica
+         * @param out Lo stream su cui scrivere
+         * @param name Il nome della metrica
+         * @param type Il tipo della metrica (counter, gauge o histogram)
+         * @param help La descrizione della metrica
+         */
+        void write_header(std::ostream &out, const char *name, const char *type, const char *help) {
+            out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+        }
+
+        /**
+         * Scrive una metrica con un solo valore
+         * @param out Lo stream su cui scrivere
+         * @param name Il nome della metrica
+         * @param type Il tipo della metrica (counter o gauge)
+         * @param help La descrizione della metrica
+         * @param value Il valore
+         */
+        void write_value(std::ostream &out, const char *name, const char *type, const char *help, uint64_t value) {
+            write_header(out, name, type, help);
+            out << name << ' ' << value << '\n';
+        }
+    }
+
+    uint64_t Histogram::upper_bound_of(size_t bucket) {
+        if (bucket < HISTOGRAM_SUB_BUCKETS)
+            return bucket;
+
+        // L'inverso di bucket_of(): la potenza di due dà lo spostamento, i bit bassi il sotto-intervallo
+        unsigned int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+        uint64_t lower = (uint64_t) (HISTOGRAM_SUB_BUCKETS + (bucket & (HISTOGRAM_SUB_BUCKETS - 1))) << shift;
+        return lower + ((uint64_t) 1 << shift) - 1;
+    }
+
+    void Histogram::merge(const Histogram &other) {
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            uint64_t value = other.buckets[i].load(std::memory_order_relaxed);
+            if (value > 0)
+                buckets[i].fetch_add(value, std::memory_order_relaxed);
+        }
+
+        count.add(other.count.get());
+        sum.add(other.sum.get());
+    }
+
+    uint64_t Histogram::value_at_quantile(double quantile) const {
+        // Come in write_prometheus(), il totale è ricalcolato dagli intervalli che vengono letti
+        uint64_t total = 0;
+        for (const auto &bucket: buckets)
+            total += bucket.load(std::memory_order_relaxed);
+        if (total == 0)
+            return 0;
+
+        // La posizione del quantile tra i valori ordinati, contata da 1
+        auto rank = (uint64_t) std::ceil(std::clamp(quantile, 0.0, 1.0) * (double) total);
+        rank = std::max<uint64_t>(rank, 1);
+
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            cumulative += buckets[i].load(std::memory_order_relaxed);
+            if (cumulative >= rank)
+                return upper_bound_of(i);
+        }
+
+        return upper_bound_of(HISTOGRAM_BUCKETS - 1);
+    }
+
+    void Histogram::write_prometheus(std::ostream &out, const string &name, const string &labels) const {
+        string separator = labels.empty() ? "" : ",";
+
+        // I contatori degli intervalli vengono letti uno alla volta mentre il worker continua a scriverli, quindi il
+        // totale è ricalcolato da loro: le serie cumulative restano coerenti anche se count è già più avanti
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        for (int power = HISTOGRAM_EXPORT_MIN_POWER; power <= HISTOGRAM_EXPORT_MAX_POWER; power++) {
+            size_t limit = bucket_of((uint64_t) 1 << power);
+            for (; bucket < limit; bucket++)
+                cumulative += buckets[bucket].load(std::memory_order_relaxed);
+
+            out << name << "_bucket{" << labels << separator << "le=\"" << (double) ((uint64_t) 1 << power) / 1e9
+                << "\"} " << cumulative << '\n';
+        }
+
+        for (; bucket < HISTOGRAM_BUCKETS; bucket++)
+            cumulative += buckets[bucket].load(std::memory_order_relaxed);
+
+        out << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << cumulative << '\n';
+        out << name << "_sum" << (labels.empty() ? "" : "{" + labels + "}") << ' ' << (double) sum.get() / 1e9 << '\n';
+        out << name << "_count" << (labels.empty() ? "" : "{" + labels + "}") << ' ' << cumulative << '\n';
+    }
+
+    MetricsServer::MetricsServer(uint16_t port, std::vector<const Metrics *> _sources) : sources(std::move(_sources)) {
+        sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd < 0) {
+            throw std::runtime_error("Errore nell'inizializzazione della socket delle metriche");
+        }
+
+        // Un riavvio non deve aspettare che le connessioni precedenti escano da TIME_WAIT
+        int enable = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (char *) &enable, sizeof(enable));
+
+        // Le metriche sono esposte solo sull'interfaccia locale
+        struct sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (bind(sockfd, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(sockfd, SOMAXCONN) < 0) {
+            closesocket(sockfd);
+            throw std::runtime_error("Errore nel collegamento della socket delle metriche");
+        }
+
+        thread = std::thread([this]() {
+            while (!stopping.load(std::memory_order_relaxed)) {
+                // L'attesa ha un limite, così il distruttore non resta bloccato su accept()
+                struct pollfd pfd{sockfd, POLLIN, 0};
+                if (poll(&pfd, 1, METRICS_REQUEST_TIMEOUT_MS) <= 0)
+                    continue;
+
+                int client_sockfd = ::accept(sockfd, nullptr, nullptr);
+                if (client_sockfd < 0)
+                    continue;
+
+                _serve(client_sockfd);
+                closesocket(client_sockfd);
+            }
+        });
+    }
+
+    MetricsServer::~MetricsServer() {
+        stopping.store(true, std::memory_order_relaxed);
+        if (thread.joinable())
+            thread.join();
+
+        closesocket(sockfd);
+    }
+
+    void MetricsServer::_serve(int client_sockfd) const {
+        // Un client che non invia la richiesta non deve bloccare le altre
+#ifdef _WIN32
+        DWORD timeout = METRICS_REQUEST_TIMEOUT_MS;
+#else
+        struct timeval timeout{METRICS_REQUEST_TIMEOUT_MS / 1000, (METRICS_REQUEST_TIMEOUT_MS % 1000) * 1000};
+#endif
+        setsockopt(client_sockfd, SOL_SOCKET, SO_RCVTIMEO, (char *) &timeout, sizeof(timeout));
+        setsockopt(client_sockfd, SOL_SOCKET, SO_SNDTIMEO, (char *) &timeout, sizeof(timeout));
+
+        // Serve solo la riga della richiesta, le intestazioni vengono ignorate
+        char request[1024];
+        size_t received = 0;
+        while (received < sizeof(request) - 1 && memchr(request, '\n', received) == nullptr) {
+            ssize_t n = recv(client_sockfd, request + received, sizeof(request) - 1 - received, 0);
+            if (n <= 0)
+                return;
+            received += n;
+        }
+        request[received] = '\0';
+
+        std::ostringstream body;
+        const char *status = "200 OK";
+        const char *content_type = "text/plain; version=0.0.4; charset=utf-8";
+        if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0) {
+            write_prometheus(body, sources);
+        } else if (Tracer::enabled() && strncmp(request, "GET /trace ", 11) == 0) {
+            // Gli eventi registrati finora, da aprire con chrome://tracing o Perfetto
+            Tracer::write_chrome_json(body);
+            content_type = "application/json";
+        } else {
+            status = "404 Not Found";
+            body << "Not found\n";
+        }
+
+        std::string content = body.str();
+        std::ostringstream response;
+        response << "HTTP/1.1 " << status << "\r\n"
+                 << "Content-Type: " << content_type << "\r\n"
+                 << "Content-Length: " << content.size() << "\r\n"
+                 << "Connection: close\r\n\r\n"
+                 << content;
+
+        std::string data = response.str();
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = ::send(client_sockfd, data.data() + sent, (int) (data.size() - sent), MSG_NOSIGNAL);
+            if (n <= 0 && errno != EINTR)
+                return;
+            if (n > 0)
+                sent += n;
+        }
+    }
+
+    void MetricsServer::write_prometheus(std::ostream &out, const std::vector<const Metrics *> &sources) {
+        // Gli istogrammi dei worker vengono riuniti qui, nel thread dell'endpoint
+        auto total = std::make_unique<Metrics>();
+        uint64_t bytes_in = 0, bytes_out = 0, accepted = 0, joined = 0, syscalls = 0;
+        uint64_t rooms = 0, players = 0, queued_bytes = 0;
+        for (const Metrics *source: sources) {
+            total->accept_to_join.merge(source->accept_to_join);
+            total->letter_turn.merge(source->letter_turn);
+            total->phrase_turn.merge(source->phrase_turn);
+            total->recv_time.merge(source->recv_time);
+            total->send_time.merge(source->send_time);
+            total->heartbeat_rtt.merge(source->heartbeat_rtt);
+
+            bytes_in += source->bytes_in.get();
+            bytes_out += source->bytes_out.get();
+            accepted += source->accepted.get();
+            joined += source->joined.get();
+            syscalls += source->syscalls.get();
+            rooms += source->rooms.get();
+            players += source->players.get();
+            queued_bytes += source->queued_bytes.get();
+        }
+
+        // I limiti degli intervalli sono potenze di due in nanosecondi, in secondi servono fino a 11 cifre
+        out.precision(12);
+
+        write_header(out, "hangman_accept_to_join_seconds", "histogram",
+                     "Time from accepting a connection to receiving its join message.");
+        total->accept_to_join.write_prometheus(out, "hangman_accept_to_join_seconds");
+
+        write_header(out, "hangman_turn_latency_seconds", "histogram",
+                     "Time from asking a player for a move to receiving it.");
+        total->letter_turn.write_prometheus(out, "hangman_turn_latency_seconds", "action=\"letter\"");
+        total->phrase_turn.write_prometheus(out, "hangman_turn_latency_seconds", "action=\"phrase\"");
+
+        write_header(out, "hangman_syscall_seconds", "histogram", "Duration of socket receive and send system calls.");
+        total->recv_time.write_prometheus(out, "hangman_syscall_seconds", "call=\"recv\"");
+        total->send_time.write_prometheus(out, "hangman_syscall_seconds", "call=\"send\"");
+
+        write_header(out, "hangman_heartbeat_rtt_seconds", "histogram",
+                     "Time from sending a heartbeat to hearing back from the player.");
+        total->heartbeat_rtt.write_prometheus(out, "hangman_heartbeat_rtt_seconds");
+
+        write_value(out, "hangman_received_bytes_total", "counter", "Bytes received from players.", bytes_in);
+        write_value(out, "hangman_sent_bytes_total", "counter", "Bytes sent to players.", bytes_out);
+        write_value(out, "hangman_accepted_connections_total", "counter", "Connections accepted.", accepted);
+        write_value(out, "hangman_joined_players_total", "counter", "Players that joined a room.", joined);
+        write_value(out, "hangman_syscalls_total", "counter", "System calls made by the event loops.", syscalls);
+        write_value(out, "hangman_rooms", "gauge", "Active rooms.", rooms);
+        write_value(out, "hangman_players", "gauge", "Connected players.", players);
+        write_value(out, "hangman_queued_bytes", "gauge", "Bytes waiting to be sent to players.", queued_bytes);
+        write_value(out, "hangman_workers", "gauge", "Worker threads.", sources.size());
+    }
+}
@@ -0,0 +1,235 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/// Bit di precisione di ogni potenza di due di un istogramma: 8 sotto-intervalli, errore relativo al più del 12.5%
+#define HISTOGRAM_SUB_BITS 3
+/// Numero di sotto-intervalli di ogni potenza di due
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+/// Numero di intervalli di un istogramma, sufficienti per qualsiasi valore a 64 bit
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+/// Prima potenza di due (in nanosecondi) esportata come limite di un istogramma, circa 1 µs
+#define HISTOGRAM_EXPORT_MIN_POWER 10
+/// Ultima potenza di due (in nanosecondi) esportata come limite di un istogramma, circa 17 s
+#define HISTOGRAM_EXPORT_MAX_POWER 34
+/// Millisecondi entro cui un client dell'endpoint delle metriche deve inviare la richiesta
+#define METRICS_REQUEST_TIMEOUT_MS 1000
+
+
+namespace Server {
+    using std::string;
+
+    /**
+     * Contatore scritto da un solo thread e letto da altri
+     * @brief L'incremento è una lettura e una scrittura atomiche separate, senza istruzioni con lock: costa come
+     * incrementare una variabile normale
+     */
+    struct Counter {
+        std::atomic<uint64_t> value{};
+
+        /// Incrementa il contatore, solo dal thread proprietario
+        void add(uint64_t amount = 1) {
+            value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+        /// Imposta il valore, solo dal thread proprietario
+        void set(uint64_t amount) { value.store(amount, std::memory_order_relaxed); }
+
+        /// Legge il valore, da qualsiasi thread
+        uint64_t get() const { return value.load(std::memory_order_relaxed); }
+    } typedef Counter;
+
+
+    /**
+     * Istogramma a intervalli logaritmici, nello stile di HdrHistogram
+     *
+     * Ogni potenza di due è divisa in HISTOGRAM_SUB_BUCKETS intervalli uguali, quindi l'intervallo di un valore si
+     * calcola con un conteggio degli zeri iniziali e registrare un valore costa pochi nanosecondi. Come Counter, è
+     * scritto da un solo thread e letto dagli altri senza lock.
+     */
+    class Histogram {
+    private:
+        /// Numero di valori registrati in ogni intervallo
+        std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS]{};
+        /// Numero di valori registrati
+        Counter count;
+        /// Somma dei valori registrati
+        Counter sum;
+
+    public:
+        /**
+         * @param value Un valore
+         * @return L'indice dell'intervallo che contiene il valore
+         */
+        static size_t bucket_of(uint64_t value) {
+            if (value < HISTOGRAM_SUB_BUCKETS)
+                return value;
+
+            int shift = 63 - std::countl_zero(value) - HISTOGRAM_SUB_BITS;
+            return ((size_t) (shift + 1) << HISTOGRAM_SUB_BITS) + ((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+        }
+
+        /**
+         * @param bucket L'indice di un intervallo
+         * @return Il più grande valore contenuto nell'intervallo
+         */
+        static uint64_t upper_bound_of(size_t bucket);
+
+        /**
+         * Registra un valore, solo dal thread proprietario
+         * @param value Il valore
+         */
+        void record(uint64_t value) {
+            std::atomic<uint64_t> &bucket = buckets[bucket_of(value)];
+            bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            count.add();
+            sum.add(value);
+        }
+
+        /**
+         * Registra una durata in nanosecondi, solo dal thread proprietario
+         * @param elapsed La durata
+         */
+        void record(std::chrono::steady_clock::duration elapsed) {
+            record((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+
+        /**
+         * Somma a questo istogramma i valori di un altro, per riunire quelli di più worker
+         * @param other L'istogramma da sommare, può essere scritto nel frattempo dal suo thread
+         */
+        void merge(const Histogram &other);
+
+        /**
+         * Stima un quantile dei valori registrati
+         * @param quantile Il quantile, tra 0 e 1 (ad esempio 0.99 per il 99° percentile)
+         * @return Il più grande valore dell'intervallo che contiene il quantile, 0 se non ci sono valori
+         */
+        uint64_t value_at_quantile(double quantile) const;
+
+        /**
+         * @return Il numero di valori registrati
+         */
+        uint64_t get_count() const { return count.get(); }
+
+        /**
+         * @return La somma dei valori registrati
+         */
+        uint64_t get_sum() const { return sum.get(); }
+
+        /**
+         * Scrive le serie dell'istogramma nel formato testuale di Prometheus, con i valori convertiti da nanosecondi a
+         * secondi
+         * @brief I limiti esportati sono le potenze di due tra HISTOGRAM_EXPORT_MIN_POWER e HISTOGRAM_EXPORT_MAX_POWER,
+         * che coincidono con dei limiti degli intervalli; le righe HELP e TYPE sono a carico del chiamante
+         * @param out Lo stream su cui scrivere
+         * @param name Il nome della metrica
+         * @param labels Le etichette della serie (ad esempio action="letter"), vuote se non ce ne sono
+         */
+        void write_prometheus(std::ostream &out, const string &name, const string &labels = "") const;
+    };
+
+
+    /**
+     * Metriche di un worker
+     *
+     * Sono scritte solo dal thread del worker e lette dall'endpoint delle metriche, che le riunisce e le formatta dal
+     * proprio thread: il loop di gioco non paga mai il costo dell'aggregazione. Le durate sono in nanosecondi.
+     */
+    struct Metrics {
+        /// Tempo dall'accettazione della connessione alla ricezione del messaggio di ingresso
+        Histogram accept_to_join;
+        /// Tempo dalla richiesta della lettera alla sua ricezione
+        Histogram letter_turn;
+        /// Tempo dalla richiesta della frase alla sua ricezione
+        Histogram phrase_turn;
+        /// Durata delle chiamate di sistema di ricezione
+        Histogram recv_time;
+        /// Durata delle chiamate di sistema di invio
+        Histogram send_time;
+        /// Tempo dall'invio di un heartbeat alla risposta del giocatore
+        Histogram heartbeat_rtt;
+
+        /// Bytes ricevuti dai giocatori
+        Counter bytes_in;
+        /// Bytes inviati ai giocatori
+        Counter bytes_out;
+        /// Connessioni accettate
+        Counter accepted;
+        /// Giocatori entrati in una stanza
+        Counter joined;
+        /// Chiamate di sistema fatte dal loop di eventi
+        Counter syscalls;
+
+        /// Stanze attive
+        Counter rooms;
+        /// Giocatori connessi
+        Counter players;
+        /// Bytes in attesa di invio
+        Counter queued_bytes;
+    } typedef Metrics;
+
+
+    /**
+     * Endpoint HTTP che espone le metriche dei worker nel formato testuale di Prometheus
+     *
+     * Risponde a GET /metrics da un thread proprio, in ascolto solo sull'interfaccia locale. Le metriche vengono lette
+     * a ogni richiesta, quindi riflettono sempre lo stato corrente dei worker. Se il programma è compilato con
+     * HANGMAN_TRACING risponde anche a GET /trace con la traccia degli eventi nel formato JSON di Chrome.
+     */
+    class MetricsServer {
+    private:
+        /// Socket in ascolto
+        int sockfd{-1};
+        /// Le metriche da esporre, una per worker
+        std::vector<const Metrics *> sources;
+        /// Il thread che risponde alle richieste
+        std::thread thread;
+        /// Chiede al thread di terminare
+        std::atomic<bool> stopping{};
+
+        /**
+         * Risponde a una richiesta
+         * @param client_sockfd Il socket del client
+         */
+        void _serve(int client_sockfd) const;
+
+    public:
+        /**
+         * Costruttore della classe MetricsServer
+         * @brief Avvia il thread che risponde alle richieste
+         * @param port La porta locale su cui rispondere
+         * @param _sources Le metriche da esporre, devono sopravvivere all'endpoint
+         * @throws std::runtime_error Se non è possibile mettersi in ascolto sulla porta
+         */
+        MetricsServer(uint16_t port, std::vector<const Metrics *> _sources);
+
+        /**
+         * Distruttore della classe MetricsServer
+         * @brief Arresta il thread e chiude il socket
+         */
+        ~MetricsServer();
+
+        MetricsServer(const MetricsServer &) = delete;
+        MetricsServer &operator=(const MetricsServer &) = delete;
+
+        /**
+         * Riunisce le metriche dei worker e le scrive nel formato testuale di Prometheus
+         * @param out Lo stream su cui scrivere
+         * @param sources Le metriche dei worker
+         */
+        static void write_prometheus(std::ostream &out, const std::vector<const Metrics *> &sources);
+    };
+}
+
+
+#endif  // METRICS_H
@@ -0,0 +1,283 @@
+#include "outbox.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "trace.h"
+
+
+namespace Server {
+#ifdef HANGMAN_IO_URING
+    namespace {
+        /// Un invio accodato in io_uring, che tiene in vita i messaggi finché il kernel non lo ha completato
+        struct SendBatch {
+            struct msghdr header{};
+            struct iovec parts[OUTBOX_MAX_IOV]{};
+            std::vector<SharedBuffer> chunks;
+        } typedef SendBatch;
+    }
+#endif
+
+    void Outbox::open(int sockfd) {
+        queues[sockfd] = OutputQueue();
+    }
+
+    void Outbox::close(int sockfd) {
+        auto entry = queues.find(sockfd);
+        if (entry == queues.end())
+            return;
+
+        queued_bytes -= entry->second.queued;
+        queues.erase(entry);
+
+        // Il descrittore potrebbe essere riusato da una nuova connessione prima che il server legga i fallimenti
+        failed.erase(std::remove(failed.begin(), failed.end(), sockfd), failed.end());
+    }
+
+    Outbox::OutputQueue *Outbox::_reserve(int sockfd, size_t size) {
+        auto entry = queues.find(sockfd);
+        if (entry == queues.end() || entry->second.failed)
+            return nullptr;
+
+        // Un client che non legge non può far crescere la memoria del server senza limiti
+        OutputQueue &queue = entry->second;
+        if (queue.queued + size > high_water_mark) {
+            shed_connections++;
+            _fail(sockfd, queue);
+            return nullptr;
+        }
+
+        return &queue;
+    }
+
+    void Outbox::_enqueued(int sockfd, OutputQueue &queue, size_t size) {
+        queue.queued += size;
+        queued_bytes += size;
+
+        // Se il socket non è scrivibile i messaggi verranno inviati da on_writable()
+        if (!queue.dirty && !queue.waiting_writable) {
+            queue.dirty = true;
+            dirty.push_back(sockfd);
+        }
+    }
+
+    bool Outbox::send(int sockfd, const SharedBuffer &buffer) {
+        OutputQueue *queue = _reserve(sockfd, buffer->size());
+        if (queue == nullptr)
+            return false;
+
+        // La coda tiene solo un riferimento, lo stesso buffer può trovarsi nelle code di tutta la stanza
+        queue->chunks.push_back(buffer);
+        _enqueued(sockfd, *queue, buffer->size());
+        return true;
+    }
+
+    bool Outbox::send(int sockfd, const void *data, size_t size) {
+        if (size > OUTBOX_SCRATCH_CAPACITY)
+            return send(sockfd, encode(data, size));
+
+        OutputQueue *queue = _reserve(sockfd, size);
+        if (queue == nullptr)
+            return false;
+
+        // Il buffer della connessione si può allungare solo se è l'ultimo della coda: la capacità è riservata alla
+        // creazione e non viene mai superata, quindi i bytes già accodati (anche in un invio di io_uring) non si spostano
+        std::vector<char> *scratch = queue->scratch.get();
+        bool appendable = scratch != nullptr && !queue->chunks.empty() && queue->chunks.back().get() == scratch &&
+                          scratch->size() + size <= scratch->capacity();
+
+        if (!appendable) {
+            // Se nessuna coda o invio lo contiene più il buffer viene riusato, altrimenti ne serve uno nuovo
+            if (scratch == nullptr || queue->scratch.use_count() > 1) {
+                queue->scratch = std::make_shared<std::vector<char>>();
+                queue->scratch->reserve(OUTBOX_SCRATCH_CAPACITY);
+            } else {
+                queue->scratch->clear();
+            }
+
+            queue->chunks.push_back(queue->scratch);
+            scratch = queue->scratch.get();
+        }
+
+        scratch->insert(scratch->end(), (const char *) data, (const char *) data + size);
+        _enqueued(sockfd, *queue, size);
+        return true;
+    }
+
+    void Outbox::_fail(int sockfd, OutputQueue &queue) {
+        if (queue.failed)
+            return;
+
+        queued_bytes -= queue.queued;
+        queue.chunks.clear();
+        queue.offset = 0;
+        queue.queued = 0;
+        queue.failed = true;
+        failed.push_back(sockfd);
+    }
+
+    void Outbox::_consume(OutputQueue &queue, size_t written) {
+        sent_bytes += written;
+        queue.queued -= written;
+        queued_bytes -= written;
+
+        // Elimina i messaggi inviati completamente
+        while (written > 0) {
+            size_t left = queue.chunks.front()->size() - queue.offset;
+            if (written < left) {
+                queue.offset += written;
+                break;
+            }
+
+            written -= left;
+            queue.offset = 0;
+            queue.chunks.pop_front();
+        }
+    }
+
+    void Outbox::_flush_queue(int sockfd, OutputQueue &queue) {
+        TRACE_SCOPE("Outbox::_flush_queue");
+
+#ifdef HANGMAN_IO_URING
+        if (event_loop.get_backend() == IO_BACKEND_URING) {
+            _submit_queue(sockfd, queue);
+            return;
+        }
+#endif
+
+        while (!queue.chunks.empty() && !queue.failed) {
+            // Raccoglie più messaggi possibile in una sola chiamata di sistema
+            ssize_t written;
+#ifndef _WIN32
+            struct iovec parts[OUTBOX_MAX_IOV];
+            size_t count = 0;
+            for (auto chunk = queue.chunks.begin(); chunk != queue.chunks.end() && count < OUTBOX_MAX_IOV; ++chunk) {
+                size_t skip = count == 0 ? queue.offset : 0;
+                parts[count].iov_base = (void *) ((*chunk)->data() + skip);
+                parts[count].iov_len = (*chunk)->size() - skip;
+                count++;
+            }
+
+            struct msghdr message{};
+            message.msg_iov = parts;
+            message.msg_iovlen = count;
+
+            // sendmsg equivale a writev ma permette di evitare SIGPIPE se il client ha chiuso la connessione
+            Clock::time_point started = send_time != nullptr ? Clock::now() : Clock::time_point();
+            written = sendmsg(sockfd, &message, MSG_NOSIGNAL);
+#else
+            const std::vector<char> &first = *queue.chunks.front();
+            Clock::time_point started = send_time != nullptr ? Clock::now() : Clock::time_point();
+            written = ::send(sockfd, first.data() + queue.offset, (int) (first.size() - queue.offset), 0);
+#endif
+            send_calls++;
+            if (send_time != nullptr)
+                send_time->record(Clock::now() - started);
+
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+
+                // Il buffer del kernel è pieno, l'invio riprenderà quando il socket tornerà scrivibile
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+
+                _fail(sockfd, queue);
+                return;
+            }
+
+            _consume(queue, (size_t) written);
+        }
+
+        // Il loop di eventi viene interessato alla scrittura solo finché ci sono messaggi bloccati
+        bool pending = !queue.chunks.empty() && !queue.failed;
+        if (pending != queue.waiting_writable) {
+            queue.waiting_writable = pending;
+            event_loop.modify(sockfd, pending ? EVENT_READ | EVENT_WRITE : EVENT_READ);
+        }
+    }
+
+#ifdef HANGMAN_IO_URING
+    void Outbox::_submit_queue(int sockfd, OutputQueue &queue) {
+        // Un solo invio alla volta per connessione, altrimenti il kernel potrebbe riordinare i messaggi
+        if (queue.in_flight || queue.chunks.empty() || queue.failed)
+            return;
+
+        auto batch = std::make_shared<SendBatch>();
+        size_t count = 0;
+        for (auto chunk = queue.chunks.begin(); chunk != queue.chunks.end() && count < OUTBOX_MAX_IOV; ++chunk) {
+            size_t skip = count == 0 ? queue.offset : 0;
+            batch->parts[count].iov_base = (void *) ((*chunk)->data() + skip);
+            batch->parts[count].iov_len = (*chunk)->size() - skip;
+            batch->chunks.push_back(*chunk);
+            count++;
+        }
+
+        batch->header.msg_iov = batch->parts;
+        batch->header.msg_iovlen = count;
+
+        // La richiesta parte con la prossima attesa del loop, insieme a quelle di tutte le altre connessioni
+        const struct msghdr *header = &batch->header;
+        if (!event_loop.send(sockfd, header, std::move(batch))) {
+            _fail(sockfd, queue);
+            return;
+        }
+
+        send_calls++;
+        queue.in_flight = true;
+    }
+#endif
+
+    void Outbox::on_sent(int sockfd, int result) {
+        auto entry = queues.find(sockfd);
+        if (entry == queues.end())
+            return;
+
+        OutputQueue &queue = entry->second;
+        queue.in_flight = false;
+        if (queue.failed)
+            return;
+
+        if (result < 0 && result != -EINTR && result != -EAGAIN) {
+            _fail(sockfd, queue);
+            return;
+        }
+
+        if (result > 0)
+            _consume(queue, (size_t) result);
+
+        // I messaggi accodati mentre l'invio era in corso partono con la prossima attesa del loop
+        _flush_queue(sockfd, queue);
+    }
+
+    void Outbox::flush() {
+        TRACE_SCOPE("Outbox::flush");
+
+        std::vector<int> to_flush;
+        to_flush.swap(dirty);
+
+        for (int sockfd: to_flush) {
+            auto entry = queues.find(sockfd);
+            if (entry == queues.end())
+                continue;
+
+            entry->second.dirty = false;
+            _flush_queue(sockfd, entry->second);
+        }
+    }
+
+    void Outbox::on_writable(int sockfd) {
+        auto entry = queues.find(sockfd);
+        if (entry == queues.end())
+            return;
+
+        _flush_queue(sockfd, entry->second);
+    }
+
+    std::vector<int> Outbox::take_failed() {
+        std::vector<int> result;
+        result.swap(failed);
+        return result;
+    }
+}
@@ -0,0 +1,237 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "protocol.h"
+#include "event_loop.h"
+#include "metrics.h"
+
+
+/// Bytes in attesa di invio oltre i quali un client viene considerato troppo lento e disconnesso
+#define OUTBOX_HIGH_WATER_MARK (64 * 1024)
+/// Numero massimo di messaggi inviati con una sola chiamata di sistema
+#define OUTBOX_MAX_IOV 64
+/// Capacità (in bytes) del buffer di ogni connessione in cui vengono accodati di seguito i messaggi per lei sola
+#define OUTBOX_SCRATCH_CAPACITY 1024
+
+
+namespace Server {
+    /**
+     * Messaggio già codificato, condiviso senza copie tra le code di tutti i destinatari
+     *
+     * Il buffer viene liberato quando l'ultima coda che lo contiene lo ha inviato.
+     */
+    typedef std::shared_ptr<const std::vector<char>> SharedBuffer;
+
+
+    /**
+     * Code di invio delle connessioni dei giocatori
+     *
+     * I messaggi non vengono scritti subito sul socket: vengono accodati e inviati tutti insieme con una sola
+     * chiamata di sistema per connessione alla fine di ogni ciclo del loop di eventi. I socket sono non bloccanti, quindi
+     * un client lento non blocca mai il server: i suoi messaggi restano in coda finché il socket non torna scrivibile e,
+     * se la coda supera OUTBOX_HIGH_WATER_MARK bytes, la connessione viene segnalata come fallita.
+     * @note Questa classe non è thread-safe
+     */
+    class Outbox {
+    private:
+        /// Coda di invio di una singola connessione
+        struct OutputQueue {
+            /// Messaggi in attesa di invio, nell'ordine in cui sono stati accodati
+            std::deque<SharedBuffer> chunks;
+            /// Buffer dei messaggi per questa sola connessione, riusato quando nessuna coda o invio lo contiene più
+            std::shared_ptr<std::vector<char>> scratch;
+            /// Bytes del primo messaggio già inviati
+            size_t offset{};
+            /// Bytes in attesa di invio
+            size_t queued{};
+            /// Se la connessione è nella lista di quelle da svuotare alla fine del ciclo
+            bool dirty{};
+            /// Se il loop di eventi segnala quando il socket torna scrivibile
+            bool waiting_writable{};
+            /// Se c'è un invio accodato in io_uring non ancora completato
+            bool in_flight{};
+            /// Se la connessione è fallita e non accetta più messaggi
+            bool failed{};
+        } typedef OutputQueue;
+
+        /// Loop di eventi su cui sono registrati i socket, usato per attendere che tornino scrivibili
+        EventLoop &event_loop;
+        /// Code di invio indicizzate per socket
+        std::unordered_map<int, OutputQueue> queues;
+        /// Connessioni con dei messaggi accodati durante il ciclo corrente
+        std::vector<int> dirty;
+        /// Connessioni fallite dall'ultima chiamata a take_failed()
+        std::vector<int> failed;
+        /// Bytes in attesa di invio oltre i quali una connessione fallisce
+        size_t high_water_mark;
+
+        /// Bytes in attesa di invio su tutte le connessioni
+        size_t queued_bytes{};
+        /// Bytes inviati dalla creazione
+        uint64_t sent_bytes{};
+        /// Chiamate di sistema di invio (o richieste di invio a io_uring) effettuate dalla creazione
+        uint64_t send_calls{};
+        /// Connessioni fallite perché troppo lente dalla creazione
+        uint64_t shed_connections{};
+        /// Istogramma in cui registrare la durata delle chiamate di sistema di invio (nullptr per non misurarla)
+        Histogram *send_time{};
+
+        /**
+         * Verifica che un messaggio possa essere accodato, altrimenti segna la connessione come fallita
+         * @param sockfd Il socket della connessione
+         * @param size La dimensione del messaggio
+         * @return La coda della connessione, nullptr se la connessione non esiste o è fallita
+         */
+        OutputQueue *_reserve(int sockfd, size_t size);
+
+        /**
+         * Aggiorna i bytes in attesa dopo aver accodato un messaggio e segna la connessione da svuotare
+         * @param sockfd Il socket della connessione
+         * @param queue La coda della connessione
+         * @param size La dimensione del messaggio
+         */
+        void _enqueued(int sockfd, OutputQueue &queue, size_t size);
+
+        /**
+         * Segna una connessione come fallita e scarta i messaggi in coda
+         * @param sockfd Il socket della connessione
+         * @param queue La coda della connessione
+         */
+        void _fail(int sockfd, OutputQueue &queue);
+
+        /**
+         * Invia il più possibile della coda di una connessione
+         * @param sockfd Il socket della connessione
+         * @param queue La coda della connessione
+         */
+        void _flush_queue(int sockfd, OutputQueue &queue);
+
+        /**
+         * Scarta dalla coda i bytes inviati
+         * @param queue La coda della connessione
+         * @param written Il numero di bytes inviati
+         */
+        void _consume(OutputQueue &queue, size_t written);
+
+#ifdef HANGMAN_IO_URING
+        /**
+         * Accoda in io_uring l'invio dei messaggi di una connessione, se non ce n'è già uno in corso
+         * @param sockfd Il socket della connessione
+         * @param queue La coda della connessione
+         */
+        void _submit_queue(int sockfd, OutputQueue &queue);
+#endif
+
+    public:
+        /**
+         * Costruttore della classe Outbox
+         * @param _event_loop Il loop di eventi su cui sono registrati i socket
+         * @param _high_water_mark I bytes in attesa di invio oltre i quali una connessione fallisce
+         */
+        explicit Outbox(EventLoop &_event_loop, size_t _high_water_mark = OUTBOX_HIGH_WATER_MARK)
+                : event_loop(_event_loop), high_water_mark(_high_water_mark) {}
+
+        Outbox(const Outbox &) = delete;
+        Outbox &operator=(const Outbox &) = delete;
+
+        /**
+         * Imposta l'istogramma in cui registrare la durata delle chiamate di sistema di invio
+         * @param histogram L'istogramma, deve sopravvivere alle code (nullptr per non misurarla)
+         */
+        void set_send_histogram(Histogram *histogram) { send_time = histogram; }
+
+        /**
+         * Crea la coda di invio di una nuova connessione
+         * @param sockfd Il socket della connessione, già registrato sul loop di eventi in lettura
+         */
+        void open(int sockfd);
+
+        /**
+         * Elimina la coda di invio di una connessione, scartando i messaggi non ancora inviati
+         * @param sockfd Il socket della connessione
+         */
+        void close(int sockfd);
+
+        /**
+         * Codifica un messaggio in un buffer condivisibile tra più code
+         * @param data I bytes del messaggio
+         * @param size La dimensione del messaggio
+         * @return Il buffer contenente una copia del messaggio
+         */
+        static SharedBuffer encode(const void *data, size_t size) {
+            return std::make_shared<const std::vector<char>>((const char *) data, (const char *) data + size);
+        }
+
+        /**
+         * Accoda un messaggio per una sola connessione
+         * @brief Il messaggio viene copiato in coda a quelli già accodati nel buffer della connessione, che viene
+         * riusato dopo l'invio: a regime i messaggi per un solo destinatario non allocano memoria
+         * @param sockfd Il socket della connessione
+         * @param data I bytes del messaggio
+         * @param size La dimensione del messaggio
+         * @return Se il messaggio è stato accodato (false se la connessione non esiste o è fallita)
+         */
+        bool send(int sockfd, const void *data, size_t size);
+
+        /**
+         * Accoda per una connessione un messaggio già codificato, senza copiarlo
+         * @param sockfd Il socket della connessione
+         * @param buffer Il messaggio, che può essere accodato anche per altre connessioni
+         * @return Se il messaggio è stato accodato (false se la connessione non esiste o è fallita)
+         */
+        bool send(int sockfd, const SharedBuffer &buffer);
+
+        /**
+         * Invia i messaggi accodati durante il ciclo corrente, con una chiamata di sistema per connessione
+         */
+        void flush();
+
+        /**
+         * Riprende l'invio su una connessione il cui socket è tornato scrivibile
+         * @param sockfd Il socket della connessione
+         */
+        void on_writable(int sockfd);
+
+        /**
+         * Gestisce il completamento di un invio accodato in io_uring e accoda il resto della coda
+         * @param sockfd Il socket della connessione
+         * @param result I bytes inviati oppure -errno
+         */
+        void on_sent(int sockfd, int result);
+
+        /**
+         * Restituisce le connessioni fallite dall'ultima chiamata, che il server deve chiudere
+         * @return I socket delle connessioni fallite
+         */
+        std::vector<int> take_failed();
+
+        /**
+         * @return I bytes in attesa di invio su tutte le connessioni
+         */
+        size_t get_queued_bytes() const { return queued_bytes; }
+
+        /**
+         * @return I bytes inviati dalla creazione
+         */
+        uint64_t get_sent_bytes() const { return sent_bytes; }
+
+        /**
+         * @return Le chiamate di sistema di invio (o richieste di invio a io_uring) effettuate dalla creazione
+         */
+        uint64_t get_send_calls() const { return send_calls; }
+
+        /**
+         * @return Le connessioni fallite perché troppo lente dalla creazione
+         */
+        uint64_t get_shed_connections() const { return shed_connections; }
+    };
+}
+
+
+#endif  // OUTBOX_H
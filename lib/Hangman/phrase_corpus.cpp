@@ -0,0 +1,330 @@
+#include "phrase_corpus.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "protocol.h"
+#include "string_utils.h"
+
+
+namespace Server {
+    PhraseCorpus::PhraseCorpus(const string &filename) {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Errore nell'apertura del file");
+        }
+
+        // Un corpus compilato si riconosce dai primi bytes, altrimenti è un file di testo
+        char magic[sizeof(CorpusHeader::magic)]{};
+        file.read(magic, sizeof(magic));
+        if (file.gcount() == sizeof(magic) && memcmp(magic, CORPUS_MAGIC, sizeof(magic)) == 0) {
+            file.close();
+            _map(filename);
+        } else {
+            file.clear();
+            file.seekg(0);
+            image = compile(file);
+            data = image.data();
+            data_size = image.size();
+        }
+
+        _attach();
+        if (count == 0) {
+            throw std::runtime_error("Il file non contiene frasi");
+        }
+    }
+
+    PhraseCorpus::~PhraseCorpus() {
+#ifndef _WIN32
+        if (mapped)
+            munmap((void *) data, data_size);
+#endif
+    }
+
+    void PhraseCorpus::_map(const string &filename) {
+#ifdef _WIN32
+        // Senza mmap il corpus compilato viene letto per intero, resta comunque senza nulla da analizzare
+        std::ifstream file(filename, std::ios::binary);
+        image.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = image.data();
+        data_size = image.size();
+#else
+        int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Errore nell'apertura del file");
+        }
+
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) < 0 || file_stat.st_size < (off_t) sizeof(CorpusHeader)) {
+            close(fd);
+            throw std::runtime_error("Il corpus compilato non è valido");
+        }
+
+        // MAP_SHARED: le pagine vengono dalla cache dei file e sono le stesse per ogni processo che le mappa
+        void *address = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("Errore nella mappatura del corpus");
+        }
+
+        // Le frasi vengono scelte a caso, leggere in anticipo le pagine successive non serve
+        madvise(address, file_stat.st_size, MADV_RANDOM);
+
+        data = (const char *) address;
+        data_size = file_stat.st_size;
+        mapped = true;
+#endif
+    }
+
+    void PhraseCorpus::_attach() {
+        if (data_size < sizeof(CorpusHeader)) {
+            throw std::runtime_error("Il corpus compilato non è valido");
+        }
+
+        CorpusHeader header{};
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, CORPUS_MAGIC, sizeof(header.magic)) != 0 || header.version != CORPUS_VERSION) {
+            throw std::runtime_error("Versione del corpus compilato non supportata");
+        }
+
+        // Le tabelle e il testo devono stare nel file, il testo deve finire con un terminatore
+        auto fits = [this](uint64_t offset, uint64_t size, size_t alignment) {
+            return offset % alignment == 0 && offset <= data_size && size <= data_size - offset;
+        };
+        if (!fits(header.entries_offset, (uint64_t) header.count * sizeof(PhraseInfo), alignof(PhraseInfo)) ||
+            !fits(header.buckets_offset, CORPUS_BUCKETS * sizeof(uint32_t), alignof(uint32_t)) ||
+            !fits(header.blob_offset, header.blob_size, 1) || (header.count > 0 && header.blob_size == 0) ||
+            (header.blob_size > 0 && data[header.blob_offset + header.blob_size - 1] != '\0')) {
+            throw std::runtime_error("Il corpus compilato non è valido");
+        }
+
+        count = header.count;
+        entries = (const PhraseInfo *) (data + header.entries_offset);
+        buckets = (const uint32_t *) (data + header.buckets_offset);
+        blob = data + header.blob_offset;
+        blob_size = header.blob_size;
+
+        // La tabella dei gruppi ha dimensione fissa, verificarla permette a select() di non uscire dall'indice
+        for (size_t i = 1; i < CORPUS_BUCKETS; i++) {
+            if (buckets[i] < buckets[i - 1])
+                throw std::runtime_error("Il corpus compilato non è valido");
+        }
+        if (buckets[CORPUS_BUCKETS - 1] != count) {
+            throw std::runtime_error("Il corpus compilato non è valido");
+        }
+    }
+
+    PhraseSelection PhraseCorpus::select(const PhraseFilter &filter) const {
+        PhraseSelection selection;
+
+        unsigned int max_difficulty = std::min<unsigned int>(filter.max_difficulty, CORPUS_DIFFICULTY_LEVELS - 1);
+        unsigned int max_length = std::min<unsigned int>(filter.max_length, CORPUS_LENGTHS - 1);
+        if (filter.min_length > max_length)
+            return selection;
+
+        // Per ogni difficoltà le frasi sono ordinate per lunghezza, quindi quelle del filtro sono contigue
+        for (unsigned int difficulty = filter.min_difficulty; difficulty <= max_difficulty; difficulty++) {
+            uint32_t begin = buckets[difficulty * CORPUS_LENGTHS + filter.min_length];
+            uint32_t end = buckets[difficulty * CORPUS_LENGTHS + max_length + 1];
+            if (end > begin) {
+                selection.ranges[selection.ranges_count++] = {begin, end};
+                selection.count += end - begin;
+            }
+        }
+
+        return selection;
+    }
+
+    uint32_t PhraseCorpus::pick(const PhraseFilter &filter, ShuffleBag &bag, Random &random) const {
+        PhraseSelection selection = select(filter);
+        if (selection.empty())
+            selection = select(PhraseFilter());
+
+        if (bag.size() != selection.size())
+            bag.reset(selection.size());
+
+        // Le frasi scartate restano fuori dal sacchetto, tanto verrebbero scartate di nuovo
+        uint32_t index = selection.at(bag.draw(random));
+        for (int attempt = 1; attempt < CORPUS_PICK_ATTEMPTS && !filter.accepts(entries[index]); attempt++) {
+            index = selection.at(bag.draw(random));
+        }
+
+        return index;
+    }
+
+    std::vector<char> PhraseCorpus::compile(std::istream &input) {
+        std::vector<PhraseInfo> infos;
+        string text;
+        uint64_t frequencies[ALPHABET_LETTERS]{};
+
+        // Tabella a indirizzamento aperto delle frasi già lette: ogni elemento è l'indice in infos più uno, 0 se vuoto.
+        // Costa 4 bytes per elemento invece di un nodo allocato per frase, come farebbe un unordered_set
+        std::vector<uint32_t> slots(CORPUS_DEDUP_SLOTS);
+        auto phrase_of = [&](uint32_t entry) {
+            return std::string_view(text.data() + infos[entry - 1].offset, infos[entry - 1].length);
+        };
+        auto find_slot = [&](std::string_view phrase) -> uint32_t & {
+            size_t mask = slots.size() - 1;
+            for (size_t slot = std::hash<std::string_view>{}(phrase) & mask;; slot = (slot + 1) & mask) {
+                if (slots[slot] == 0 || phrase_of(slots[slot]) == phrase)
+                    return slots[slot];
+            }
+        };
+
+        string line;
+        while (std::getline(input, line)) {
+            str_to_upper(line);
+            trim(line);
+
+            // Le frasi più lunghe non entrerebbero nei messaggi, il troncamento può lasciare degli spazi alla fine
+            if (line.size() > SHORTPHRASE_LENGTH - 1) {
+                line.resize(SHORTPHRASE_LENGTH - 1);
+                rtrim(line);
+            }
+            if (line.empty())
+                continue;
+
+            // Le frasi ripetute vengono salvate una volta sola
+            uint32_t &slot = find_slot(line);
+            if (slot != 0)
+                continue;
+
+            if (text.size() + line.size() + 1 > std::numeric_limits<uint32_t>::max() ||
+                infos.size() == std::numeric_limits<uint32_t>::max()) {
+                throw std::runtime_error("Il testo è troppo grande per un corpus compilato");
+            }
+
+            PhraseInfo info{};
+            info.offset = (uint32_t) text.size();
+            info.length = (uint8_t) line.size();
+
+            bool in_word = false;
+            for (char c: line) {
+                if (c >= 'A' && c <= 'Z') {
+                    info.letters |= 1u << (c - 'A');
+                    info.letter_count++;
+                    frequencies[c - 'A']++;
+                    if (strchr("AEIOU", c) != nullptr)
+                        info.vowels++;
+                }
+
+                if (c == ' ') {
+                    in_word = false;
+                } else if (!in_word) {
+                    in_word = true;
+                    info.words++;
+                }
+            }
+            info.distinct_letters = (uint8_t) std::popcount(info.letters);
+
+            infos.push_back(info);
+            text += line;
+            text += '\0';
+            slot = (uint32_t) infos.size();
+
+            // Mantiene la tabella piena al più per metà, così le ricerche restano brevi
+            if (infos.size() * 2 > slots.size()) {
+                slots.assign(slots.size() * 2, 0);
+                for (uint32_t entry = 1; entry <= infos.size(); entry++)
+                    find_slot(phrase_of(entry)) = entry;
+            }
+        }
+        slots = std::vector<uint32_t>();
+
+        // Le lettere in ordine di frequenza nel corpus, così la difficoltà non dipende dalla lingua delle frasi
+        uint8_t letters_by_frequency[ALPHABET_LETTERS];
+        for (uint8_t i = 0; i < ALPHABET_LETTERS; i++)
+            letters_by_frequency[i] = i;
+        std::stable_sort(letters_by_frequency, letters_by_frequency + ALPHABET_LETTERS,
+                         [&frequencies](uint8_t a, uint8_t b) { return frequencies[a] > frequencies[b]; });
+
+        uint8_t rank[ALPHABET_LETTERS];
+        for (uint8_t i = 0; i < ALPHABET_LETTERS; i++)
+            rank[letters_by_frequency[i]] = i;
+
+        // Chi prova le lettere in ordine di frequenza sbaglia tutte quelle assenti che precedono l'ultima presente
+        std::vector<uint32_t> group_sizes(CORPUS_BUCKETS);
+        for (auto &info: infos) {
+            uint8_t last_rank = 0;
+            for (uint32_t letters = info.letters; letters != 0; letters &= letters - 1)
+                last_rank = std::max(last_rank, rank[std::countr_zero(letters)]);
+
+            info.difficulty = info.letters != 0 ? (uint8_t) (last_rank + 1 - info.distinct_letters) : 0;
+            group_sizes[info.difficulty * CORPUS_LENGTHS + info.length]++;
+        }
+
+        // Ordina le frasi per difficoltà e lunghezza contandole, ogni gruppo inizia dove finisce il precedente
+        std::vector<uint32_t> buckets(CORPUS_BUCKETS);
+        for (size_t i = 1; i < CORPUS_BUCKETS; i++)
+            buckets[i] = buckets[i - 1] + group_sizes[i - 1];
+
+        std::vector<uint32_t> order(infos.size());
+        std::vector<uint32_t> next(buckets.begin(), buckets.end() - 1);
+        for (uint32_t i = 0; i < infos.size(); i++)
+            order[next[infos[i].difficulty * CORPUS_LENGTHS + infos[i].length]++] = i;
+
+        CorpusHeader header{};
+        memcpy(header.magic, CORPUS_MAGIC, sizeof(header.magic));
+        header.version = CORPUS_VERSION;
+        header.count = (uint32_t) infos.size();
+        header.entries_offset = sizeof(CorpusHeader);
+        header.buckets_offset = header.entries_offset + infos.size() * sizeof(PhraseInfo);
+        header.blob_offset = header.buckets_offset + buckets.size() * sizeof(uint32_t);
+        header.blob_size = text.size();
+
+        std::vector<char> result(header.blob_offset + header.blob_size);
+        memcpy(result.data(), &header, sizeof(header));
+        memcpy(result.data() + header.buckets_offset, buckets.data(), buckets.size() * sizeof(uint32_t));
+
+        // Anche il testo segue l'ordine della tabella: le frasi di una selezione sono vicine in memoria
+        auto *entries_out = (PhraseInfo *) (result.data() + header.entries_offset);
+        char *blob_out = result.data() + header.blob_offset;
+        uint32_t offset = 0;
+        for (uint32_t position = 0; position < order.size(); position++) {
+            PhraseInfo info = infos[order[position]];
+            memcpy(blob_out + offset, text.data() + info.offset, info.length + 1);
+            info.offset = offset;
+            offset += info.length + 1;
+            memcpy(entries_out + position, &info, sizeof(info));
+        }
+
+        return result;
+    }
+
+    uint32_t PhraseCorpus::compile(const string &text_filename, const string &output_filename) {
+        std::ifstream input(text_filename);
+        if (!input.is_open()) {
+            throw std::runtime_error("Errore nell'apertura del file");
+        }
+
+        std::vector<char> result = compile(input);
+
+        // Scrive su un file temporaneo e lo rinomina: un server che ha mappato la versione precedente continua a
+        // leggere il vecchio file, invece di vederlo cambiare (o accorciarsi) sotto di sé
+        string temporary_filename = output_filename + ".tmp";
+        std::ofstream output(temporary_filename, std::ios::binary | std::ios::trunc);
+        output.write(result.data(), (std::streamsize) result.size());
+        output.close();
+        if (!output || std::rename(temporary_filename.c_str(), output_filename.c_str()) != 0) {
+            std::remove(temporary_filename.c_str());
+            throw std::runtime_error("Errore nella scrittura del corpus compilato");
+        }
+
+        CorpusHeader header{};
+        memcpy(&header, result.data(), sizeof(header));
+        return header.count;
+    }
+}
@@ -0,0 +1,298 @@
+#ifndef PHRASE_CORPUS_H
+#define PHRASE_CORPUS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "protocol.h"
+#include "random.h"
+
+
+/// Identifica un corpus compilato, sono i primi bytes del file
+#define CORPUS_MAGIC "HANGCRP"
+/// Versione del formato, da incrementare a ogni modifica delle strutture salvate nel file
+#define CORPUS_VERSION 3
+/// Numero di lettere dell'alfabeto che si possono indovinare
+#define ALPHABET_LETTERS 26
+/// Numero di livelli di difficoltà, al più una lettera sbagliata per ognuna di quelle che la frase non contiene
+#define CORPUS_DIFFICULTY_LEVELS ALPHABET_LETTERS
+/// Numero di lunghezze possibili di una frase, da 0 a SHORTPHRASE_LENGTH - 1
+#define CORPUS_LENGTHS SHORTPHRASE_LENGTH
+/// Numero di elementi della tabella che divide le frasi ordinate per difficoltà e lunghezza
+#define CORPUS_BUCKETS (CORPUS_DIFFICULTY_LEVELS * CORPUS_LENGTHS + 1)
+/// Numero massimo di frasi scartate da una scelta prima di accettarne una che non rispetta i filtri sulle lettere
+#define CORPUS_PICK_ATTEMPTS 16
+/// Dimensione iniziale della tabella usata per riconoscere le frasi ripetute durante la compilazione
+#define CORPUS_DEDUP_SLOTS 1024
+
+
+namespace Server {
+    using std::string;
+
+    /**
+     * Intestazione di un corpus compilato
+     * @note Il file viene mappato in memoria così com'è, quindi i numeri sono nell'ordine dei bytes della macchina che
+     * l'ha compilato
+     */
+    struct CorpusHeader {
+        /// Contiene CORPUS_MAGIC, terminatore compreso
+        char magic[8];
+        /// Contiene CORPUS_VERSION
+        uint32_t version;
+        /// Numero di frasi
+        uint32_t count;
+        /// Posizione nel file della tabella delle frasi
+        uint64_t entries_offset;
+        /// Posizione nel file del blocco con il testo delle frasi
+        uint64_t blob_offset;
+        /// Dimensione del blocco con il testo delle frasi
+        uint64_t blob_size;
+        /// Posizione nel file della tabella dei gruppi, CORPUS_BUCKETS elementi: l'elemento
+        /// difficoltà * CORPUS_LENGTHS + lunghezza è l'indice della prima frase di quel gruppo, l'ultimo vale count
+        uint64_t buckets_offset;
+    } typedef CorpusHeader;
+
+    /**
+     * Posizione e caratteristiche di una frase del corpus, calcolate una volta sola dalla compilazione
+     * @brief Sono 16 bytes per frase, che insieme al testo sono tutta la memoria occupata dal corpus
+     */
+    struct PhraseInfo {
+        /// Posizione della frase nel blocco di testo, la frase è seguita da un terminatore
+        uint32_t offset;
+        /// Lettere presenti nella frase, la lettera 'A' + i nel bit i
+        uint32_t letters;
+        /// Lunghezza della frase, senza terminatore
+        uint8_t length;
+        /// Numero di parole
+        uint8_t words;
+        /// Numero di lettere diverse, cioè di tentativi corretti necessari per indovinarla a lettere
+        uint8_t distinct_letters;
+        /// Numero di caratteri che sono lettere
+        uint8_t letter_count;
+        /// Numero di caratteri che sono vocali
+        uint8_t vowels;
+        /// Lettere sbagliate da chi prova le lettere in ordine di frequenza nel corpus, prima di scoprire la frase
+        uint8_t difficulty;
+        /// Non usati, mantengono la dimensione multipla di quattro bytes
+        uint8_t reserved[2];
+
+        /**
+         * @return La percentuale di vocali tra le lettere della frase
+         */
+        unsigned int vowel_percent() const { return letter_count > 0 ? vowels * 100u / letter_count : 0; }
+    } typedef PhraseInfo;
+
+
+    /**
+     * Criteri con cui una stanza sceglie le frasi da indovinare
+     * @brief I valori predefiniti accettano tutte le frasi
+     */
+    struct PhraseFilter {
+        /// Lunghezza minima della frase
+        uint8_t min_length = 0;
+        /// Lunghezza massima della frase
+        uint8_t max_length = UINT8_MAX;
+        /// Difficoltà minima della frase (vedi PhraseInfo::difficulty)
+        uint8_t min_difficulty = 0;
+        /// Difficoltà massima della frase (vedi PhraseInfo::difficulty)
+        uint8_t max_difficulty = UINT8_MAX;
+        /// Percentuale massima di vocali, per evitare frasi che si risolvono da sole quando le vocali vengono sbloccate
+        uint8_t max_vowel_percent = 100;
+
+        /**
+         * Verifica i criteri che l'indice non può applicare da sé
+         * @param info Le caratteristiche di una frase che rispetta già lunghezza e difficoltà
+         * @return Se la frase rispetta anche gli altri criteri
+         */
+        bool accepts(const PhraseInfo &info) const { return info.vowel_percent() <= max_vowel_percent; }
+    } typedef PhraseFilter;
+
+
+    /**
+     * Le frasi di un corpus che rispettano lunghezza e difficoltà di un filtro
+     *
+     * Le frasi del corpus sono ordinate per difficoltà e lunghezza, quindi sono al più CORPUS_DIFFICULTY_LEVELS
+     * intervalli contigui di indici, uno per ogni livello di difficoltà: costruirla e accedere a una frase non dipende
+     * dal numero di frasi.
+     * @note È valida finché esiste il corpus da cui è stata ottenuta
+     */
+    struct PhraseSelection {
+        /// Un intervallo di indici delle frasi
+        struct Range {
+            uint32_t begin, end;
+        } typedef Range;
+
+        /// Gli intervalli non vuoti
+        Range ranges[CORPUS_DIFFICULTY_LEVELS]{};
+        /// Numero di intervalli non vuoti
+        uint8_t ranges_count{};
+        /// Numero di frasi selezionate
+        uint32_t count{};
+
+        /**
+         * @return Il numero di frasi selezionate
+         */
+        uint32_t size() const { return count; }
+
+        /**
+         * @return Se nessuna frase rispetta il filtro
+         */
+        bool empty() const { return count == 0; }
+
+        /**
+         * @param position La posizione tra le frasi selezionate, minore di size()
+         * @return L'indice della frase nel corpus
+         */
+        uint32_t at(uint32_t position) const {
+            for (uint8_t i = 0; i < ranges_count; i++) {
+                uint32_t range_size = ranges[i].end - ranges[i].begin;
+                if (position < range_size)
+                    return ranges[i].begin + position;
+                position -= range_size;
+            }
+
+            return ranges[ranges_count - 1].end - 1;
+        }
+    } typedef PhraseSelection;
+
+
+    /**
+     * Questa classe contiene le frasi da indovinare
+     *
+     * Le frasi sono già normalizzate (in maiuscolo e senza spazi all'inizio e alla fine), senza ripetizioni, e stanno in
+     * un unico blocco contiguo, preceduto da una tabella con la posizione e le caratteristiche di ognuna. Frasi e
+     * tabella sono ordinate per difficoltà e lunghezza, quindi con la tabella dei gruppi select() trova le frasi di un
+     * filtro senza scorrerle.
+     * Un corpus compilato con compile() viene mappato in memoria senza leggerlo: l'avvio non dipende dal numero di frasi
+     * e le pagine sono condivise tra tutti i processi che usano lo stesso file. Un file di testo (una frase per riga)
+     * viene invece compilato in memoria all'apertura.
+     * @note Una volta aperto il corpus è in sola lettura, quindi può essere condiviso tra più thread
+     */
+    class PhraseCorpus {
+    private:
+        /// Il corpus compilato, mappato dal file oppure contenuto in image
+        const char *data{};
+        /// Dimensione del corpus compilato
+        size_t data_size{};
+        /// Tabella delle frasi, all'interno di data
+        const PhraseInfo *entries{};
+        /// Testo delle frasi, all'interno di data
+        const char *blob{};
+        /// Dimensione del testo delle frasi, l'ultimo carattere è un terminatore
+        size_t blob_size{};
+        /// Indice della prima frase di ogni gruppo di difficoltà e lunghezza, all'interno di data
+        const uint32_t *buckets{};
+        /// Numero di frasi
+        uint32_t count{};
+        /// Corpus compilato in memoria da un file di testo
+        std::vector<char> image;
+        /// Se data è una mappatura del file da rimuovere alla distruzione
+        bool mapped{};
+
+        /**
+         * Mappa in memoria un corpus compilato
+         * @param filename Il nome del file
+         * @throws std::runtime_error Se non è possibile mappare il file
+         */
+        void _map(const string &filename);
+
+        /**
+         * Verifica l'intestazione del corpus e ricava la posizione della tabella e del testo
+         * @brief Controlla l'intestazione e la tabella dei gruppi, in un tempo che non dipende dal numero di frasi: la
+         * tabella delle frasi non viene letta, è phrase() a non uscire dal testo
+         * @throws std::runtime_error Se il corpus non è valido
+         */
+        void _attach();
+
+    public:
+        /**
+         * Apre un corpus
+         * @param filename Il nome del file, compilato oppure di testo con una frase per riga
+         * @throws std::runtime_error Se il file non esiste, non è valido o non contiene frasi
+         */
+        explicit PhraseCorpus(const string &filename);
+
+        /**
+         * Distruttore della classe PhraseCorpus
+         * @brief Rimuove la mappatura del file
+         */
+        ~PhraseCorpus();
+
+        PhraseCorpus(const PhraseCorpus &) = delete;
+        PhraseCorpus &operator=(const PhraseCorpus &) = delete;
+
+        /**
+         * Compila un testo con una frase per riga
+         * @brief Ogni riga viene convertita in maiuscolo, privata degli spazi all'inizio e alla fine e troncata alla
+         * lunghezza massima di una frase del protocollo; le righe vuote e le frasi ripetute vengono saltate
+         * @param input Il testo da compilare
+         * @return Il corpus compilato, da scrivere su un file o da usare direttamente
+         * @throws std::runtime_error Se il testo è troppo grande per il formato
+         */
+        static std::vector<char> compile(std::istream &input);
+
+        /**
+         * Compila un file di testo con una frase per riga e salva il risultato
+         * @param text_filename Il file di testo
+         * @param output_filename Il file in cui salvare il corpus compilato
+         * @return Il numero di frasi compilate
+         * @throws std::runtime_error Se non è possibile leggere o scrivere uno dei file
+         */
+        static uint32_t compile(const string &text_filename, const string &output_filename);
+
+        /**
+         * @return Il numero di frasi
+         */
+        uint32_t size() const { return count; }
+
+        /**
+         * @param index L'indice della frase, minore di size()
+         * @return Il testo della frase, seguito da un terminatore
+         * @note La posizione e la lunghezza lette dalla tabella vengono limitate al testo, così un corpus danneggiato
+         * restituisce una frase sbagliata invece di leggere fuori dalla mappatura
+         */
+        std::string_view phrase(uint32_t index) const {
+            size_t offset = std::min<size_t>(entries[index].offset, blob_size - 1);
+            return {blob + offset, std::min<size_t>(entries[index].length, blob_size - 1 - offset)};
+        }
+
+        /**
+         * @param index L'indice della frase, minore di size()
+         * @return La posizione e le caratteristiche della frase
+         */
+        const PhraseInfo &info(uint32_t index) const { return entries[index]; }
+
+        /**
+         * Seleziona le frasi che rispettano lunghezza e difficoltà di un filtro
+         * @param filter I criteri di scelta
+         * @return Le frasi selezionate, vuota se nessuna frase rispetta il filtro
+         */
+        PhraseSelection select(const PhraseFilter &filter) const;
+
+        /**
+         * Sceglie a caso una frase che rispetta un filtro
+         * @brief Le frasi vengono estratte senza ripetizioni dalla selezione di lunghezza e difficoltà e scartate se non
+         * rispettano gli altri criteri, per al più CORPUS_PICK_ATTEMPTS volte; se nessuna frase rispetta lunghezza e
+         * difficoltà la scelta avviene tra tutte le frasi
+         * @param filter I criteri di scelta
+         * @param bag Le frasi già estratte, viene svuotato se la selezione ha cambiato dimensione
+         * @param random Il generatore da usare
+         * @return L'indice della frase
+         * @note Il sacchetto va svuotato anche quando cambia il corpus da cui si sceglie
+         */
+        uint32_t pick(const PhraseFilter &filter, ShuffleBag &bag, Random &random) const;
+
+        /**
+         * @return Se il corpus è mappato da un file compilato
+         */
+        bool is_mapped() const { return mapped; }
+    };
+}
+
+
+#endif  // PHRASE_CORPUS_H
@@ -10,6 +10,7 @@
 
 #define SHUT_RDWR SD_BOTH
 #define MSG_NOSIGNAL 0
+#define poll WSAPoll
 
 #define socklen_t int
 #define ssize_t int
@@ -17,6 +18,7 @@
 
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
@@ -31,8 +33,24 @@
 
 #define SHORTPHRASE_LENGTH 123
 #define USERNAME_LENGTH 32
+#define ROOMNAME_LENGTH 32
 #define GENERIC_ACTION 0xFF
 
+// Versioni del protocollo: la v1 usa messaggi da 128 bytes, la v2 messaggi compatti con lunghezza in testa
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+// Versione più recente supportata
+#define PROTOCOL_VERSION PROTOCOL_V2
+
+// Funzionalità opzionali, concordate nel messaggio di ingresso indipendentemente dalla versione
+// Aggiornamenti incrementali dello stato della partita (UPDATE_DELTA) al posto di quelli completi
+#define CAPABILITY_DELTA 0x01
+// Funzionalità supportate
+#define PROTOCOL_CAPABILITIES CAPABILITY_DELTA
+
+// Bytes necessari per avere un bit per ogni carattere della frase
+#define REVEALED_MASK_BYTES ((SHORTPHRASE_LENGTH + 7) / 8)
+
 
 // Il protocollo per il gioco dell'impiccato si basa su sistema di azione (Action) e risposta (Response)
 namespace Client {
@@ -48,6 +66,9 @@ namespace Client {
 
         HEARTBEAT,
 
+        // Richiesta dello stato completo della partita, dopo aver perso un aggiornamento incrementale
+        RESYNC,
+
         // Valore da sostituire
         GENERIC = GENERIC_ACTION,
     };
@@ -69,7 +90,15 @@ namespace Client {
         // Nome del giocatore
         char username[USERNAME_LENGTH]{};
 
-        uint8_t pad[124 - USERNAME_LENGTH]{};
+        // Nome della stanza in cui entrare (vuoto per lasciare la scelta al server)
+        char room[ROOMNAME_LENGTH]{};
+
+        // Versione del protocollo richiesta dal client (0 per i client che non la conoscono, cioè la v1)
+        uint8_t version{};
+        // Funzionalità opzionali supportate dal client
+        uint8_t capabilities{};
+
+        uint8_t pad[124 - USERNAME_LENGTH - ROOMNAME_LENGTH - 2]{};
     } typedef JoinMessage;
 
     // Struttura che rappresenta un messaggio di invio di una nuova lettera
@@ -137,6 +166,12 @@ namespace Server {
         // Risposta di errore della frase
         SHORT_PHRASE_REJECTED,
 
+        // Conferma della versione del protocollo, inviata solo ai client che ne hanno richiesta una
+        PROTOCOL_ACCEPTED,
+
+        // Aggiornamento incrementale dello stato della partita, inviato solo ai client con CAPABILITY_DELTA
+        UPDATE_DELTA,
+
         // Valore da sostituire
         GENERIC = GENERIC_ACTION,
     };
@@ -183,10 +218,33 @@ namespace Server {
         // Lista dei tentativi fatti
         char attempts_list[26]{};
 
+        uint8_t reserved[3]{};
+        // Numero di sequenza dell'ultimo aggiornamento incrementale incluso in questo stato
+        uint32_t sequence{};
+
         // Bytes in eccesso
-        uint8_t pad[124 - 1 - 1 - 1 - 26]{};
+        uint8_t pad[124 - 1 - 1 - 1 - 26 - 3 - 4]{};
     } typedef UpdateAttemptsMessage;
 
+    // Struttura che rappresenta un aggiornamento incrementale dello stato della partita dopo un tentativo valido
+    // Il numero di sequenza cresce di uno a ogni aggiornamento: se il client ne trova uno diverso dal successivo
+    // dell'ultimo ricevuto ha perso un aggiornamento e deve chiedere lo stato completo con RESYNC
+    struct UpdateDeltaMessage {
+        Action action = UPDATE_DELTA;
+
+        // Numero di sequenza dell'aggiornamento
+        uint32_t sequence{};
+        // Lettera tentata, da aggiungere alla lista dei tentativi
+        char letter{};
+        // Numero degli errori fatti dopo il tentativo
+        uint8_t errors{};
+        // Posizioni della frase in cui la lettera è stata scoperta, un bit per carattere
+        uint8_t revealed[REVEALED_MASK_BYTES]{};
+
+        // Bytes in eccesso
+        uint8_t pad[124 - 4 - 1 - 1 - REVEALED_MASK_BYTES]{};
+    } typedef UpdateDeltaMessage;
+
     // Struttura che rappresenta un messaggio di cambio turno
     struct OtherOneTurnMessage {
         Action action = OTHER_TURN;
@@ -199,11 +257,29 @@ namespace Server {
     } typedef OtherOneTurnMessage;
 
 
+    // Struttura che rappresenta la conferma della versione del protocollo
+    // Viene sempre inviata in formato v1 ed è il primo messaggio dopo l'ingresso: i messaggi successivi, in entrambe le
+    // direzioni, usano la versione confermata
+    struct ProtocolMessage {
+        Action action = PROTOCOL_ACCEPTED;
+
+        // Versione del protocollo scelta dal server
+        uint8_t version{};
+        // Funzionalità opzionali attive per la connessione
+        uint8_t capabilities{};
+
+        // Bytes in eccesso
+        uint8_t pad[124 - 2]{};
+    } typedef ProtocolMessage;
+
+
     // Verifica che le struct siano di dimensione corretta
+    static_assert(sizeof(Message) == sizeof(ProtocolMessage), "sizes must match");
     static_assert(sizeof(Message) == sizeof(UpdateUserMessage), "sizes must match");
     static_assert(sizeof(Message) == sizeof(UpdateWordMessage), "sizes must match");
     static_assert(sizeof(Message) == sizeof(OtherOneTurnMessage), "sizes must match");
     static_assert(sizeof(Message) == sizeof(UpdateAttemptsMessage), "sizes must match");
+    static_assert(sizeof(Message) == sizeof(UpdateDeltaMessage), "sizes must match");
 }
 
 // Verifica che le struct siano di dimensione corretta
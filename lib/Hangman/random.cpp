@@ -0,0 +1,31 @@
+#include "random.h"
+
+
+namespace Server {
+    uint32_t ShuffleBag::_value_at(uint32_t position) const {
+        auto entry = swapped.find(position);
+        return entry != swapped.end() ? entry->second : position;
+    }
+
+    void ShuffleBag::reset(uint32_t size) {
+        bag_size = size;
+        drawn = 0;
+        swapped.clear();
+    }
+
+    uint32_t ShuffleBag::draw(Random &random) {
+        // Il giro è finito: tutte le posizioni sono uscite una volta
+        if (drawn == bag_size)
+            reset(bag_size);
+
+        // Scambia la posizione corrente con una a caso tra quelle non ancora estratte
+        uint32_t chosen = drawn + random.below(bag_size - drawn);
+        uint32_t value = _value_at(chosen);
+        if (chosen != drawn)
+            swapped[chosen] = _value_at(drawn);
+        swapped.erase(drawn);
+        drawn++;
+
+        return value;
+    }
+}
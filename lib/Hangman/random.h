@@ -0,0 +1,120 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+#include <unordered_map>
+
+
+namespace Server {
+    /**
+     * Generatore di numeri pseudocasuali xoshiro256**
+     *
+     * Ogni stanza ha il proprio generatore, quindi le stanze di thread diversi non condividono lo stato di rand() e la
+     * sequenza di una stanza dipende solo dal suo seme, che permette di riprodurre una partita.
+     * @note Non è adatto a usi crittografici
+     */
+    class Random {
+    private:
+        /// Stato del generatore, non deve essere tutto a zero
+        uint64_t state[4]{};
+
+        static uint64_t _rotate_left(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    public:
+        /**
+         * Costruttore della classe Random
+         * @param seed Il seme, espanso nello stato del generatore con splitmix64
+         */
+        explicit Random(uint64_t seed = 0) {
+            for (auto &word: state) {
+                seed += 0x9E3779B97F4A7C15ull;
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                word = z ^ (z >> 31);
+            }
+        }
+
+        /**
+         * @return 64 bit pseudocasuali
+         */
+        uint64_t next() {
+            uint64_t result = _rotate_left(state[1] * 5, 7) * 9;
+            uint64_t t = state[1] << 17;
+
+            state[2] ^= state[0];
+            state[3] ^= state[1];
+            state[1] ^= state[2];
+            state[0] ^= state[3];
+            state[2] ^= t;
+            state[3] = _rotate_left(state[3], 45);
+
+            return result;
+        }
+
+        /**
+         * Estrae un numero uniforme in [0, bound) senza la distorsione del modulo (metodo di Lemire)
+         * @param bound Il limite superiore escluso, maggiore di 0
+         * @return Il numero estratto
+         */
+        uint32_t below(uint32_t bound) {
+            uint64_t product = (next() >> 32) * bound;
+            auto low = (uint32_t) product;
+            if (low < bound) {
+                uint32_t threshold = -bound % bound;
+                while (low < threshold) {
+                    product = (next() >> 32) * bound;
+                    low = (uint32_t) product;
+                }
+            }
+
+            return (uint32_t) (product >> 32);
+        }
+    };
+
+
+    /**
+     * Sacchetto da cui estrarre le posizioni da 0 a size() - 1 senza ripetizioni
+     *
+     * È un mescolamento di Fisher-Yates svolto un passo per estrazione: solo le posizioni scambiate vengono salvate,
+     * quindi la memoria è proporzionale alle estrazioni fatte e non al numero di posizioni. Quando tutte le posizioni sono
+     * state estratte il sacchetto ricomincia.
+     */
+    class ShuffleBag {
+    private:
+        /// Numero di posizioni nel sacchetto
+        uint32_t bag_size{};
+        /// Numero di posizioni già estratte nel giro corrente
+        uint32_t drawn{};
+        /// Valore delle posizioni spostate dal mescolamento, le altre contengono il proprio indice
+        std::unordered_map<uint32_t, uint32_t> swapped;
+
+        /**
+         * @param position Una posizione del mescolamento
+         * @return Il valore contenuto nella posizione
+         */
+        uint32_t _value_at(uint32_t position) const;
+
+    public:
+        /**
+         * Svuota il sacchetto e lo riempie con nuove posizioni
+         * @param size Il numero di posizioni
+         */
+        void reset(uint32_t size);
+
+        /**
+         * Estrae una posizione che non è ancora uscita nel giro corrente
+         * @param random Il generatore da usare
+         * @return La posizione estratta, minore di size()
+         */
+        uint32_t draw(Random &random);
+
+        /**
+         * @return Il numero di posizioni nel sacchetto
+         */
+        uint32_t size() const { return bag_size; }
+    };
+}
+
+
+#endif  // RANDOM_H
@@ -0,0 +1,671 @@
+#include "room.h"
+
+#include "trace.h"
+
+
+namespace Server {
+    Room::Room(uint32_t _id, const string &_name, const std::shared_ptr<const PhraseCorpus> &_corpus,
+               const uint64_t &_corpus_generation, const RoomSettings &settings, uint64_t seed, TimerWheel &_timers,
+               Outbox &_outbox, Metrics &_metrics, std::function<void(int)> _on_remove,
+               std::function<void(Room *)> _on_timeout)
+            : id(_id), name(_name), random(seed), corpus(_corpus), corpus_generation(_corpus_generation),
+              timers(_timers), outbox(_outbox), metrics(_metrics), on_remove(std::move(_on_remove)), on_timeout(std::move(_on_timeout)) {
+        // Inizializzazione delle variabili
+        this->max_errors = settings.max_errors;
+        this->blocked_attempts = settings.blocked_attempts;
+        this->phrase_filter = settings.phrase_filter;
+        for (char letter: settings.start_blocked_letters) {
+            if (letter >= 'A' && letter <= 'Z')
+                this->blocked_letters |= 1u << (letter - 'A');
+        }
+
+        // La stanza nasce già con una frase da indovinare
+        new_round();
+    }
+
+    Room::~Room() {
+        // Il turno sospeso non deve riprendere su una stanza distrutta, lo stesso vale per i timer ancora programmati
+        _cancel_turn();
+        timers.cancel(phase_timer);
+        for (auto &player: players) {
+            timers.cancel(player.heartbeat_timer);
+        }
+    }
+
+    Player *Room::_find_player(int sockfd) {
+        for (auto &player: players) {
+            if (player.sockfd == sockfd)
+                return &player;
+        }
+
+        return nullptr;
+    }
+
+    bool Room::add_player(const Player &player) {
+        if (is_full()) {
+            return false;
+        }
+
+        // push_back può riallocare la lista, quindi il puntatore al giocatore corrente va aggiornato
+        long current_index = current_player != nullptr ? current_player - players.data() : -1;
+        players.push_back(player);
+        players_connected++;
+
+        // Il messaggio di ingresso conta come segno di vita
+        players.back().last_seen = Clock::now();
+        if (current_index >= 0)
+            current_player = &players.at(current_index);
+
+        // Invia il messaggio di aggiornamento della lista dei giocatori
+        _broadcast(_build_update_players());
+
+        // Invia la frase e i tentativi fatti fino ad ora al nuovo player
+        _send_snapshot(&players.back());
+
+        return true;
+    }
+
+    void Room::remove_player(int sockfd) {
+        Player *player = _find_player(sockfd);
+        if (player == nullptr) {
+            return;
+        }
+
+        _remove_player(player);
+
+        _broadcast(_build_update_players());
+    }
+
+    void Room::_set_state(GameState _state, unsigned int timeout) {
+        // La scadenza della fase precedente non è più valida
+        timers.cancel(phase_timer);
+        phase_timer = 0;
+        state = _state;
+
+        if (timeout == 0)
+            return;
+
+        phase_timer = timers.schedule(std::chrono::seconds(timeout), [this]() {
+            phase_timer = 0;
+            _on_phase_timeout();
+
+            // Il server potrebbe distruggere la stanza, quindi deve essere l'ultima operazione
+            on_timeout(this);
+        });
+    }
+
+    void Room::print_status(std::ostream &out) const {
+        out << "Room: " << id;
+        if (!name.empty())
+            out << " (" << name << ")";
+        out << "\n";
+
+        out << "Short phrase: " << short_phrase << "\n";
+        if (current_player != nullptr)
+            out << "Current player: " << current_player->username << "\n";
+        out << "Current attempt: " << current_attempt << "\n" << std::endl;
+    }
+
+    void Room::new_round() {
+        TRACE_SCOPE("Room::new_round");
+
+        _broadcast_action(Action::NEW_GAME);
+
+        // Inizializzazione delle variabili
+        this->current_errors = 0;
+        this->current_attempt = 0;
+        this->current_player = nullptr;
+        this->attempts.clear();
+        this->used_letters = 0;
+
+        _set_state(TURN_IDLE);
+
+        // Generazione della parola o frase da indovinare
+        _generate_short_phrase();
+
+        // Invia tutti i dati della partita ai player connessi, ogni messaggio viene codificato una sola volta per versione
+        _broadcast(_build_update_players());
+        _broadcast(_build_update_attempts());
+        _broadcast(_build_update_short_phrase());
+    }
+
+    inline bool Room::_is_short_phrase_guessed() {
+        return revealed_positions == hidden_positions;
+    }
+
+    void Room::_remove_player(Player *player) {
+        TRACE_SCOPE("Room::_remove_player");
+
+        // Il puntatore potrebbe riferirsi a un elemento di players, che viene spostato dalla erase
+        int removed_sockfd = player->sockfd;
+
+        // Trova la posizione del giocatore corrente prima di modificare la lista
+        long current_index = -1;
+        if (current_player != nullptr)
+            current_index = current_player - players.data();
+
+        // Elimina il giocatore dalla lista dei player connessi
+        long removed_index = -1;
+        for (unsigned int i = 0; i < players_connected; i++) {
+            if (players.at(i).sockfd == removed_sockfd) {
+                // Un giocatore disconnesso non deve più rispondere all'heartbeat
+                timers.cancel(players.at(i).heartbeat_timer);
+                players.erase(players.begin() + i);
+                removed_index = i;
+                break;
+            }
+        }
+
+        // Se non è stato rimosso significa che era già stato disconesso
+        if (removed_index < 0) {
+            return;
+        }
+
+        if (removed_index == current_index) {
+            // Se il giocatore è il giocatore corrente, passa il turno al giocatore successivo
+            current_player = nullptr;
+
+            // Il turno in corso non può più essere completato
+            if (state == WAITING_LETTER || state == WAITING_SHORT_PHRASE) {
+                _cancel_turn();
+                _set_state(TURN_IDLE);
+            }
+        } else if (removed_index < current_index) {
+            // La erase ha spostato indietro di una posizione il giocatore corrente
+            current_player = &players.at(current_index - 1);
+        }
+
+        // Aggiorna il contatore dei giocatori connessi
+        players_connected = players.size();
+
+        // Il server si occupa di chiudere la connessione con il giocatore
+        on_remove(removed_sockfd);
+    }
+
+    void Room::_send_heartbeats() {
+        TRACE_SCOPE("Room::_send_heartbeats");
+
+        // Copia la lista dei giocatori connessi perché _remove_player la modifica
+        std::vector<Player> players_copy = players;
+
+        // Chi ha inviato un messaggio di recente è sicuramente connesso e non ha bisogno di essere sondato
+        bool removed = false;
+        Clock::time_point idle_since = Clock::now() - std::chrono::seconds(HEARTBEAT_IDLE);
+        for (auto &player: players_copy) {
+            if (player.heartbeat_timer != 0 || player.last_seen > idle_since)
+                continue;
+
+            // Se l'invio fallisce significa che il giocatore si è disconnesso
+            if (!_send_action(&player, Action::HEARTBEAT)) {
+                removed |= true;
+                _remove_player(&player);
+                continue;
+            }
+
+            // La risposta verrà gestita da on_message() quando arriva, altrimenti il timer disconnette il giocatore
+            int heartbeat_sockfd = player.sockfd;
+            Player *connected = _find_player(heartbeat_sockfd);
+            if (connected != nullptr) {
+                connected->heartbeat_sent = Clock::now();
+                auto timeout = std::chrono::seconds(HEARTBEAT_TIMEOUT);
+                connected->heartbeat_timer = timers.schedule(timeout, [this, heartbeat_sockfd]() {
+                    _on_heartbeat_timeout(heartbeat_sockfd);
+
+                    // Il server potrebbe distruggere la stanza, quindi deve essere l'ultima operazione
+                    on_timeout(this);
+                });
+            }
+        }
+
+        if (removed && players_connected > 0) {
+            _broadcast(_build_update_players());
+        }
+    }
+
+    void Room::_on_heartbeat_timeout(int sockfd) {
+        Player *player = _find_player(sockfd);
+        if (player == nullptr) {
+            return;
+        }
+
+        // Se un giocatore non ha risposto all'heartbeat entro la scadenza significa che si è disconesso
+        player->heartbeat_timer = 0;
+        remove_player(sockfd);
+    }
+
+    template<typename TypeMessage>
+    bool Room::_send(Player *player, const TypeMessage &message) {
+        Message packet = std::bit_cast<Message>(message);
+
+        // Il messaggio viene inviato dal server alla fine del ciclo insieme agli altri, senza mai bloccare
+        char bytes[WIRE_MAX_FRAME];
+        size_t size = Wire::encode(packet, player->version, bytes);
+        return outbox.send(player->sockfd, bytes, size);
+    }
+
+    bool Room::_send_action(Player *player, Server::Action action) {
+        Message packet;
+        packet.action = action;
+
+        return _send(player, packet);
+    }
+
+    bool Room::_send(Player *player, const SharedBuffer &buffer) {
+        return outbox.send(player->sockfd, buffer);
+    }
+
+    SharedBuffer Room::_encode(const Message &message, uint8_t version) {
+        char bytes[WIRE_MAX_FRAME];
+        size_t size = Wire::encode(message, version, bytes);
+        return Outbox::encode(bytes, size);
+    }
+
+    template<typename TypeMessage>
+    void Room::_broadcast(const TypeMessage &message, const Player *except) {
+        TRACE_SCOPE("Room::_broadcast");
+
+        _broadcast_if(message, [except](const Player &player) {
+            return except == nullptr || player.sockfd != except->sockfd;
+        });
+    }
+
+    template<typename TypeMessage, typename Filter>
+    void Room::_broadcast_if(const TypeMessage &message, Filter filter) {
+        Message packet = std::bit_cast<Message>(message);
+
+        // Ogni versione viene codificata solo se almeno un destinatario la usa
+        SharedBuffer encoded[PROTOCOL_VERSION + 1];
+        for (auto &player: players) {
+            if (!filter(player))
+                continue;
+
+            SharedBuffer &buffer = encoded[player.version];
+            if (!buffer)
+                buffer = _encode(packet, player.version);
+
+            _send(&player, buffer);
+        }
+    }
+
+    inline void Room::_broadcast_action(Server::Action action) {
+        Message packet;
+        packet.action = action;
+
+        _broadcast(packet);
+    }
+
+    inline UpdateShortPhraseMessage Room::_build_update_short_phrase() const {
+        UpdateShortPhraseMessage packet;
+        packet.errors = current_errors;
+        // La frase mascherata ha la stessa dimensione del campo: si copia tutta e il terminatore è sempre presente
+        memcpy(packet.short_phrase, short_phrase_masked, sizeof(packet.short_phrase) - 1);
+        packet.short_phrase[sizeof(packet.short_phrase) - 1] = '\0';
+
+        return packet;
+    }
+
+    inline UpdateUserMessage Room::_build_update_players() const {
+        UpdateUserMessage packet;
+        packet.user_count = players_connected;
+
+        for (unsigned int i = 0; i < players_connected; i++) {
+            strncat(packet.usernames[i], players.at(i).username, USERNAME_LENGTH - 1);
+        }
+
+        return packet;
+    }
+
+    void Room::_next_turn() {
+        TRACE_SCOPE("Room::_next_turn");
+
+        if (current_player == nullptr) {
+            current_player = &(players.at(0));
+        } else {  // Se non è il primo turno, determina il giocatore successivo
+            // Trova l'indice del giocatore corrente
+            unsigned int i;
+            for (i = 0; i < players_connected; i++) {
+                if (players.at(i).sockfd == current_player->sockfd)
+                    break;
+            }
+
+            // Ho uno strano bug per il quale i supera di valore players_connected, seppur ciò sia impossibile
+            // Non ho idea da dove provenga il bug se dal compilatore o radiazione cosmica
+            // Ma per ora lo fixo così
+            if (i >= players_connected)
+                i = players_connected - 1;
+
+            // Determina il giocatore successivo
+            if (i == players_connected - 1) {
+                current_player = &players.at(0);
+            } else {
+                current_player = &players.at(i + 1);
+            }
+        }
+
+        // Invia il messaggio di turno agli altri giocatori
+        OtherOneTurnMessage packet;
+        // Il nome del giocatore ha la stessa dimensione del campo
+        memcpy(packet.player_name, current_player->username, sizeof(packet.player_name) - 1);
+        packet.player_name[sizeof(packet.player_name) - 1] = '\0';
+
+        _broadcast(packet, current_player);
+
+        // Invia il messaggio di turno al giocatore corrente
+        _send_action(current_player, Action::YOUR_TURN);
+    }
+
+    void Room::_generate_short_phrase() {
+        // Con un nuovo corpus le frasi già uscite non hanno più senso
+        if (bag_generation != corpus_generation) {
+            bag_generation = corpus_generation;
+            phrase_bag.reset(0);
+        }
+
+        // Prende una frase random tra quelle che rispettano i criteri della stanza e non sono ancora uscite
+        uint32_t index = corpus->pick(phrase_filter, phrase_bag, random);
+
+        // Le frasi del corpus sono già normalizzate e non più lunghe di un messaggio
+        bzero(short_phrase, SHORTPHRASE_LENGTH);
+        std::string_view phrase = corpus->phrase(index);
+        memcpy(short_phrase, phrase.data(), std::min(phrase.size(), (size_t) SHORTPHRASE_LENGTH - 1));
+
+        // Maschera la frase, un vettore di caratteri alla volta
+        Simd::mask_phrase(short_phrase, short_phrase_masked, SHORTPHRASE_LENGTH, hidden_positions.words);
+        revealed_positions = PhraseMask();
+
+        // Indicizza le posizioni di ogni lettera, scorrendo solo i caratteri nascosti
+        for (auto &positions: letter_positions) {
+            positions = PhraseMask();
+        }
+        hidden_positions.for_each([this](size_t i) {
+            if (short_phrase[i] >= 'A' && short_phrase[i] <= 'Z')
+                letter_positions[short_phrase[i] - 'A'].set(i);
+        });
+    }
+
+    int Room::_get_letter_from_player(Player *player, Client::LetterMessage &packet) {
+        TRACE_SCOPE("Room::_get_letter_from_player");
+
+        // Verifica che la lettere faccia parte dell'alafabeto
+        packet.letter = (char) toupper((unsigned char) packet.letter);
+        if (packet.letter < 'A' || packet.letter > 'Z') {
+            _send_action(player, Action::LETTER_REJECTED);
+            return -1;
+        }
+
+        uint32_t letter_bit = 1u << (packet.letter - 'A');
+
+        // Verifica che la lettera non sia bloccata per i primi tre turni e che non sia già stata usata
+        bool blocked = current_attempt < blocked_attempts && (blocked_letters & letter_bit);
+        if (blocked || (used_letters & letter_bit)) {
+            _send_action(player, Action::LETTER_REJECTED);
+            return -1;
+        }
+
+        // Aggiunge la lettera alla lista delle lettere usate
+        current_attempt++;
+        used_letters |= letter_bit;
+        attempts.push_back(packet.letter);
+
+        // Scopre tutte le posizioni della lettera, già note dall'inizio del round
+        const PhraseMask &positions = letter_positions[packet.letter - 'A'];
+        if (positions.any()) {
+            revealed_positions |= positions;
+            positions.for_each([this, &packet](size_t i) { short_phrase_masked[i] = packet.letter; });
+
+            _send_action(player, Action::LETTER_ACCEPTED);
+            return 1;
+        } else {
+            current_errors++;
+            _send_action(player, Action::LETTER_REJECTED);
+            return 0;
+        }
+    }
+
+    int Room::_get_short_phrase_from_player(Player *player, Client::ShortPhraseMessage &packet) {
+        TRACE_SCOPE("Room::_get_short_phrase_from_player");
+
+        // Controlla se la frase è corretta, senza distinguere maiuscole e minuscole
+        if (Simd::equals_upper(packet.short_phrase, short_phrase, SHORTPHRASE_LENGTH)) {
+            _send_action(player, Action::SHORT_PHRASE_ACCEPTED);
+            return 1;
+        } else {
+            _send_action(player, Action::SHORT_PHRASE_REJECTED);
+            return 0;
+        }
+    }
+
+    inline UpdateAttemptsMessage Room::_build_update_attempts() const {
+        // Invia il messaggio di aggiornamento delle lettere usate
+        Server::UpdateAttemptsMessage packet;
+
+        packet.max_errors = max_errors;
+        packet.errors = current_errors;
+        packet.attempts = current_attempt;
+        packet.sequence = sequence;
+        strncat(packet.attempts_list, attempts.data(), packet.attempts);
+
+        return packet;
+    }
+
+    inline UpdateDeltaMessage Room::_build_update_delta() const {
+        UpdateDeltaMessage packet;
+        packet.sequence = sequence;
+        packet.errors = current_errors;
+        packet.letter = attempts.empty() ? '\0' : attempts.back();
+
+        // Segna le posizioni in cui compare la lettera, che sono quelle appena scoperte
+        if (packet.letter >= 'A' && packet.letter <= 'Z') {
+            letter_positions[packet.letter - 'A'].for_each([&packet](size_t i) {
+                packet.revealed[i / 8] |= 1 << (i % 8);
+            });
+        }
+
+        return packet;
+    }
+
+    bool Room::start_turn() {
+        TRACE_SCOPE("Room::start_turn");
+
+        // Verifica che i giocatori connessi lo siano ancora, chi non risponde verrà rimosso dal suo timer
+        _send_heartbeats();
+
+        // Se tutti i giocatori si sono disconnessi non c'è nessun turno da avviare
+        if (players_connected == 0) {
+            return false;
+        }
+
+        // Seleziona il giocatore successivo
+        _next_turn();
+
+        // In rari casi current player potrebbe essere null seppur viene impostato in _next_turn
+        // Questo è dovuto al fatto che il giocatore potrebbe essere disconnesso durante il turno
+        if (current_player == nullptr) {
+            return false;
+        }
+
+        // Il turno prosegue da solo fino alla prima attesa, le risposte arriveranno tramite il loop di eventi
+        _play_turn();
+
+        return true;
+    }
+
+    void Room::_broadcast_progress(bool changed) {
+        TRACE_SCOPE("Room::_broadcast_progress");
+
+        auto wants_delta = [](const Player &player) { return (player.capabilities & CAPABILITY_DELTA) != 0; };
+
+        if (changed) {
+            sequence++;
+            _broadcast_if(_build_update_delta(), wants_delta);
+        }
+
+        // I client senza aggiornamenti incrementali ricevono sempre lo stato completo
+        auto wants_snapshot = [&wants_delta](const Player &player) { return !wants_delta(player); };
+        _broadcast_if(_build_update_short_phrase(), wants_snapshot);
+        _broadcast_if(_build_update_attempts(), wants_snapshot);
+    }
+
+    void Room::_send_snapshot(Player *player) {
+        _send(player, _build_update_short_phrase());
+        _send(player, _build_update_attempts());
+    }
+
+    void Room::FrameRead::await_suspend(std::coroutine_handle<> _handle) {
+        handle = _handle;
+        room.pending_read = this;
+        started = Clock::now();
+
+        // Allo scadere del tempo il turno riprende senza messaggio
+        Room *owner = &room;
+        timer = room.timers.schedule(std::chrono::seconds(timeout), [owner]() {
+            if (owner->pending_read != nullptr)
+                owner->pending_read->timer = 0;
+            owner->_resume_read(std::nullopt);
+
+            // Il server potrebbe distruggere la stanza, quindi deve essere l'ultima operazione
+            owner->on_timeout(owner);
+        });
+    }
+
+    void Room::_resume_read(const std::optional<Client::Message> &message) {
+        FrameRead *read = pending_read;
+        if (read == nullptr)
+            return;
+
+        pending_read = nullptr;
+        timers.cancel(read->timer);
+        read->message = message;
+
+        // La coroutine prosegue fino alla prossima attesa o alla fine del turno, che distrugge anche read
+        read->handle.resume();
+    }
+
+    void Room::_cancel_turn() {
+        if (pending_read == nullptr)
+            return;
+
+        FrameRead *read = pending_read;
+        pending_read = nullptr;
+        timers.cancel(read->timer);
+
+        // Distrugge il frame della coroutine, e con esso read
+        read->handle.destroy();
+    }
+
+    Task Room::_play_turn() {
+        int sockfd = current_player->sockfd;
+
+        // Chiede la lettera al giocatore e sospende il turno finché non risponde o scade il tempo
+        _send_action(current_player, Action::SEND_LETTER);
+        _set_state(WAITING_LETTER);
+        std::optional<Client::Message> message = co_await _read_frame(sockfd, Client::LETTER, LETTER_TIMEOUT);
+
+        // Se il giocatore fosse stato rimosso il turno sarebbe stato annullato, quindi current_player è ancora lui
+        int res_letter = -2;
+        if (message) {
+            auto packet = std::bit_cast<Client::LetterMessage>(*message);
+            res_letter = _get_letter_from_player(current_player, packet);
+        }
+
+        // Solo un tentativo valido modifica la frase o la lista dei tentativi
+        _broadcast_progress(res_letter >= 0);
+
+        // Controlla se il giocatore ha vinto indovinando l'ultima lettera
+        if (_is_short_phrase_guessed()) {
+            _end_round(Action::WIN);
+            co_return;
+        }
+        // Controlla se il giocatore ha perso perchè ha raggiunto il numero massimo di errori
+        if (current_errors == max_errors) {
+            _end_round(Action::LOSE);
+            co_return;
+        }
+
+        // Solo se il tentativo è valido il giocatore può provare a indovinare la frase
+        if (res_letter < 0) {
+            _set_state(TURN_IDLE);
+            co_return;
+        }
+
+        _send_action(current_player, Action::SEND_SHORT_PHRASE);
+        _set_state(WAITING_SHORT_PHRASE);
+        message = co_await _read_frame(sockfd, Client::SHORT_PHRASE, SHORT_PHRASE_TIMEOUT);
+
+        if (message) {
+            auto packet = std::bit_cast<Client::ShortPhraseMessage>(*message);
+
+            // Controlla se il giocatore ha vinto indovinando la frase
+            if (_get_short_phrase_from_player(current_player, packet) == 1) {
+                _end_round(Action::WIN);
+                co_return;
+            }
+        }
+
+        _set_state(TURN_IDLE);
+    }
+
+    void Room::_end_round(Server::Action action) {
+        _broadcast_action(action);
+
+        // Il nuovo round verrà avviato da _on_phase_timeout() al termine della pausa
+        _set_state(ROUND_OVER, ROUND_PAUSE);
+    }
+
+    void Room::on_message(int sockfd, Client::Message &message) {
+        TRACE_SCOPE("Room::on_message");
+
+        Player *player = _find_player(sockfd);
+        if (player == nullptr) {
+            return;
+        }
+
+        // Qualsiasi messaggio dimostra che il giocatore è connesso, anche se non è la risposta all'heartbeat
+        Clock::time_point now = Clock::now();
+        player->last_seen = now;
+        if (player->heartbeat_timer != 0)
+            metrics.heartbeat_rtt.record(now - player->heartbeat_sent);
+        timers.cancel(player->heartbeat_timer);
+        player->heartbeat_timer = 0;
+
+        // Qualsiasi messaggio non richiesto dalla fase corrente viene ignorato
+        switch (message.action) {
+            case Client::Action::HEARTBEAT: {
+                break;
+            }
+            case Client::Action::RESYNC: {
+                // Il client ha perso un aggiornamento incrementale e ricostruisce lo stato da zero
+                _send_snapshot(player);
+                break;
+            }
+            case Client::Action::LETTER:
+            case Client::Action::SHORT_PHRASE: {
+                // Riprende il turno solo se è proprio il messaggio che la coroutine sta aspettando da questo giocatore
+                if (pending_read == nullptr || pending_read->sockfd != sockfd || pending_read->action != message.action)
+                    break;
+
+                Histogram &turn = message.action == Client::Action::LETTER ? metrics.letter_turn : metrics.phrase_turn;
+                turn.record(now - pending_read->started);
+
+                _resume_read(message);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    void Room::_on_phase_timeout() {
+        // Le attese del turno hanno un timer proprio, che riprende la coroutine
+        switch (state) {
+            case ROUND_OVER: {
+                new_round();
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,585 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include <bit>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "protocol.h"
+#include "string_utils.h"
+#include "coroutine.h"
+#include "event_loop.h"
+#include "timer_wheel.h"
+#include "outbox.h"
+#include "metrics.h"
+#include "phrase_corpus.h"
+#include "wire.h"
+
+
+/// Numero massimo di giocatori in una stanza
+#define MAX_CLIENTS 3
+
+/// Tempo massimo (in secondi) che un giocatore ha per inviare una lettera
+#define LETTER_TIMEOUT 5
+/// Tempo massimo (in secondi) che un giocatore ha per inviare la frase
+#define SHORT_PHRASE_TIMEOUT 10
+/// Tempo massimo (in secondi) entro cui un giocatore deve rispondere all'heartbeat
+#define HEARTBEAT_TIMEOUT 1
+/// Tempo (in secondi) senza messaggi dopo il quale un giocatore riceve un heartbeat
+#define HEARTBEAT_IDLE 5
+/// Pausa (in secondi) tra la fine di un round e l'inizio del successivo
+#define ROUND_PAUSE 5
+
+
+using std::string;
+
+
+namespace Server {
+    /**
+     * Rappresenta il giocatore
+     *
+     * Contiene il nome del giocatore e il descrittore del suo socket
+     *
+     * @author John Toniutti
+     */
+    struct Player {
+        /// Socket del client
+        int sockfd{-1};
+        /// Nome del client
+        char username[USERNAME_LENGTH]{};
+        /// Istante in cui è stato ricevuto l'ultimo messaggio del client, di qualsiasi tipo
+        Clock::time_point last_seen{};
+        /// Timer che disconnette il client se non risponde all'heartbeat (0 se non c'è un heartbeat in attesa)
+        TimerId heartbeat_timer{};
+        /// Istante in cui è stato inviato l'heartbeat in attesa di risposta
+        Clock::time_point heartbeat_sent{};
+        /// Versione del protocollo concordata con il client
+        uint8_t version{PROTOCOL_V1};
+        /// Funzionalità opzionali concordate con il client (CAPABILITY_*)
+        uint8_t capabilities{};
+    } typedef Player;
+
+
+    /**
+     * Insieme di posizioni della frase da indovinare, un bit per carattere
+     *
+     * Permette di scoprire tutte le occorrenze di una lettera e di verificare se la frase è stata indovinata con poche
+     * operazioni su parole a 64 bit, invece di scorrere ogni volta tutti i caratteri della frase.
+     */
+    struct PhraseMask {
+        /// Bit delle posizioni, la posizione i si trova nel bit i % 64 della parola i / 64
+        uint64_t words[(SHORTPHRASE_LENGTH + 63) / 64]{};
+
+        /**
+         * Aggiunge una posizione all'insieme
+         * @param position La posizione nella frase
+         */
+        void set(size_t position) { words[position / 64] |= (uint64_t) 1 << (position % 64); }
+
+        /**
+         * @return Se l'insieme contiene almeno una posizione
+         */
+        bool any() const {
+            uint64_t res = 0;
+            for (uint64_t word: words)
+                res |= word;
+            return res != 0;
+        }
+
+        /**
+         * Chiama una funzione per ogni posizione dell'insieme, in ordine crescente
+         * @tparam Function Una funzione che riceve la posizione come size_t
+         * @param function La funzione da chiamare
+         */
+        template<typename Function>
+        void for_each(Function function) const {
+            for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+                for (uint64_t bits = words[i]; bits != 0; bits &= bits - 1)
+                    function(i * 64 + std::countr_zero(bits));
+            }
+        }
+
+        PhraseMask &operator|=(const PhraseMask &other) {
+            for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+                words[i] |= other.words[i];
+            return *this;
+        }
+
+        bool operator==(const PhraseMask &other) const = default;
+    } typedef PhraseMask;
+
+
+    /**
+     * Rappresenta la fase in cui si trova la partita
+     *
+     * Il server non attende mai in modo bloccante la risposta di un giocatore: il turno è una coroutine che si sospende
+     * in attesa del messaggio e riprende quando arriva oppure, allo scadere del tempo, come se il giocatore non avesse
+     * risposto.
+     */
+    enum GameState {
+        /// Nessun turno in corso, ne verrà avviato uno nuovo appena c'è almeno un giocatore
+        TURN_IDLE,
+        /// In attesa della lettera del giocatore corrente
+        WAITING_LETTER,
+        /// In attesa della frase del giocatore corrente
+        WAITING_SHORT_PHRASE,
+        /// Round terminato, in pausa prima di iniziarne uno nuovo
+        ROUND_OVER,
+    };
+
+
+    /**
+     * Impostazioni di gioco di una stanza
+     */
+    struct RoomSettings {
+        /// Il numero massimo di errori prima che la partita sia persa
+        uint8_t max_errors = 10;
+        /// Le lettere che non si possono indovinare all'inizio
+        string start_blocked_letters = "AEIOU";
+        /// Il numero di tentativi che devono essere fatti prima di poter usare le lettere bloccate
+        uint8_t blocked_attempts = 3;
+        /// I criteri con cui scegliere le frasi da indovinare
+        PhraseFilter phrase_filter;
+    } typedef RoomSettings;
+
+
+    /**
+     * Questa classe rappresenta una singola partita del gioco dell'impiccato
+     *
+     * Contiene lo stato della partita (frase, tentativi, errori), i giocatori che vi partecipano e il turno corrente.
+     * La stanza non possiede i socket dei giocatori: quando un giocatore deve essere disconnesso lo segnala al server
+     * tramite la callback passata al costruttore.
+     * @note Questa classe non è thread-safe
+     */
+    class Room {
+    private:
+        /// Identificativo della stanza
+        uint32_t id;
+        /// Nome della stanza (vuoto se è stata creata automaticamente)
+        string name;
+
+        /// Rappresenta il numero di errori massimo che i giocatori possono commettere
+        unsigned int max_errors{};
+        /// Rappresenta il numero di errori commessi dai giocatori
+        unsigned int current_errors{};
+        /// Rappresenta i tentativi fatti fin'ora
+        std::vector<char> attempts;
+        /// Rappresenta quanti tentativi sono stati fatti
+        unsigned int current_attempt{};
+        /// Rappresenta la parola o frase da indovinare
+        char short_phrase[SHORTPHRASE_LENGTH]{};
+        /// Rappresenta la parola o frase da indovinare con i caratteri non ancora indovinati sostituiti da _
+        char short_phrase_masked[SHORTPHRASE_LENGTH]{};
+        /// Posizioni di ogni lettera (da A a Z) nella frase, calcolate a ogni nuovo round
+        PhraseMask letter_positions[ALPHABET_LETTERS]{};
+        /// Posizioni della frase nascoste all'inizio del round
+        PhraseMask hidden_positions{};
+        /// Posizioni della frase scoperte fino ad ora
+        PhraseMask revealed_positions{};
+        /// Lettere già tentate nel round, il bit i corrisponde alla lettera 'A' + i
+        uint32_t used_letters{};
+        /// Lettere che non si possono indovinare all'inizio, il bit i corrisponde alla lettera 'A' + i
+        uint32_t blocked_letters{};
+        /// Rappresenta il numero di tentativi che devono essere fatti prima di poter usare le lettere bloccate
+        unsigned int blocked_attempts{};
+        /// I criteri con cui scegliere le frasi da indovinare
+        PhraseFilter phrase_filter;
+        /// Generatore dei numeri casuali della stanza
+        Random random;
+        /// Frasi già uscite in questa stanza, per non ripeterle finché non sono uscite tutte
+        ShuffleBag phrase_bag;
+        /// La versione del corpus da cui sono state estratte le frasi di phrase_bag
+        uint64_t bag_generation{};
+        /// Numero di sequenza dell'ultimo aggiornamento incrementale dello stato
+        uint32_t sequence{};
+        /// Lista dei client connessi
+        std::vector<Player> players;
+        /// Rappresenta il numero di giocatori connessi
+        unsigned int players_connected{};
+        /// Rappresenta il giocatore corrente
+        Player *current_player{};
+        /// Contiene tutte le possibili frasi da indovinare, condivise con le altre stanze e sostituite dal server
+        const std::shared_ptr<const PhraseCorpus> &corpus;
+        /// Versione di corpus, incrementata dal server a ogni sostituzione: l'indirizzo non basta, perché un nuovo corpus
+        /// può essere allocato dove stava quello liberato
+        const uint64_t &corpus_generation;
+
+        /**
+         * Attesa di un messaggio da parte della coroutine del turno
+         *
+         * Viene restituita da _read_frame() e vive nel frame della coroutine, che la stanza riprende da on_message()
+         * quando arriva il messaggio atteso oppure dal timer quando scade il tempo.
+         */
+        struct FrameRead {
+            /// Stanza che riprenderà la coroutine
+            Room &room;
+            /// Socket del giocatore da cui è atteso il messaggio
+            int sockfd;
+            /// Azione del messaggio atteso
+            Client::Action action;
+            /// Tempo massimo di attesa (in secondi)
+            unsigned int timeout;
+            /// Messaggio ricevuto (vuoto se il tempo è scaduto)
+            std::optional<Client::Message> message{};
+            /// Coroutine sospesa
+            std::coroutine_handle<> handle{};
+            /// Timer che riprende la coroutine allo scadere del tempo
+            TimerId timer{};
+            /// Istante in cui la coroutine si è sospesa, subito dopo aver chiesto il messaggio al giocatore
+            Clock::time_point started{};
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> _handle);
+
+            std::optional<Client::Message> await_resume() noexcept { return message; }
+        };
+
+        /// Fase in cui si trova la partita
+        GameState state{TURN_IDLE};
+        /// Timer della fase corrente (0 se la fase non prevede un'attesa)
+        TimerId phase_timer{};
+        /// Lettura su cui è sospesa la coroutine del turno (nullptr se non c'è un turno in attesa)
+        FrameRead *pending_read{};
+
+        /// Ruota dei timer del server, condivisa con le altre stanze
+        TimerWheel &timers;
+        /// Code di invio del server, in cui vengono accodati i messaggi per i giocatori
+        Outbox &outbox;
+        /// Metriche del server, in cui vengono registrate le latenze dei turni e degli heartbeat
+        Metrics &metrics;
+        /// Chiamata con il socket di ogni giocatore rimosso dalla stanza, in modo che il server lo chiuda
+        std::function<void(int)> on_remove;
+        /// Chiamata dopo che un timer ha fatto avanzare la partita, in modo che il server aggiorni la stanza
+        std::function<void(Room *)> on_timeout;
+
+        /**
+         * Permette di inviare un messaggio ad un certo giocatore
+         * @tparam TypeMessage Un tipo di messaggio generico di 128 bytes. Quindi può essere un qualsiasi messaggio, anche del client
+         * @param player Il giocatore a cui inviare il messaggio
+         * @param message Il messaggio da inviare
+         *
+         * @return Lo stato di invio del messaggio
+         * @retval true Il messaggio è stato accodato e verrà inviato alla fine del ciclo del loop
+         * @retval false La connessione è fallita o ha superato il limite di bytes in attesa
+         */
+        template<typename TypeMessage>
+        bool _send(Player *player, const TypeMessage &message);
+
+        /**
+         * Permette di inviare ad un certo giocatore un messaggio già codificato, senza copiarlo
+         * @param player Il giocatore a cui inviare il messaggio
+         * @param buffer Il messaggio codificato, condiviso con gli altri destinatari
+         * @return Se il messaggio è stato accodato
+         */
+        bool _send(Player *player, const SharedBuffer &buffer);
+
+        /**
+         * Codifica un messaggio in una certa versione del protocollo, in modo che possa essere inviato a più giocatori
+         * @param message Il messaggio da codificare
+         * @param version La versione del protocollo dei destinatari
+         * @return Il messaggio codificato
+         */
+        static SharedBuffer _encode(const Message &message, uint8_t version);
+
+        /**
+         * Cerca un giocatore della stanza a partire dal suo socket
+         * @param sockfd Il socket del giocatore
+         * @return Il giocatore oppure nullptr se non fa parte della stanza
+         */
+        Player *_find_player(int sockfd);
+
+        /**
+         * Fa avanzare la partita quando il timer della fase corrente scade (solo la pausa tra i round)
+         */
+        void _on_phase_timeout();
+
+        /**
+         * Disconnette un giocatore che non ha risposto all'heartbeat in tempo
+         * @param sockfd Il socket del giocatore
+         */
+        void _on_heartbeat_timeout(int sockfd);
+
+    protected:
+        /**
+         * Permette di generare una nuova frase da indovinare
+         * @brief Calcola anche le posizioni di ogni lettera, così un tentativo non deve scorrere la frase
+         */
+        void _generate_short_phrase();
+
+        /**
+         * Permette di passare il turno al giocatore successivo
+         */
+        void _next_turn();
+
+        /**
+         * Permette di inviare un messaggio a tutti i giocatori
+         * @brief Il messaggio viene codificato una sola volta per ogni versione del protocollo in uso nella stanza e ogni
+         * coda di invio ne tiene solo un riferimento
+         * @tparam TypeMessage Un tipo di messaggio generico di 128 bytes
+         * @param message Il messaggio da inviare
+         * @param except Un giocatore a cui non inviare il messaggio (nullptr per inviarlo a tutti)
+         */
+        template<typename TypeMessage>
+        void _broadcast(const TypeMessage &message, const Player *except = nullptr);
+
+        /**
+         * Permette di inviare un messaggio ai soli giocatori che soddisfano una condizione
+         * @tparam TypeMessage Un tipo di messaggio generico di 128 bytes
+         * @tparam Filter Una funzione che riceve un Player e restituisce se deve ricevere il messaggio
+         * @param message Il messaggio da inviare
+         * @param filter La condizione
+         */
+        template<typename TypeMessage, typename Filter>
+        void _broadcast_if(const TypeMessage &message, Filter filter);
+
+        /**
+         * Invia a tutti i giocatori lo stato della partita dopo un tentativo
+         * @brief I giocatori con CAPABILITY_DELTA ricevono solo un aggiornamento incrementale, e nulla se lo stato non è
+         * cambiato; gli altri ricevono la frase e i tentativi completi
+         * @param changed Se il tentativo ha cambiato lo stato della partita
+         */
+        void _broadcast_progress(bool changed);
+
+        /**
+         * Permette di inviare a tutti i giocatori un'azione
+         * @param action L'azione da inviare
+         */
+        inline void _broadcast_action(Server::Action action);
+
+        /**
+         * Crea un aggiornamento sullo stato del gioco
+         * @return Il messaggio, da inviare a uno o più giocatori
+         */
+        inline UpdateShortPhraseMessage _build_update_short_phrase() const;
+
+        /**
+         * Crea un aggiornamento sul numero di errori commessi
+         * @return Il messaggio, da inviare a uno o più giocatori
+         */
+        inline UpdateAttemptsMessage _build_update_attempts() const;
+
+        /**
+         * Crea un aggiornamento sulla lista dei giocatori
+         * @return Il messaggio, da inviare a uno o più giocatori
+         */
+        inline UpdateUserMessage _build_update_players() const;
+
+        /**
+         * Crea un aggiornamento incrementale con l'ultimo tentativo fatto
+         * @return Il messaggio, da inviare ai giocatori con CAPABILITY_DELTA
+         */
+        inline UpdateDeltaMessage _build_update_delta() const;
+
+        /**
+         * Invia a un giocatore lo stato completo della partita (frase e tentativi)
+         * @param player Il giocatore a cui inviarlo
+         */
+        void _send_snapshot(Player *player);
+
+        /**
+         * Permette di inviare un'azione ad un certo giocatore
+         * @brief Crea un messaggio generico con l'azione e lo invia con _send()
+         * @param player Il giocatore a cui inviare l'azione
+         * @param action L'azione da inviare
+         *
+         * @return Lo stato di invio restituito da _send()
+         * @retval true L'invio è andato a buon fine
+         * @retval false L'invio non è andato a buon fine
+         */
+        inline bool _send_action(Player *player, Server::Action action);
+
+        /**
+         * Permette di eliminare un giocatore dalla lista dei giocatori e disconnetterlo
+         * @param player Il Player da eliminare
+         */
+        void _remove_player(Player *player);
+
+        /**
+         * Permette di verificare se la parola o frase è stata indovinata
+         * @return Se la parola o frase è stata indovinata
+         * @retval true se la parola o la frase è stata indovinata
+         * @retval false se la parola o la frase non è stata indovinata
+         */
+        inline bool _is_short_phrase_guessed();
+
+        /**
+         * Permette di valutare un tentativo di un player contenente una lettera
+         * @param player Il player che ha fatto il tentativo
+         * @param packet Il messaggio ricevuto dal player
+         *
+         * @return Un numero che rappresenta il risultato della funzione
+         * @retval 1 Se il tentativo è andato a buon fine e ha indovinato
+         * @retval 0 Se il tentativo è andato a buon fine e non ha indovinato
+         * @retval -1 Se la lettera è bloccata o se è già stata usata o se non è una lettera dell'alfabeto ASCII
+         */
+        int _get_letter_from_player(Player *player, Client::LetterMessage &packet);
+
+        /**
+         * Permette di valutare il tentativo di un player sulla frase da indovinare
+         * @param player Il player che ha fatto il tentativo
+         * @param packet Il messaggio ricevuto dal player
+         *
+         * @return Un numero che rappresenta il risultato della funzione
+         * @retval 1 Se il tentativo è andato a buon fine e ha indovinato
+         * @retval 0 Se il tentativo è andato a buon fine e non ha indovinato
+         */
+        int _get_short_phrase_from_player(Player *player, Client::ShortPhraseMessage &packet);
+
+        /**
+         * Attende un messaggio da un giocatore senza bloccare il server
+         * @brief Usata con co_await dalla coroutine del turno, che resta sospesa finché il messaggio non arriva
+         * @param sockfd Il socket del giocatore
+         * @param action L'azione del messaggio atteso, gli altri messaggi vengono ignorati
+         * @param timeout Il tempo massimo di attesa (in secondi)
+         * @return L'attesa, il cui risultato è il messaggio ricevuto oppure std::nullopt se il tempo è scaduto
+         */
+        FrameRead _read_frame(int sockfd, Client::Action action, unsigned int timeout) {
+            return FrameRead{*this, sockfd, action, timeout};
+        }
+
+        /**
+         * Riprende la coroutine del turno sospesa in _read_frame()
+         * @param message Il messaggio ricevuto oppure std::nullopt se il tempo è scaduto
+         */
+        void _resume_read(const std::optional<Client::Message> &message);
+
+        /**
+         * Annulla il turno in corso distruggendo la coroutine sospesa, se c'è
+         */
+        void _cancel_turn();
+
+        /**
+         * Esegue il turno del giocatore corrente: chiede la lettera e, se il tentativo è valido, la frase
+         * @brief Ogni attesa sospende la coroutine sul loop di eventi, il turno termina riportando la partita in
+         * TURN_IDLE oppure ROUND_OVER
+         * @return La coroutine, che parte subito e si distrugge da sola al termine del turno
+         */
+        Task _play_turn();
+
+        /**
+         * Termina il round corrente e programma l'inizio di quello successivo
+         * @param action L'azione da inviare a tutti i giocatori (WIN o LOSE)
+         */
+        void _end_round(Server::Action action);
+
+        /**
+         * Invia un heartbeat ai giocatori silenziosi da almeno HEARTBEAT_IDLE secondi che non ne hanno già uno in attesa
+         * di risposta
+         * @brief La risposta viene gestita in modo asincrono da on_message()
+         */
+        void _send_heartbeats();
+
+        /**
+         * Cambia la fase della partita e ne programma la scadenza
+         * @param _state La nuova fase
+         * @param timeout Il tempo massimo (in secondi) della fase, 0 se non prevede un'attesa
+         */
+        void _set_state(GameState _state, unsigned int timeout = 0);
+
+    public:
+        /**
+         * Costruttore della classe Room
+         * @param _id L'identificativo della stanza
+         * @param _name Il nome della stanza (vuoto se creata automaticamente)
+         * @param _corpus Le frasi da cui scegliere quella da indovinare, lette all'inizio di ogni round, il puntatore deve
+         * sopravvivere alla stanza
+         * @param _corpus_generation La versione di _corpus, deve sopravvivere alla stanza
+         * @param settings Le impostazioni di gioco della stanza
+         * @param seed Il seme del generatore di numeri casuali della stanza, lo stesso seme produce le stesse frasi
+         * @param _timers La ruota su cui programmare le scadenze, deve sopravvivere alla stanza
+         * @param _outbox Le code in cui accodare i messaggi per i giocatori, devono sopravvivere alla stanza
+         * @param _metrics Le metriche in cui registrare le latenze, devono sopravvivere alla stanza
+         * @param _on_remove Chiamata con il socket di ogni giocatore rimosso dalla stanza
+         * @param _on_timeout Chiamata dopo che una scadenza ha fatto avanzare la partita, può distruggere la stanza
+         */
+        Room(uint32_t _id, const string &_name, const std::shared_ptr<const PhraseCorpus> &_corpus,
+             const uint64_t &_corpus_generation, const RoomSettings &settings, uint64_t seed, TimerWheel &_timers,
+             Outbox &_outbox, Metrics &_metrics, std::function<void(int)> _on_remove,
+             std::function<void(Room *)> _on_timeout);
+
+        /**
+         * Distruttore della classe Room
+         * @brief Annulla il turno sospeso e cancella i timer ancora programmati dalla stanza
+         */
+        ~Room();
+
+        Room(const Room &) = delete;
+        Room &operator=(const Room &) = delete;
+
+        /**
+         * @return L'identificativo della stanza
+         */
+        uint32_t get_id() const { return id; }
+
+        /**
+         * @return Il nome della stanza (vuoto se creata automaticamente)
+         */
+        const string &get_name() const { return name; }
+
+        /**
+         * @return Il numero di giocatori nella stanza
+         */
+        unsigned int get_players_connected() const { return players_connected; }
+
+        /**
+         * @return Se la stanza ha raggiunto il numero massimo di giocatori
+         */
+        bool is_full() const { return players_connected >= MAX_CLIENTS; }
+
+        /**
+         * @return Se nella stanza non c'è nessun giocatore
+         */
+        bool is_empty() const { return players_connected == 0; }
+
+        /**
+         * Aggiunge un giocatore alla stanza e gli invia lo stato della partita
+         * @param player Il giocatore da aggiungere, con il nome già ricevuto
+         * @return Se il giocatore è stato aggiunto (false se la stanza è piena)
+         */
+        bool add_player(const Player &player);
+
+        /**
+         * Rimuove un giocatore dalla stanza e notifica gli altri giocatori
+         * @param sockfd Il socket del giocatore da rimuovere
+         */
+        void remove_player(int sockfd);
+
+        /**
+         * Gestisce un messaggio ricevuto da un giocatore in base alla fase della partita
+         * @param sockfd Il socket del giocatore che ha inviato il messaggio
+         * @param message Il messaggio ricevuto
+         */
+        void on_message(int sockfd, Client::Message &message);
+
+        /**
+         * @return Se la stanza ha dei giocatori ma nessun turno in corso
+         */
+        bool needs_turn() const { return state == TURN_IDLE && players_connected > 0; }
+
+        /**
+         * Avvia il turno del giocatore successivo e gli chiede una lettera
+         * @return Se il turno è stato avviato
+         */
+        bool start_turn();
+
+        /**
+         * Permette di avviare un nuovo round
+         */
+        void new_round();
+
+        /**
+         * Stampa un resoconto dello stato della partita
+         * @param out Lo stream su cui stampare
+         */
+        void print_status(std::ostream &out) const;
+    };
+}
+
+
+#endif  // ROOM_H
@@ -1,8 +1,12 @@
 #include "server.h"
 
+#include "logger.h"
+#include "trace.h"
+
 
 namespace Server {
-    HangmanServer::HangmanServer(const string &ip, uint16_t port) {
+    HangmanServer::HangmanServer(const string &ip, uint16_t port, bool reuse_port, IoBackend backend)
+            : event_loop(backend) {
         // Inizializzazione del socket
 #ifdef _WIN32
         WSADATA wsa_data;
@@ -22,6 +26,18 @@ namespace Server {
         fcntl(sockfd, F_SETFL, O_NONBLOCK);
 #endif
 
+        // Permette a più worker di ascoltare sulla stessa porta, il kernel distribuisce le connessioni tra loro
+        if (reuse_port) {
+#ifdef SO_REUSEPORT
+            int enable = 1;
+            if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, (char *) &enable, sizeof(enable)) < 0) {
+                throw std::runtime_error("Errore nell'impostazione di SO_REUSEPORT");
+            }
+#else
+            throw std::runtime_error("SO_REUSEPORT non è supportato da questo sistema");
+#endif
+        }
+
         // Inizializzazione dell'indirizzo del server
         bzero(&address, sizeof(struct sockaddr_in));
 
@@ -39,6 +55,12 @@ namespace Server {
         if (bind(sockfd, (struct sockaddr *) &address, sizeof(address)) < 0) {
             throw std::runtime_error("Errore nel collegamento della socket al server");
         }
+
+        // Il loop si risveglia quando ci sono nuove connessioni da accettare (con io_uring le accetta direttamente)
+        event_loop.add_listener(sockfd);
+
+        // La durata degli invii viene misurata dalle code, che fanno le chiamate di sistema
+        outbox.set_send_histogram(&metrics.send_time);
     }
 
     HangmanServer::~HangmanServer() {
@@ -55,481 +77,593 @@ namespace Server {
             status = fcntl(sockfd, F_SETFD, status | FD_CLOEXEC);
 #endif
 
-#ifdef _WIN32
-        WSACleanup();
-#endif
         closesocket(sockfd);
 
-        // Elimina i giocatori
-        for (auto &player: players) {
-            _remove_player(&player);
+#ifndef _WIN32
+        if (wake_fds[0] >= 0) {
+            ::close(wake_fds[0]);
+            ::close(wake_fds[1]);
         }
+#endif
+
+        // Chiude le connessioni che non hanno completato il messaggio di ingresso
+        for (auto &entry: handshakes) {
+            closesocket(entry.first);
+        }
+        handshakes.clear();
+
+        // Chiude le connessioni con i giocatori di tutte le stanze
+        for (auto &entry: player_rooms) {
+            shutdown(entry.first, SHUT_RDWR);
+            closesocket(entry.first);
+        }
+        player_rooms.clear();
+        connections.clear();
+        open_rooms.clear();
+        named_rooms.clear();
+        rooms.clear();
+
+#ifdef _WIN32
+        WSACleanup();
+#endif
     }
 
     void
     HangmanServer::start(uint8_t _max_errors, const string& _start_blocked_letters, uint8_t _blocked_attempts,
                          const string &_filename) {
-        // Inizializzazione delle variabili
-        this->max_errors = _max_errors;
-        this->current_errors = 0;
-        this->current_attempt = 0;
-        strncat(this->start_blocked_letters, _start_blocked_letters.c_str(), 26);
-        this->blocked_attempts = _blocked_attempts;
-        this->current_player = nullptr;
-        this->attempts.clear();
+        // Inizializzazione delle impostazioni usate per le nuove stanze
+        this->settings.max_errors = _max_errors;
+        this->settings.start_blocked_letters = _start_blocked_letters;
+        this->settings.blocked_attempts = _blocked_attempts;
         this->players_connected = 0;
 
-        // Carica le frasi dal file
-        _load_short_phrases(_filename);
+        // Carica le frasi dal file, a meno che non siano già state fornite
+        if (!corpus)
+            _load_short_phrases(_filename);
 
-        // Inizializzazione della lista dei giocatori
-        players.clear();
+        // Inizializzazione delle stanze
+        player_rooms.clear();
+        connections.clear();
+        open_rooms.clear();
+        named_rooms.clear();
+        rooms.clear();
 
         // Avvio del server
-        if (listen(sockfd, MAX_CLIENTS) < 0) {
+        // La coda delle connessioni in attesa è condivisa da tutte le stanze
+        if (listen(sockfd, listen_backlog) < 0) {
             throw std::runtime_error("Errore nell'avvio del server");
         }
-
-        new_round();
     }
 
-    void HangmanServer::new_round() {
-        _broadcast_action(Action::NEW_GAME);
-
-        // Inizializzazione delle variabili
-        this->current_errors = 0;
-        this->current_attempt = 0;
-        this->current_player = nullptr;
-        this->attempts.clear();
+    void HangmanServer::accept() {
+        TRACE_SCOPE("HangmanServer::accept");
 
-        // Generazione della parola o frase da indovinare
-        _generate_short_phrase();
+        // Svuota tutta la coda, così una raffica di connessioni non viene accettata una per ciclo
+        while (true) {
+#ifdef __linux__
+            int client_socket = accept4(sockfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+            int client_socket = ::accept(sockfd, nullptr, nullptr);
+#endif
+            if (client_socket < 0) {
+                // Una connessione chiusa prima di essere accettata non svuota la coda
+                if (errno == ECONNABORTED || errno == EINTR)
+                    continue;
+                return;
+            }
 
-        // Invia tutti i dati della partita ai player connessi
-        for (auto &player: players) {
-            _send_update_players(player);
-            _send_update_attempts(player);
-            _send_update_short_phrase(player);
+            _begin_handshake(client_socket);
         }
     }
 
-    inline bool HangmanServer::_is_short_phrase_guessed() {
-        return strncasecmp(short_phrase, short_phrase_masked, SHORTPHRASE_LENGTH) == 0;
-    }
+    void HangmanServer::_begin_handshake(int client_socket) {
+        _configure_socket(client_socket);
 
-    void HangmanServer::_remove_player(Player *player) {
-        // Elimina il giocatore dalla lista dei player connessi
-        bool removed = false;
-        for (unsigned int i = 0; i < players_connected; i++) {
-            if (players.at(i).sockfd == player->sockfd) {
-                players.erase(players.begin() + i);
-                removed = true;
-                break;
-            }
-        }
+        // Il messaggio di ingresso viene segnalato dal loop di eventi, chi non lo invia in tempo viene disconnesso
+        Handshake &handshake = handshakes[client_socket];
+        handshake.accepted = Clock::now();
+        metrics.accepted.add();
+        handshake.timer = timers.schedule(std::chrono::seconds(HANDSHAKE_TIMEOUT), [this, client_socket]() {
+            handshakes.at(client_socket).timer = 0;
+            _close_handshake(client_socket);
+        });
 
-        // Se non è stato rimosso significa che era già stato disconesso
-        if (!removed) {
-            return;
-        }
+        event_loop.add_connection(client_socket);
+    }
 
-        // Se il giocatore è il giocatore corrente, passa il turno al giocatore successivo
-        if (current_player != nullptr && current_player->sockfd == player->sockfd) {
-            current_player = nullptr;
-        }
+    void HangmanServer::_close_handshake(int client_socket) {
+        auto entry = handshakes.find(client_socket);
+        if (entry == handshakes.end())
+            return;
 
-        // Chiude la connessione con il giocatore
-        shutdown(player->sockfd, SHUT_RDWR);
-        closesocket(player->sockfd);
+        timers.cancel(entry->second.timer);
+        handshakes.erase(entry);
 
-        // Aggiorna il contatore dei giocatori connessi
-        players_connected = players.size();
+        event_loop.remove(client_socket);
+        closesocket(client_socket);
     }
 
-    void HangmanServer::_check_disconnected_players() {
-        // copia la lista dei giocatori connessi
-        std::vector<Player> players_copy = players;
+    void HangmanServer::_on_handshake_event(const Event &event) {
+        TRACE_SCOPE("HangmanServer::_on_handshake_event");
 
-        if (players_copy.empty()) {
-            return;
-        }
+        Handshake &handshake = handshakes.at(event.fd);
 
-        // Invia un heartbeat a tutti i giocatori connessi
-        // se un giocatore non risponde significa che si è disconesso
-        bool removed = false;
-        Client::Message heartbeat_resp;
-        for (auto &player: players_copy) {
-            bool res = _send_action(&player, Action::HEARTBEAT);
-            if (!res) {
-                removed |= true;
-                _remove_player(&player);
-                continue;
-            }
+        if (!(event.events & (EVENT_READ | EVENT_DATA | EVENT_HANGUP | EVENT_ERROR)))
+            return;
 
-            res = _read(&player, heartbeat_resp, Client::Action::HEARTBEAT, 1);
-            if (!res) {
-                removed |= true;
-                _remove_player(&player);
-            }
-        }
+        ssize_t n = _receive(handshake.inbound, event);
 
-        if (removed && players_connected > 0) {
-            for (auto &player: players) {
-                _send_update_players(player);
-            }
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            _close_handshake(event.fd);
+            return;
         }
-    }
 
-    template<class TypeMessage>
-    bool HangmanServer::_read(Player *player, TypeMessage &message, Client::Action action, int timeout) {
-        int n = 0;
+        // Il messaggio di ingresso ha sempre la dimensione fissa della v1, la versione si concorda proprio qui
+        Client::JoinMessage packet;
+        if (!handshake.inbound.next(&packet, sizeof(packet)))
+            return;
 
-        // Aspetta di ricevere un messaggio entro il timeout in secondi dato
-        for (int i = 0; i < timeout * 10; i++) {
-            n = recv(player->sockfd, (char *) &message, sizeof(TypeMessage), MSG_NOSIGNAL);
-            if (n > 0) {
-                break;
-            }
-            // Dorme per 100 millisecond
-            usleep(100'000);
+        if (packet.action != Client::JOIN_GAME) {
+            _close_handshake(event.fd);
+            return;
         }
 
+        metrics.accept_to_join.record(Clock::now() - handshake.accepted);
 
-        // Se il giocatore ha chiuso la connessione
-        if (n == 0) {
-            return false;
-        }
+        // I bytes inviati subito dopo il messaggio di ingresso appartengono già alla partita
+        FrameBuffer inbound = std::move(handshake.inbound);
+        timers.cancel(handshake.timer);
+        handshakes.erase(event.fd);
 
-        // Se il giocatore ha inviato un messaggio
-        if (n == MessageSize) {
-            // Se il messaggio inviato ha un action diversa da quella richiesta
-            if (action != Client::GENERIC && message.action != action) {
-                return false;
-            } else {
-                return true;
-            }
+        // Non possiamo ancora aggiungere il suo nome perché non è ancora stato inviato
+        Player new_player;
+        new_player.sockfd = event.fd;
+
+        // Copia il nome del giocatore
+        memcpy(new_player.username, packet.username, sizeof(new_player.username) - 1);
+        new_player.username[sizeof(new_player.username) - 1] = '\0';
+
+        // Da qui in poi il giocatore parla la versione più recente supportata da entrambi
+        new_player.version = Wire::negotiate(packet.version);
+        new_player.capabilities = packet.capabilities & PROTOCOL_CAPABILITIES;
+
+        char room_name[ROOMNAME_LENGTH]{};
+        memcpy(room_name, packet.room, sizeof(room_name) - 1);
+
+        // Una stanza con un nome potrebbe appartenere a un altro worker, che in quel caso adotta il giocatore
+        HangmanServer *owner = room_name[0] != '\0' && router ? router(room_name) : nullptr;
+        if (owner != nullptr) {
+            // Il socket passa all'altro worker solo quando questo loop non può più ricevere i suoi dati, fino ad
+            // allora i bytes che arrivano si aggiungono a quelli da consegnare
+            Handoff &handoff = handoffs[new_player.sockfd];
+            handoff.player = new_player;
+            handoff.room_name = room_name;
+            handoff.inbound = std::move(inbound);
+            handoff.owner = owner;
+            event_loop.release(new_player.sockfd);
+            return;
         }
 
-        // Se il giocatore ha chiuso la connessione
-        return false;
+        _admit_player(new_player, room_name, std::move(inbound), true);
     }
 
-    template<typename TypeMessage>
-    bool HangmanServer::_send(Player *player, TypeMessage &message) {
-        int res = send(player->sockfd, (char *) (&message), sizeof(Message), MSG_NOSIGNAL);
+    void HangmanServer::_on_handoff_event(const Event &event) {
+        auto entry = handoffs.find(event.fd);
 
-        if (res == EAGAIN)
-            res = send(player->sockfd, (char *) (&message), sizeof(Message), MSG_NOSIGNAL);
+        bool closed = event.events & (EVENT_HANGUP | EVENT_ERROR);
+        if (!closed && (event.events & EVENT_DATA))
+            closed = _receive(entry->second.inbound, event) <= 0;
 
-        if (res < 0) {
-            return false;
-        } else {
-            return true;
+        if (closed) {
+            handoffs.erase(entry);
+            event_loop.remove(event.fd);
+            closesocket(event.fd);
+            return;
         }
+
+        if (!(event.events & EVENT_RELEASED))
+            return;
+
+        // Da qui in poi il socket appartiene solo al worker proprietario della stanza
+        HangmanServer *owner = entry->second.owner;
+        owner->adopt_player(std::move(entry->second));
+        handoffs.erase(entry);
     }
 
-    bool HangmanServer::_send_action(Player *player, Server::Action action) {
-        Message packet;
-        packet.action = action;
+    void HangmanServer::_configure_socket(int client_socket) const {
+        // Un client lento non deve mai bloccare il server, i messaggi restano nella sua coda di invio
+#ifdef _WIN32
+        u_long mode = 1;
+        ioctlsocket(client_socket, FIONBIO, &mode);
+#else
+        fcntl(client_socket, F_SETFL, O_NONBLOCK);
+#endif
+
+        // Disabilita l'algoritmo di Nagle, i messaggi sono piccoli e devono arrivare subito
+        int nodelay = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, (char *) &nodelay, sizeof(nodelay));
 
-        return _send(player, packet);
+        if (!tcp_keepalive)
+            return;
+
+        // Il kernel sonda le connessioni inattive e chiude quelle che non rispondono, il loop lo segnala come errore
+        int enable = 1;
+        setsockopt(client_socket, SOL_SOCKET, SO_KEEPALIVE, (char *) &enable, sizeof(enable));
+
+#ifdef TCP_KEEPIDLE
+        int idle = KEEPALIVE_IDLE, interval = KEEPALIVE_INTERVAL, count = KEEPALIVE_COUNT;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_KEEPIDLE, (char *) &idle, sizeof(idle));
+        setsockopt(client_socket, IPPROTO_TCP, TCP_KEEPINTVL, (char *) &interval, sizeof(interval));
+        setsockopt(client_socket, IPPROTO_TCP, TCP_KEEPCNT, (char *) &count, sizeof(count));
+#endif
+
+#ifdef TCP_USER_TIMEOUT
+        // Se i dati inviati non vengono confermati entro il limite la connessione viene chiusa
+        unsigned int user_timeout = USER_TIMEOUT_MS;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_USER_TIMEOUT, (char *) &user_timeout, sizeof(user_timeout));
+#endif
     }
 
-    inline void HangmanServer::_broadcast_action(Server::Action action) {
-        Message packet;
-        packet.action = action;
+    void HangmanServer::_admit_player(const Player &new_player, const string &room_name, FrameBuffer inbound,
+                                      bool watched) {
+        // Se la stanza richiesta è piena la connessione viene rifiutata
+        Room *room = _pick_room(room_name);
+        if (room == nullptr) {
+            if (watched)
+                event_loop.remove(new_player.sockfd);
+            closesocket(new_player.sockfd);
+            return;
+        }
 
-        for (auto &player: players) {
-            _send(&player, packet);
+        // Da ora in poi i messaggi del giocatore vengono segnalati dal loop di eventi
+        player_rooms[new_player.sockfd] = room;
+        connections[new_player.sockfd].version = new_player.version;
+        outbox.open(new_player.sockfd);
+        players_connected++;
+        if (!watched)
+            event_loop.add_connection(new_player.sockfd);
+
+        // Un client che ha richiesto una versione del protocollo o delle funzionalità attende la conferma prima di usarle
+        if (new_player.version >= PROTOCOL_V2 || new_player.capabilities != 0) {
+            ProtocolMessage ack;
+            ack.version = new_player.version;
+            ack.capabilities = new_player.capabilities;
+            outbox.send(new_player.sockfd, &ack, MessageSize);
+        }
+
+        // Aggiunge il giocatore alla stanza, che gli invia lo stato della partita
+        room->add_player(new_player);
+        metrics.joined.add();
+        _after_room_event(room);
+
+        // I bytes inviati subito dopo il messaggio di ingresso appartengono già alla partita
+        auto connection = connections.find(new_player.sockfd);
+        if (connection != connections.end() && inbound.size() > 0) {
+            connection->second.inbound = std::move(inbound);
+            _deliver_messages(new_player.sockfd);
         }
     }
 
-    inline void HangmanServer::_send_update_short_phrase(Server::Player &player) {
-        UpdateShortPhraseMessage packet;
-        packet.errors = current_errors;
-        strncat(packet.short_phrase, short_phrase_masked, SHORTPHRASE_LENGTH - 1);
+    void HangmanServer::adopt_player(Handoff handoff) {
+        {
+            std::lock_guard<std::mutex> lock(inbox_mutex);
+            inbox.push_back(std::move(handoff));
+        }
 
-        _send(&player, packet);
+        // Risveglia il loop del worker, che ammetterà il giocatore dal proprio thread
+        char wake = 1;
+        if (wake_fds[1] >= 0)
+            (void) !write(wake_fds[1], &wake, 1);
     }
 
-    inline void HangmanServer::_send_update_players(Server::Player &player) {
-        UpdateUserMessage packet;
-        packet.user_count = players_connected;
+    void HangmanServer::_drain_inbox() {
+        // Svuota la pipe di risveglio
+        char buffer[64];
+        while (read(wake_fds[0], buffer, sizeof(buffer)) > 0);
 
-        for (unsigned int i = 0; i < players_connected; i++) {
-            strncat(packet.usernames[i], players.at(i).username, USERNAME_LENGTH - 1);
+        std::vector<Handoff> adopted;
+        {
+            std::lock_guard<std::mutex> lock(inbox_mutex);
+            adopted.swap(inbox);
         }
 
-        _send(&player, packet);
+        for (auto &handoff: adopted) {
+            _admit_player(handoff.player, handoff.room_name, std::move(handoff.inbound));
+        }
     }
 
-    void HangmanServer::_next_turn() {
-        if (current_player == nullptr) {
-            current_player = &(players.at(0));
-        } else {  // Se non è il primo turno, determina il giocatore successivo
-            // Trova l'indice del giocatore corrente
-            unsigned int i;
-            for (i = 0; i < players_connected; i++) {
-                if (players.at(i).sockfd == current_player->sockfd)
-                    break;
-            }
+    void HangmanServer::replace_corpus(std::shared_ptr<const PhraseCorpus> _corpus) {
+        {
+            std::lock_guard<std::mutex> lock(inbox_mutex);
+            next_corpus = std::move(_corpus);
+        }
 
-            // Ho uno strano bug per il quale i supera di valore players_connected, seppur ciò sia impossibile
-            // Non ho idea da dove provenga il bug se dal compilatore o radiazione cosmica
-            // Ma per ora lo fixo così
-            if (i >= players_connected)
-                i = players_connected - 1;
+        // Non serve risvegliare il loop: le frasi vengono scelte solo in risposta a un evento
+        corpus_replaced.store(true, std::memory_order_release);
+    }
 
-            // Determina il giocatore successivo
-            if (i == players_connected - 1) {
-                current_player = &players.at(0);
-            } else {
-                current_player = &players.at(i + 1);
-            }
+    void HangmanServer::_swap_corpus() {
+        std::shared_ptr<const PhraseCorpus> previous;
+        {
+            std::lock_guard<std::mutex> lock(inbox_mutex);
+            corpus_replaced.store(false, std::memory_order_relaxed);
+            if (!next_corpus)
+                return;
+
+            previous = std::move(corpus);
+            corpus = std::move(next_corpus);
         }
+        corpus_generation++;
 
-        // Invia il messaggio di turno agli altri giocatori
-        OtherOneTurnMessage packet;
-        strncat(packet.player_name, current_player->username, USERNAME_LENGTH - 1);
+        // Le stanze leggono corpus solo all'inizio di un round e copiano la frase scelta, quindi la versione
+        // precedente viene liberata qui (fuori dal lock) se nessun altro worker la usa ancora
+        previous.reset();
+    }
 
-        for (auto &player: players) {
-            if (player.sockfd == current_player->sockfd)
-                continue;
+    void HangmanServer::set_router(std::function<HangmanServer *(const string &)> _router) {
+#ifndef _WIN32
+        // La pipe permette agli altri worker di risvegliare il loop quando gli affidano un giocatore
+        if (wake_fds[0] < 0) {
+            if (pipe(wake_fds) < 0) {
+                throw std::runtime_error("Errore nella creazione della pipe di risveglio");
+            }
 
-            _send(&player, packet);
+            fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+            fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+            event_loop.add(wake_fds[0], EVENT_READ);
         }
+#endif
 
-        // Invia il messaggio di turno al giocatore corrente
-        _send_action(current_player, Action::YOUR_TURN);
+        this->router = std::move(_router);
     }
 
-    void HangmanServer::accept() {
-        struct sockaddr_in client_address{};
-        socklen_t client_address_len = sizeof(client_address);
-        int client_socket = ::accept(sockfd, (struct sockaddr *) &client_address, &client_address_len);
+    Room *HangmanServer::_pick_room(const string &room_name) {
+        // Il giocatore ha chiesto una stanza precisa
+        if (!room_name.empty()) {
+            auto named = named_rooms.find(room_name);
+            if (named == named_rooms.end())
+                return _create_room(room_name);
 
-        if (client_socket < 0) {
-            return;
+            Room *room = rooms.at(named->second).get();
+            return room->is_full() ? nullptr : room;
         }
 
-        // Aggiunge il giocatore alla lista
-        // Non possiamo ancora aggiungere il suo nome perché non è ancora stato inviato
-        Player new_player;
-        new_player.sockfd = client_socket;
-
-        // Legge il nome del giocatore
-        Client::JoinMessage packet;
+        // Riempie per prime le stanze più vecchie, così le partite non restano con un solo giocatore
+        if (!open_rooms.empty()) {
+            return rooms.at(*open_rooms.begin()).get();
+        }
 
-        bool res = _read(&new_player, packet, packet.action, 1);
-        if (res) {
-            // Copia il nome del giocatore nella lista
-            strncat(new_player.username, packet.username, USERNAME_LENGTH - 1);
+        return _create_room(room_name);
+    }
 
-            players.push_back(new_player);
-            players_connected++;
+    Room *HangmanServer::_create_room(const string &room_name) {
+        uint32_t id = next_room_id++;
 
-            // Invia il messaggio di aggiornamento della lista dei giocatori
-            for (auto &player: players) {
-                _send_update_players(player);
-            }
+        // La stanza segnala al server i giocatori da disconnettere e le partite fatte avanzare dai suoi timer
+        auto room = std::make_unique<Room>(id, room_name, corpus, corpus_generation, settings, room_seeds.next(), timers,
+                                           outbox, metrics,
+                                           [this](int client_sockfd) { _close_player(client_sockfd); },
+                                           [this](Room *timed_out) { _after_room_event(timed_out); });
+        Room *created = room.get();
 
-            // Invia la frase al nuovo player
-            _send_update_short_phrase(new_player);
+        rooms[id] = std::move(room);
+        if (room_name.empty())
+            open_rooms.insert(id);
+        else
+            named_rooms[room_name] = id;
 
-            // Invia i tentativi fatti fino ad ora al nuovo player
-            _send_update_attempts(new_player);
-        } else {
-            closesocket(new_player.sockfd);
-        }
+        return created;
     }
 
-    void HangmanServer::_load_short_phrases(const std::string &filename) {
-        all_phrases.clear();
-        std::ifstream file(filename);
+    void HangmanServer::_update_room(Room *room) {
+        uint32_t id = room->get_id();
 
-        if (!file.is_open()) {
-            throw std::runtime_error("Errore nell'apertura del file");
+        if (room->is_empty()) {
+            // Una stanza vuota non serve più, quella successiva ripartirà con una nuova frase
+            open_rooms.erase(id);
+            if (!room->get_name().empty())
+                named_rooms.erase(room->get_name());
+            rooms.erase(id);
+            return;
         }
 
-        std::string temp_text;
-        while (std::getline(file, temp_text)) {
-            str_to_upper(temp_text);
-            trim(temp_text);
-            all_phrases.push_back(temp_text);
+        if (room->get_name().empty()) {
+            if (room->is_full())
+                open_rooms.erase(id);
+            else
+                open_rooms.insert(id);
         }
-
-        file.close();
     }
 
-    void HangmanServer::_generate_short_phrase() {
-        // Prende una frase random
-        int index = rand() % all_phrases.size();
+    void HangmanServer::_close_player(int client_sockfd) {
+        player_rooms.erase(client_sockfd);
+        connections.erase(client_sockfd);
+        outbox.close(client_sockfd);
+        players_connected = player_rooms.size();
 
-        bzero(short_phrase, SHORTPHRASE_LENGTH);
+        // Chiude la connessione con il giocatore
+        event_loop.remove(client_sockfd);
+        shutdown(client_sockfd, SHUT_RDWR);
+        closesocket(client_sockfd);
+    }
 
-        std::string phrase = all_phrases.at(index);
-        strncat(short_phrase, phrase.c_str(), SHORTPHRASE_LENGTH - 1);
+    void HangmanServer::_load_short_phrases(const std::string &filename) {
+        corpus = std::make_shared<const PhraseCorpus>(filename);
+    }
 
-        // Maschera la frase
-        bzero(short_phrase_masked, SHORTPHRASE_LENGTH);
-        for (int i = 0; i < SHORTPHRASE_LENGTH; i++) {
-            if (short_phrase[i] == ' ') {
-                short_phrase_masked[i] = ' ';
-            } else if (short_phrase[i] == '\0') {
-                continue;
-            } else {
-                short_phrase_masked[i] = '_';
-            }
+    void HangmanServer::_on_player_event(const Event &event) {
+        TRACE_SCOPE("HangmanServer::_on_player_event");
+
+        // Il giocatore potrebbe essere già stato rimosso da un evento precedente
+        auto entry = player_rooms.find(event.fd);
+        if (entry == player_rooms.end()) {
+            return;
         }
-    }
 
-    int HangmanServer::_get_letter_from_player(Player *player, int timeout) {
-        _send_action(player, Action::SEND_LETTER);
+        Room *room = entry->second;
 
-        Client::LetterMessage packet;
+        // Il socket è tornato scrivibile, riprende l'invio dei messaggi rimasti in coda
+        if (event.events & EVENT_WRITE)
+            outbox.on_writable(event.fd);
 
-        if (!_read(player, packet, packet.action, timeout)) {
-            return -2;
-        }
+        // Con io_uring il kernel ha concluso un invio, il resto della coda parte con il ciclo successivo
+        if (event.events & EVENT_SENT)
+            outbox.on_sent(event.fd, event.result);
 
-        // Verifica che la lettere faccia parte dell'alafabeto
-        if (isalpha(packet.letter) == 0) {
-            _send_action(player, Action::LETTER_REJECTED);
-            return -1;
-        }
+        if (!(event.events & (EVENT_READ | EVENT_DATA | EVENT_HANGUP | EVENT_ERROR)))
+            return;
 
-        packet.letter = toupper(packet.letter);
+        // Una sola lettura raccoglie tutti i bytes disponibili, anche più messaggi o parte di uno
+        ssize_t n = _receive(connections[event.fd].inbound, event);
 
-        // Verifica che la lettera non sia bloccata per i primi tre turni
-        if (current_attempt < blocked_attempts) {
-            for (size_t i = 0; i < strlen(start_blocked_letters); i++) {
-                if (start_blocked_letters[i] == packet.letter) {
-                    _send_action(player, Action::LETTER_REJECTED);
-                    return -1;
-                }
-            }
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            // Il giocatore ha chiuso la connessione
+            room->remove_player(event.fd);
+            _after_room_event(room);
+            return;
         }
 
-        // Controlla se la lettera è già stata usata
-        for (auto letter: attempts) {
-            if (letter == packet.letter) {
-                _send_action(player, Action::LETTER_REJECTED);
-                return -1;
-            }
-        }
+        _deliver_messages(event.fd);
+    }
 
-        // Aggiunge la lettera alla lista delle lettere usate
-        current_attempt++;
-        attempts.push_back(packet.letter);
+    ssize_t HangmanServer::_receive(FrameBuffer &inbound, const Event &event) {
+        TRACE_SCOPE("HangmanServer::_receive");
 
-        // Controlla se la lettera è presente nella frase
-        bool found = false;
-        for (int i = 0; i < SHORTPHRASE_LENGTH; i++) {
-            if (short_phrase[i] == packet.letter) {
-                short_phrase_masked[i] = packet.letter;
-                found = true;
-            }
+        ssize_t n = 0;
+        if (event.events & EVENT_READ) {
+            Clock::time_point started = Clock::now();
+            n = inbound.fill(event.fd);
+            metrics.recv_time.record(Clock::now() - started);
+        } else if (event.events & EVENT_DATA) {
+            // Con io_uring i bytes sono già stati ricevuti, un client che ne invia troppi viola il protocollo
+            n = inbound.append(event.data, event.size) ? (ssize_t) event.size : 0;
         }
 
-        if (found) {
-            _send_action(player, Action::LETTER_ACCEPTED);
-            return 1;
-        } else {
-            current_errors++;
-            _send_action(player, Action::LETTER_REJECTED);
-            return 0;
-        }
+        if (n > 0)
+            metrics.bytes_in.add(n);
+
+        return n;
     }
 
-    int HangmanServer::_get_short_phrase_from_player(Player *player, int timeout) {
-        _send_action(player, Action::SEND_SHORT_PHRASE);
+    void HangmanServer::_deliver_messages(int client_sockfd) {
+        TRACE_SCOPE("HangmanServer::_deliver_messages");
 
-        Client::ShortPhraseMessage packet;
+        // Consegna alla stanza tutti i messaggi completi, i bytes rimanenti aspettano la lettura successiva
+        Client::Message message;
+        while (true) {
+            auto entry = player_rooms.find(client_sockfd);
+            auto connection = connections.find(client_sockfd);
+            if (entry == player_rooms.end() || connection == connections.end())
+                break;
 
-        if (!_read(player, packet, packet.action, timeout)) {
-            return -1;
-        }
+            Room *room = entry->second;
+            int res = Wire::decode(connection->second.inbound, connection->second.version, message);
+            if (res == 0)
+                break;
+
+            // Un messaggio malformato rende impossibile trovare l'inizio del successivo
+            if (res < 0) {
+                room->remove_player(client_sockfd);
+                _after_room_event(room);
+                break;
+            }
 
-        // Controlla se la frase è corretta
-        str_to_upper(packet.short_phrase);
-        if (strncmp(packet.short_phrase, short_phrase, SHORTPHRASE_LENGTH) == 0) {
-            _send_action(player, Action::SHORT_PHRASE_ACCEPTED);
-            return 1;
-        } else {
-            _send_action(player, Action::SHORT_PHRASE_REJECTED);
-            return 0;
+            room->on_message(client_sockfd, message);
+
+            // Il turno successivo potrebbe aver rimosso il giocatore e distrutto la stanza
+            _after_room_event(room);
         }
     }
 
-    inline void HangmanServer::_send_update_attempts(Player &player) {
-        // Invia il messaggio di aggiornamento delle lettere usate
-        Server::UpdateAttemptsMessage packet;
+    void HangmanServer::_after_room_event(Room *room) {
+        TRACE_SCOPE("HangmanServer::_after_room_event");
 
-        packet.max_errors = max_errors;
-        packet.errors = current_errors;
-        packet.attempts = current_attempt;
-        strncat(packet.attempts_list, attempts.data(), packet.attempts);
+        if (room->needs_turn() && room->start_turn() && verbose) {
+            // Gli identificativi delle stanze si ripetono tra i worker
+            Log status(LOG_LEVEL_INFO);
+            status << "Worker: " << worker_index << "\n";
+            room->print_status(status.stream());
+        }
 
-        _send(&player, packet);
+        _update_room(room);
     }
 
-    void HangmanServer::loop() {
-        // Verifica che i giocatori connessi lo siano ancora
-        _check_disconnected_players();
+    void HangmanServer::_flush_outbox() {
+        TRACE_SCOPE("HangmanServer::_flush_outbox");
 
-        // Seleziona il giocatore successivo
-        _next_turn();
+        outbox.flush();
 
-        // In rari casi current player potrebbe essere null seppur viene impostato in _next_turn
-        // Questo è dovuto al fatto che il giocatore potrebbe essere disconnesso durante il turno
-        if (current_player == nullptr) {
-            return;
-        }
+        // Disconnettere un giocatore invia degli aggiornamenti agli altri, che potrebbero a loro volta fallire
+        std::vector<int> failed = outbox.take_failed();
+        while (!failed.empty()) {
+            for (int client_sockfd: failed) {
+                auto entry = player_rooms.find(client_sockfd);
+                if (entry == player_rooms.end())
+                    continue;
 
-        int res_letter = _get_letter_from_player(current_player);
-        for (auto &player: players) {
-            _send_update_short_phrase(player);
-            _send_update_attempts(player);
-        }
-
-        // Controlla se il giocatore ha vinto indovinando l'ultima lettera
-        if (_is_short_phrase_guessed()) {
-            _broadcast_action(Action::WIN);
-            usleep(5'000'000);  // sleep di 5 secondi
-            new_round();
+                Room *room = entry->second;
+                room->remove_player(client_sockfd);
+                _after_room_event(room);
+            }
 
-            return;
+            outbox.flush();
+            failed = outbox.take_failed();
         }
-        // Controlla se il giocatore ha perso perchè ha raggiunto il numero massimo di errori
-        if (current_errors == max_errors) {
-            _broadcast_action(Action::LOSE);
-            usleep(5'000'000);
-            new_round();
+    }
 
-            return;
+    void HangmanServer::loop() {
+        TRACE_SCOPE("HangmanServer::loop");
+
+        // Attende fino al primo evento o alla prima scadenza della ruota dei timer
+        const std::vector<Event> &events = event_loop.wait(timers.timeout_ms());
+
+        // Le nuove frasi valgono per i round che iniziano da questo ciclo in poi
+        if (corpus_replaced.load(std::memory_order_acquire))
+            _swap_corpus();
+
+        for (const auto &event: events) {
+            if (event.fd == sockfd) {
+                // Controlla se ci sono nuove connessioni, con io_uring sono già state accettate
+                if (event.events & EVENT_ACCEPT)
+                    _begin_handshake(event.result);
+                else
+                    accept();
+            } else if (event.fd == wake_fds[0]) {
+                // Un altro worker ha affidato dei giocatori a questo
+                _drain_inbox();
+            } else if (handshakes.count(event.fd) > 0) {
+                // Un client appena connesso ha inviato (parte del) messaggio di ingresso
+                _on_handshake_event(event);
+            } else if (handoffs.count(event.fd) > 0) {
+                // Un giocatore affidato a un altro worker, il cui socket non è ancora stato rilasciato
+                _on_handoff_event(event);
+            } else {
+                _on_player_event(event);
+            }
         }
 
-        int res_phrase = -1;
-        if (res_letter >= 0)
-            res_phrase = _get_short_phrase_from_player(current_player);
+        // Fa scadere solo i timer raggiunti, ogni stanza interessata avvia da sé il turno successivo
+        timers.advance(Clock::now());
 
-        // Controlla se il giocatore ha vinto indovinando la frase
-        if (res_phrase == 1) {
-            _broadcast_action(Action::WIN);
-            usleep(5'000'000);
-            new_round();
+        // Invia con una sola chiamata per giocatore tutti i messaggi generati durante il ciclo
+        _flush_outbox();
 
-            return;
-        }
+        // Pubblica le statistiche per gli altri thread
+        metrics.rooms.set(rooms.size());
+        metrics.players.set(players_connected);
+        metrics.queued_bytes.set(outbox.get_queued_bytes());
+        metrics.syscalls.set(event_loop.get_syscalls());
+        metrics.bytes_out.set(outbox.get_sent_bytes());
     }
 
-    void HangmanServer::run(const bool verbose) {
+    void HangmanServer::run(const bool _verbose) {
         unsigned int prev_n_players = 0;
+        this->verbose = _verbose;
 
         try {
             start();
         } catch (const std::exception &e) {
-            std::cerr << e.what() << std::endl;
+            Log(LOG_LEVEL_ERROR) << e.what();
             exit(EXIT_FAILURE);
         }
 
@@ -537,36 +671,26 @@ namespace Server {
         // Scrive a schermo l'indirizzo IP del server e la sua porta
         char str[INET_ADDRSTRLEN];
         inet_ntop(AF_INET, &address.sin_addr, str, INET_ADDRSTRLEN);
-        std::cout << "Server address: " << str << "\n";
-        std::cout << "Server port: " << ntohs(address.sin_port) << "\n\n";
+        Log(LOG_LEVEL_INFO) << "Server address: " << str;
+        Log(LOG_LEVEL_INFO) << "Server port: " << ntohs(address.sin_port);
+        Log(LOG_LEVEL_INFO) << "I/O backend: " << (get_backend() == IO_BACKEND_URING ? "io_uring" : "epoll");
+        TRACE_THREAD_NAME("server");
 
 
         while (true) {
             try {
-                // Controlla se ci sono nuove connessioni
-                accept();
-                // Fa in modo che l'uso della CPU non sia troppo alto
-                usleep(100);
+                loop();
 
                 if (verbose && players_connected > 0 && prev_n_players == 0)
-                    std::cout << "Exited idle state" << "\n" << std::endl;
-
-                if (players_connected > 0)
-                    loop();
-
-                if (verbose && players_connected > 0 && current_player != nullptr) {
-                    std::cout << "Short phrase: " << short_phrase << "\n";
-                    std::cout << "Current player: " << current_player->username << "\n";
-                    std::cout << "Current attempt: " << current_attempt << "\n" << std::endl;
-                }
+                    Log(LOG_LEVEL_INFO) << "Exited idle state";
 
                 if (verbose && players_connected == 0 && prev_n_players > 0)
-                    std::cout << "Entered idle state" << "\n" << std::endl;
+                    Log(LOG_LEVEL_INFO) << "Entered idle state";
 
                 prev_n_players = players_connected;
             }
             catch (const std::exception &e) {
-                std::cerr << e.what() << std::endl;
+                Log(LOG_LEVEL_ERROR) << e.what();
             }
         }
     }
@@ -5,6 +5,13 @@
 #include <fcntl.h>
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <unordered_map>
 
 #ifdef _WIN32
 #include <unistd.h>
@@ -12,9 +19,26 @@
 
 #include "protocol.h"
 #include "string_utils.h"
-
-
-#define MAX_CLIENTS 3
+#include "event_loop.h"
+#include "frame_buffer.h"
+#include "metrics.h"
+#include "outbox.h"
+#include "phrase_corpus.h"
+#include "timer_wheel.h"
+#include "room.h"
+#include "wire.h"
+
+
+/// Secondi di inattività dopo i quali il kernel inizia a sondare una connessione (TCP keepalive)
+#define KEEPALIVE_IDLE 10
+/// Secondi tra due sonde TCP keepalive
+#define KEEPALIVE_INTERVAL 2
+/// Numero di sonde TCP keepalive senza risposta dopo il quale la connessione viene chiusa
+#define KEEPALIVE_COUNT 3
+/// Millisecondi entro cui i dati inviati devono essere confermati dal client prima che la connessione venga chiusa
+#define USER_TIMEOUT_MS 15000
+/// Tempo massimo (in secondi) entro cui un client appena connesso deve inviare il messaggio di ingresso
+#define HANDSHAKE_TIMEOUT 1
 
 
 using std::string;
@@ -22,18 +46,44 @@ using std::string;
 
 namespace Server {
     /**
-     * Rappresenta il giocatore
-     *
-     * Contiene il nome del giocatore e il descrittore del suo socket
-     *
-     * @author John Toniutti
+     * Stato di ricezione della connessione di un giocatore
      */
-    struct Player {
-        /// Socket del client
-        int sockfd;
-        /// Nome del client
-        char username[USERNAME_LENGTH]{};
-    } typedef Player;
+    struct Connection {
+        /// Bytes ricevuti e non ancora ricomposti in un messaggio
+        FrameBuffer inbound;
+        /// Versione del protocollo concordata con il client
+        uint8_t version{PROTOCOL_V1};
+    } typedef Connection;
+
+
+    /**
+     * Connessione accettata che non ha ancora inviato il messaggio di ingresso
+     */
+    struct Handshake {
+        /// Bytes ricevuti e non ancora ricomposti nel messaggio di ingresso
+        FrameBuffer inbound;
+        /// Timer che chiude la connessione se il messaggio di ingresso non arriva in tempo
+        TimerId timer{};
+        /// Istante in cui la connessione è stata accettata
+        Clock::time_point accepted{};
+    } typedef Handshake;
+
+
+    class HangmanServer;
+
+    /**
+     * Giocatore che ha inviato il messaggio di ingresso e viene affidato al worker proprietario della stanza richiesta
+     */
+    struct Handoff {
+        /// Il giocatore
+        Player player;
+        /// Il nome della stanza richiesta
+        string room_name;
+        /// Bytes ricevuti dopo il messaggio di ingresso, appartengono già alla partita
+        FrameBuffer inbound;
+        /// Il worker che adotta il giocatore
+        HangmanServer *owner{};
+    } typedef Handoff;
 
 
     /**
@@ -41,6 +91,8 @@ namespace Server {
      *
      * Provvede a dare una funzione per eseguire il gioco direttamente e a dare le funzioni per crearsi il proprio loop
      * di gioco nel caso fosse necessario.
+     * Un solo server ospita più partite indipendenti (Room) dietro la stessa porta: il messaggio di ingresso indica in
+     * quale stanza entrare, oppure lascia che sia il server a sceglierne una con dei posti liberi.
      * @note Questa classe non è thread-safe
      * @warning Se un client non rispetta il protocollo, questo viene disconnesso
      *
@@ -54,188 +106,218 @@ namespace Server {
         /// Contiene l'indirizzo IP e la porta del server
         struct sockaddr_in address{};
 
-        /// Rappresenta il numero di errori massimo che i giocatori possono commettere
-        unsigned int max_errors{};
-        /// Rappresenta il numero di errori commessi dai giocatori
-        unsigned int current_errors{};
-        /// Rappresenta i tentativi fatti fin'ora
-        std::vector<char> attempts;
-        /// Rappresenta quanti tentativi sono stati fatti
-        unsigned int current_attempt{};
-        /// Rappresenta la parola o frase da indovinare
-        char short_phrase[SHORTPHRASE_LENGTH]{};
-        /// Rappresenta la parola o frase da indovinare con i caratteri non ancora indovinati sostituiti da _
-        char short_phrase_masked[SHORTPHRASE_LENGTH]{};
-        /// Rappresenta le lettere che non si possono indovinare all'inizio
-        char start_blocked_letters[26]{};
-        /// Rappresenta il numero di tentativi che devono essere fatti prima di poter usare le lettere bloccate
-        unsigned int blocked_attempts{};
-        /// Lista dei client connessi
-        std::vector<Player> players;
-        /// Rappresenta il numero di giocatori connessi
+        /// Impostazioni di gioco usate per le nuove stanze
+        RoomSettings settings;
+        /// Contiene tutte le possibili frasi da indovinare, condivise da tutte le stanze (e dagli altri worker)
+        std::shared_ptr<const PhraseCorpus> corpus;
+        /// Incrementato a ogni sostituzione di corpus, le stanze lo usano per riconoscere un corpus nuovo
+        uint64_t corpus_generation{};
+
+        /// Contatori e istogrammi del worker, letti dall'endpoint delle metriche, devono sopravvivere alle stanze
+        Metrics metrics;
+
+        /// Loop di eventi su cui sono registrati il socket del server e quelli dei giocatori
+        EventLoop event_loop;
+        /// Scadenze delle fasi di gioco e degli heartbeat di tutte le stanze, deve sopravvivere alle stanze
+        TimerWheel timers;
+        /// Code di invio dei giocatori, svuotate alla fine di ogni ciclo, devono sopravvivere alle stanze
+        Outbox outbox{event_loop};
+
+        /// Stanze attive indicizzate per identificativo
+        std::unordered_map<uint32_t, std::unique_ptr<Room>> rooms;
+        /// Identificativi delle stanze con un nome, indicizzati per nome
+        std::unordered_map<string, uint32_t> named_rooms;
+        /// Stanze create automaticamente che hanno ancora dei posti liberi
+        std::set<uint32_t> open_rooms;
+        /// Stanza di appartenenza di ogni giocatore, indicizzata per socket
+        std::unordered_map<int, Room *> player_rooms;
+        /// Stato di ricezione di ogni giocatore, indicizzato per socket
+        std::unordered_map<int, Connection> connections;
+        /// Connessioni in attesa del messaggio di ingresso, indicizzate per socket
+        std::unordered_map<int, Handshake> handshakes;
+        /// Giocatori affidati ad altri worker il cui socket non è ancora stato rilasciato dal loop, indicizzati per socket
+        std::unordered_map<int, Handoff> handoffs;
+        /// Lunghezza massima della coda delle connessioni in attesa di essere accettate
+        int listen_backlog{SOMAXCONN};
+        /// Identificativo da assegnare alla prossima stanza creata, unico solo all'interno del worker
+        uint32_t next_room_id{};
+        /// Indice del worker nel pool, riportato insieme all'identificativo delle stanze
+        size_t worker_index{};
+        /// Genera il seme di ogni nuova stanza
+        Random room_seeds{std::random_device{}()};
+        /// Rappresenta il numero di giocatori connessi in tutte le stanze
         unsigned int players_connected{};
-        /// Rappresenta il giocatore corrente
-        Player *current_player{};
-        /// Contiene tutte le possibili frasi da indovinare
-        std::vector<string> all_phrases;
-
-        /**
-         * Permette di inviare un messaggio ad un certo giocatore
-         * @tparam TypeMessage Un tipo di messaggio generico di 128 bytes. Quindi può essere un qualsiasi messaggio, anche del client
-         * @param player Il giocatore a cui inviare il messaggio
-         * @param message Il messaggio da inviare
-         *
-         * @return Lo stato di invio del messaggio
-         * @retval true L'invio è andato a buon fine
-         * @retval false L'invio non è andato a buon fine
-         */
-        template<typename TypeMessage>
-        bool _send(Player *player, TypeMessage &message);
+        /// Se deve stampare un resoconto di ogni nuovo turno
+        bool verbose{};
+        /// Se il kernel deve rilevare da sé le connessioni morte (TCP keepalive e TCP_USER_TIMEOUT)
+        bool tcp_keepalive{true};
+
+        /// Restituisce il worker proprietario di una stanza con un nome, nullptr se è questo
+        std::function<HangmanServer *(const string &)> router;
+        /// Pipe usata dagli altri worker per risvegliare il loop quando affidano un giocatore
+        int wake_fds[2]{-1, -1};
+        /// Protegge inbox e next_corpus, l'unico stato condiviso con gli altri thread
+        std::mutex inbox_mutex;
+        /// Giocatori affidati da altri worker, in attesa di essere ammessi
+        std::vector<Handoff> inbox;
+        /// Nuova versione delle frasi, in attesa di sostituire quella in uso
+        std::shared_ptr<const PhraseCorpus> next_corpus;
+        /// Se next_corpus contiene una nuova versione delle frasi, evita di prendere il lock a ogni ciclo
+        std::atomic<bool> corpus_replaced{};
 
+    protected:
         /**
-         * Permette di leggere un messaggio da un certo giocatore
-         * @tparam TypeMessage Un tipo di messaggio generico di 128 bytes. Quindi può essere un qualsiasi messaggio, anche del client
-         * @tparam TypeAction Il tipo di azione che ci si aspetta. Se TypeMessage è un messaggio del client, TypeAction sarà una action del client. Viceversa se TypeMessage è un messaggio del server, TypeAction sarà una action del server.
-         *
-         * @param player Il giocatore da cui aspettarsi il messaggio
-         * @param message Il messaggio passato per reference sui cui verrà scritto il messaggio ricevuto
-         * @param timeout Il tempo massimo di attesa per il messaggio (in secondi)
-         *
-         * @return Lo stato di lettura del messaggio
-         * @retval true L'invio è andato a buon fine
-         * @retval false L'invio non è andato a buon fine
+         * Imposta le opzioni di un socket appena accettato
+         * @brief Disabilita l'algoritmo di Nagle e, se richiesto, attiva il rilevamento delle connessioni morte
+         * @param client_socket Il socket del client
          */
-        template<class TypeMessage>
-        bool
-        _read(Player *player, TypeMessage &message, Client::Action action = Client::Action::GENERIC, int timeout = 5);
+        void _configure_socket(int client_socket) const;
 
-    protected:
         /**
          * Carica le frasi da un file
          *
-         * @param filename il nome del file da cui caricare le frasi
-         * @throws std::runtime_error se il file non esiste
+         * @param filename il nome del file da cui caricare le frasi, compilato oppure di testo
+         * @throws std::runtime_error se il file non esiste o non è valido
          */
         void _load_short_phrases(const string &filename = "data/data.txt");
 
         /**
-         * Permette di generare una nuova frase da indovinare
+         * Fa entrare in una stanza un giocatore che ha già inviato il messaggio di ingresso
+         * @param new_player Il giocatore da ammettere
+         * @param room_name Il nome della stanza richiesta (vuoto per lasciare la scelta al server)
+         * @param inbound I bytes ricevuti dopo il messaggio di ingresso, consegnati alla stanza come i successivi
+         * @param watched Se il socket è già registrato nel loop di eventi di questo server
          */
-        void _generate_short_phrase();
+        void _admit_player(const Player &new_player, const string &room_name, FrameBuffer inbound,
+                           bool watched = false);
 
         /**
-         * Permette di passare il turno al giocatore successivo
+         * Ammette i giocatori affidati a questo worker dagli altri worker
          */
-        void _next_turn();
+        void _drain_inbox();
 
         /**
-         * Permette di inviare a tutti i giocatori un'azione
-         * @param action L'azione da inviare
+         * Sostituisce le frasi in uso con quelle passate a replace_corpus()
+         * @brief Le partite in corso mantengono la propria frase, i nuovi round scelgono tra le nuove frasi
          */
-        inline void _broadcast_action(Server::Action action);
+        void _swap_corpus();
 
         /**
-         * Permette di inviare a un giocatore un aggiornamento sullo stato del gioco
-         *
-         * @param player Il giocatore a cui inviare l'aggiornamento
+         * Trova la stanza in cui far entrare un giocatore, creandola se necessario
+         * @param room_name Il nome della stanza richiesta dal giocatore (vuoto per lasciare la scelta al server)
+         * @return La stanza scelta oppure nullptr se la stanza richiesta è piena
          */
-        inline void _send_update_short_phrase(Player &player);
+        Room *_pick_room(const string &room_name);
 
         /**
-         * Permette di inviare a un giocatore un aggiornamento sul numero di errori commessi
-         *
-         * @param player Il giocatore a cui inviare l'aggiornamento
+         * Crea una nuova stanza
+         * @param room_name Il nome della stanza (vuoto se creata automaticamente)
+         * @return La stanza creata
          */
-        inline void _send_update_attempts(Player &player);
+        Room *_create_room(const string &room_name);
 
         /**
-         * Permette di inviare a un giocatore un aggiornamento sulla lista dei giocatori
-         *
-         * @param player Il giocatore a cui inviare l'aggiornamento
+         * Aggiorna l'insieme delle stanze con posti liberi ed elimina la stanza se è rimasta vuota
+         * @param room La stanza da controllare
          */
-        inline void _send_update_players(Player &player);
+        void _update_room(Room *room);
 
         /**
-         * Permette di inviare un'azione ad un certo giocatore
-         * @brief Crea un messaggio generico con l'azione e lo invia con _send()
-         * @param player Il giocatore a cui inviare l'azione
-         * @param action L'azione da inviare
-         *
-         * @return Lo stato di invio restituito da _send()
-         * @retval true L'invio è andato a buon fine
-         * @retval false L'invio non è andato a buon fine
+         * Chiude la connessione con un giocatore rimosso da una stanza
+         * @param client_sockfd Il socket del giocatore
          */
-        inline bool _send_action(Player *player, Server::Action action);
+        void _close_player(int client_sockfd);
 
         /**
-         * Permette di eliminare un giocatore dalla lista dei giocatori e disconnetterlo
-         * @param player Il Player da eliminare
+         * Riempie un buffer di ricezione con i bytes di un evento
+         * @brief Con EVENT_READ legge dal socket misurando la durata della chiamata di sistema, con EVENT_DATA copia i
+         * bytes già ricevuti da io_uring
+         * @param inbound Il buffer da riempire
+         * @param event L'evento da cui leggere
+         * @return I bytes ricevuti, 0 se la connessione è stata chiusa o -1 in caso di errore
          */
-        void _remove_player(Player *player);
+        ssize_t _receive(FrameBuffer &inbound, const Event &event);
 
         /**
-         * Permette di verificare se la parola o frase è stata indovinata
-         * @return Se la parola o frase è stata indovinata
-         * @retval true se la parola o la frase è stata indovinata
-         * @retval false se la parola o la frase non è stata indovinata
+         * Gestisce un evento del loop relativo al socket di un giocatore
+         * @param event L'evento da gestire
          */
-        inline bool _is_short_phrase_guessed();
+        void _on_player_event(const Event &event);
 
         /**
-         * Permette di ricevere da un player un tentativo contenente una lettera
-         * @param player Il player che deve fare il tentativo
-         * @param timeout Il tempo massimo da aspettare in secondi
-         *
-         * @return Un numero che rappresenta il risultato della funzione
-         * @retval 1 Se il tentativo è andato a buon fine e ha indovinato
-         * @retval 0 Se il tentativo è andato a buon fine e non ha indovinato
-         * @retval -1 Se la lettera è bloccata o se è già stata usata o se non è una lettera dell'alfabeto ASCII
-         * @retval -2 Se la ricezione non è andata a buon fine
+         * Consegna alla stanza di un giocatore tutti i messaggi completi presenti nel suo buffer di ricezione
+         * @param client_sockfd Il socket del giocatore
          */
-        int _get_letter_from_player(Player *player, int timeout = 5);
+        void _deliver_messages(int client_sockfd);
 
         /**
-         * Permette di ricevere da un player un tentativo sulla frase da indovinare
-         * @param player Il player che deve fare il tentativo
-         * @param timeout Il tempo massimo da aspettare in secondi
-         *
-         * @return Un numero che rappresenta il risultato della funzione
-         * @retval 1 Se il tentativo è andato a buon fine e ha indovinato
-         * @retval 0 Se il tentativo è andato a buon fine e non ha indovinato
-         * @retval -1 Se la ricezione non è andata a buon fine
+         * Fa avanzare la partita di una stanza dopo un messaggio, un nuovo giocatore o una scadenza
+         * @brief Avvia un nuovo turno se non ce n'è uno in corso, quindi aggiorna la stanza con _update_room()
+         * @warning La stanza potrebbe essere distrutta, non deve essere usata dopo la chiamata
+         * @param room La stanza da far avanzare
          */
-        int _get_short_phrase_from_player(Player *player, int timeout = 10);
+        void _after_room_event(Room *room);
 
         /**
-         * Permette di verificare se uno dei giocatori connessi si è disconnesso
+         * Invia i messaggi accodati durante il ciclo e disconnette i giocatori le cui connessioni sono fallite
          */
-        void _check_disconnected_players();
+        void _flush_outbox();
 
         /**
-         * Permette di verificare se ci sono nuovi client che vogliono connettersi e di accettarli
+         * Accetta tutte le connessioni in attesa e le mette in attesa del messaggio di ingresso
          */
         void accept();
 
+        /**
+         * Mette un client appena accettato in attesa del messaggio di ingresso, senza bloccare il loop
+         * @param client_socket Il socket del client
+         */
+        void _begin_handshake(int client_socket);
+
+        /**
+         * Gestisce un evento del loop relativo a un client che non ha ancora inviato il messaggio di ingresso
+         * @brief Quando il messaggio è completo il client viene affidato al worker proprietario della stanza richiesta
+         * oppure fatto entrare in una stanza di questo server
+         * @param event L'evento da gestire
+         */
+        void _on_handshake_event(const Event &event);
+
+        /**
+         * Gestisce un evento del loop relativo a un giocatore affidato a un altro worker
+         * @brief I bytes ricevuti si aggiungono a quelli da consegnare; con EVENT_RELEASED il socket non appartiene più
+         * a questo loop e il giocatore viene consegnato al worker proprietario della stanza
+         * @param event L'evento da gestire
+         */
+        void _on_handoff_event(const Event &event);
+
+        /**
+         * Chiude la connessione con un client che non ha completato il messaggio di ingresso
+         * @param client_socket Il socket del client
+         */
+        void _close_handshake(int client_socket);
+
         /**
          * Loop del server
          * @brief Si occupa di gestire le connessioni e le richieste dei client, quindi di eseguire il gioco
+         * @details Attende sul loop di eventi fino al primo messaggio, connessione o scadenza della ruota dei timer,
+         * senza consumare CPU quando il server è inattivo e senza scorrere tutte le stanze a ogni ciclo
          * @note Deve trovarsi all'interno di un while loop
          */
         void loop();
 
-        /**
-         * Permette di avviare un nuovo round
-         */
-        void new_round();
+        friend class HangmanServerPool;
 
     public:
         /**
          * Costruttore della classe HangmanServer
          * @param _ip L'indirizzo IP del server (se lasciato come default usa tutte le interfacce disponibili)
          * @param _port La porta del server
+         * @param reuse_port Se più server possono ascoltare sulla stessa porta (SO_REUSEPORT)
+         * @param backend Il meccanismo usato per le operazioni sui socket, se non è disponibile viene usato epoll
          * @throws std::runtime_error Se non è possibile creare il socket
          */
-        explicit HangmanServer(const string &_ip = "0.0.0.0", uint16_t _port = 9090);
+        explicit HangmanServer(const string &_ip = "0.0.0.0", uint16_t _port = 9090, bool reuse_port = false,
+                               IoBackend backend = IO_BACKEND_EPOLL);
 
         /**
          * Distruttore della classe HangmanServer
@@ -248,7 +330,7 @@ namespace Server {
          * @param _max_errors Il numero massimo di errori prima che la partita sia persa
          * @param _start_blocked_letters Le lettere che non si possono indovinare all'inizio
          * @param _blocked_attempts Il numero di tentativi che devono essere fatti prima di poter usare le lettere bloccate
-         * @param _filename Il nome del file da cui caricare le frasi
+         * @param _filename Il nome del file da cui caricare le frasi, se non sono state impostate con set_corpus()
          * @throws std::runtime_error Se il server non è stato avviato
          */
         void start(uint8_t _max_errors = 10, const string& _start_blocked_letters = "AEIOU",
@@ -260,9 +342,106 @@ namespace Server {
          * @param verbose Se deve stampare un resoconto dello stato del server ad ogni ciclo
         */
         void run(bool verbose = true);
+
+        /**
+         * Abilita o disabilita il rilevamento delle connessioni morte da parte del kernel
+         * @details Con TCP keepalive e TCP_USER_TIMEOUT una connessione interrotta viene chiusa dal kernel e segnalata
+         * dal loop di eventi, senza che il server debba inviare heartbeat ai giocatori attivi
+         * @param enable Se usare TCP keepalive e TCP_USER_TIMEOUT sulle nuove connessioni
+         */
+        void set_tcp_keepalive(bool enable) { tcp_keepalive = enable; }
+
+        /**
+         * Imposta la lunghezza massima della coda delle connessioni in attesa di essere accettate
+         * @note Deve essere chiamata prima di start()
+         * @param backlog Il valore passato a listen() (il kernel lo limita a net.core.somaxconn)
+         */
+        void set_listen_backlog(int backlog) { listen_backlog = backlog; }
+
+        /**
+         * Imposta le frasi da indovinare, al posto di quelle caricate da start()
+         * @note Deve essere chiamata prima di start()
+         * @param _corpus Le frasi, possono essere condivise con altri server
+         */
+        void set_corpus(std::shared_ptr<const PhraseCorpus> _corpus) {
+            corpus = std::move(_corpus);
+            corpus_generation++;
+        }
+
+        /**
+         * Imposta i criteri con cui le nuove stanze scelgono le frasi da indovinare
+         * @param filter I criteri di scelta
+         */
+        void set_phrase_filter(const PhraseFilter &filter) { settings.phrase_filter = filter; }
+
+        /**
+         * Imposta il seme da cui derivano i semi delle stanze, per riprodurre le stesse frasi
+         * @note Deve essere chiamata prima di start(), altrimenti il seme viene scelto a caso
+         * @param seed Il seme
+         */
+        void set_seed(uint64_t seed) { room_seeds = Random(seed); }
+
+        /**
+         * Imposta l'indice del worker nel pool, che distingue nei resoconti le stanze con lo stesso identificativo
+         * @param index L'indice del worker
+         */
+        void set_worker_index(size_t index) { worker_index = index; }
+
+        /**
+         * Imposta la funzione che decide se un giocatore deve essere affidato a un altro worker
+         * @param _router Restituisce il worker proprietario di una stanza con un nome, nullptr se è questo
+         * @note Deve essere chiamata prima di avviare il loop
+         */
+        void set_router(std::function<HangmanServer *(const string &)> _router);
+
+        /**
+         * Affida a questo server un giocatore accettato da un altro worker
+         * @note È l'unica funzione che può essere chiamata da un thread diverso da quello del loop
+         * @param handoff Il giocatore, che ha già inviato il messaggio di ingresso, e il socket non deve più essere
+         * registrato nel loop del worker che lo affida
+         */
+        void adopt_player(Handoff handoff);
+
+        /**
+         * Sostituisce le frasi da indovinare mentre il server è in esecuzione
+         * @brief La sostituzione avviene nel thread del loop all'inizio del ciclo successivo
+         * @note Può essere chiamata da un thread diverso da quello del loop
+         * @param _corpus Le nuove frasi, possono essere condivise con altri server
+         */
+        void replace_corpus(std::shared_ptr<const PhraseCorpus> _corpus);
+
+        /**
+         * @return Il numero di stanze attive (può essere letto da qualsiasi thread)
+         */
+        unsigned int get_rooms_count() const { return metrics.rooms.get(); }
+
+        /**
+         * @return Il numero di giocatori connessi (può essere letto da qualsiasi thread)
+         */
+        unsigned int get_connections_count() const { return metrics.players.get(); }
+
+        /**
+         * @return I bytes in attesa di invio ai giocatori (può essere letto da qualsiasi thread)
+         */
+        size_t get_queued_bytes() const { return metrics.queued_bytes.get(); }
+
+        /**
+         * @return Le chiamate di sistema fatte dal loop di eventi (può essere letto da qualsiasi thread)
+         */
+        uint64_t get_syscalls() const { return metrics.syscalls.get(); }
+
+        /**
+         * @return I contatori e gli istogrammi del worker (possono essere letti da qualsiasi thread)
+         */
+        const Metrics &get_metrics() const { return metrics; }
+
+        /**
+         * @return Il meccanismo effettivamente usato per le operazioni sui socket
+         */
+        IoBackend get_backend() const { return event_loop.get_backend(); }
     };
 
 }
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,166 @@
+#include "server_pool.h"
+
+#include <chrono>
+
+#include "logger.h"
+#include "trace.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+/// Ogni quanti secondi viene stampato il resoconto dei worker
+#define REPORT_INTERVAL 10
+
+
+namespace Server {
+    HangmanServerPool::HangmanServerPool(const string &ip, uint16_t port, unsigned int workers_count,
+                                         bool _pin_threads, IoBackend backend) : pin_threads(_pin_threads) {
+        if (workers_count == 0)
+            workers_count = std::max(1u, std::thread::hardware_concurrency());
+
+        // Con un solo worker non serve condividere la porta
+        bool reuse_port = workers_count > 1;
+        for (unsigned int i = 0; i < workers_count; i++) {
+            workers.push_back(std::make_unique<HangmanServer>(ip, port, reuse_port, backend));
+            workers.back()->set_worker_index(i);
+        }
+
+        if (!reuse_port)
+            return;
+
+        // Le stanze con un nome appartengono a un solo worker, gli altri gli affidano i giocatori
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i]->set_router([this, i](const string &room_name) -> HangmanServer * {
+                size_t owner = _owner_of(room_name);
+                return owner == i ? nullptr : workers[owner].get();
+            });
+        }
+    }
+
+    size_t HangmanServerPool::_owner_of(const string &room_name) const {
+        return std::hash<string>{}(room_name) % workers.size();
+    }
+
+    void HangmanServerPool::_pin_current_thread(size_t index) {
+#ifdef __linux__
+        unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(index % cores, &cpu_set);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#else
+        (void) index;
+#endif
+    }
+
+    void HangmanServerPool::start(uint8_t _max_errors, const string &_start_blocked_letters, uint8_t _blocked_attempts,
+                                  const string &_filename) {
+        // Un solo corpus per tutti i worker, invece di una copia delle frasi per ognuno
+        if (!corpus)
+            corpus = std::make_shared<const PhraseCorpus>(_filename);
+
+        for (auto &worker: workers) {
+            worker->set_corpus(corpus);
+            worker->start(_max_errors, _start_blocked_letters, _blocked_attempts, _filename);
+        }
+    }
+
+    void HangmanServerPool::replace_corpus(const std::shared_ptr<const PhraseCorpus> &_corpus) {
+        // Ogni worker la adotta dal proprio thread, la versione precedente viene liberata dall'ultimo che la lascia
+        for (auto &worker: workers) {
+            worker->replace_corpus(_corpus);
+        }
+    }
+
+    void HangmanServerPool::set_phrase_filter(const PhraseFilter &filter) {
+        for (auto &worker: workers) {
+            worker->set_phrase_filter(filter);
+        }
+    }
+
+    void HangmanServerPool::set_seed(uint64_t seed) {
+        // Ogni worker ha il proprio seme, altrimenti le loro stanze sceglierebbero le stesse frasi
+        Random seeds(seed);
+        for (auto &worker: workers) {
+            worker->set_seed(seeds.next());
+        }
+    }
+
+    void HangmanServerPool::set_listen_backlog(int backlog) {
+        for (auto &worker: workers) {
+            worker->set_listen_backlog(backlog);
+        }
+    }
+
+    void HangmanServerPool::run(const bool verbose) {
+        try {
+            start();
+        } catch (const std::exception &e) {
+            Log(LOG_LEVEL_ERROR) << e.what();
+            exit(EXIT_FAILURE);
+        }
+
+        // Scrive a schermo l'indirizzo IP del server, la sua porta e il numero di worker
+        char str[INET_ADDRSTRLEN];
+        const struct sockaddr_in &address = workers.front()->address;
+        inet_ntop(AF_INET, &address.sin_addr, str, INET_ADDRSTRLEN);
+        Log(LOG_LEVEL_INFO) << "Server address: " << str;
+        Log(LOG_LEVEL_INFO) << "Server port: " << ntohs(address.sin_port);
+        Log(LOG_LEVEL_INFO) << "Workers: " << workers.size();
+        Log(LOG_LEVEL_INFO) << "I/O backend: "
+                            << (workers.front()->get_backend() == IO_BACKEND_URING ? "io_uring" : "epoll");
+
+        for (size_t i = 0; i < workers.size(); i++) {
+            HangmanServer *worker = workers[i].get();
+            worker->verbose = verbose;
+
+            threads.emplace_back([this, worker, i]() {
+                if (pin_threads)
+                    _pin_current_thread(i);
+                TRACE_THREAD_NAME("worker " + std::to_string(i));
+
+                while (true) {
+                    try {
+                        worker->loop();
+                    }
+                    catch (const std::exception &e) {
+                        Log(LOG_LEVEL_ERROR) << e.what();
+                    }
+                }
+            });
+        }
+
+        // Il thread principale si limita a riportare il carico dei worker
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::seconds(REPORT_INTERVAL));
+
+            // Un messaggio per worker, un solo messaggio verrebbe troncato con molti worker
+            if (verbose) {
+                for (size_t i = 0; i < workers.size(); i++) {
+                    Log status(LOG_LEVEL_INFO);
+                    report(status.stream(), i);
+                }
+            }
+        }
+    }
+
+    void HangmanServerPool::report(std::ostream &out, size_t worker) const {
+        const HangmanServer &server = *workers.at(worker);
+        out << "Worker " << worker << ": " << server.get_rooms_count() << " rooms, " << server.get_connections_count()
+            << " connections, " << server.get_queued_bytes() << " queued bytes, " << server.get_syscalls()
+            << " syscalls";
+    }
+
+    std::vector<const Metrics *> HangmanServerPool::get_metrics() const {
+        std::vector<const Metrics *> result;
+        for (const auto &worker: workers) {
+            result.push_back(&worker->get_metrics());
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef SERVER_POOL_H
+#define SERVER_POOL_H
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "server.h"
+
+
+namespace Server {
+    /**
+     * Questa classe esegue più HangmanServer in parallelo, uno per thread, sulla stessa porta
+     *
+     * Ogni worker possiede il proprio loop di eventi, il proprio socket di ascolto (SO_REUSEPORT) e le proprie stanze,
+     * quindi le partite non hanno mai bisogno di lock. Il kernel distribuisce le nuove connessioni tra i worker; un
+     * giocatore che chiede una stanza con un nome viene affidato al worker proprietario di quel nome, in modo che tutti
+     * i giocatori della stessa stanza finiscano nello stesso thread.
+     */
+    class HangmanServerPool {
+    private:
+        /// Un server per ogni worker
+        std::vector<std::unique_ptr<HangmanServer>> workers;
+        /// I thread che eseguono il loop dei worker
+        std::vector<std::thread> threads;
+        /// Se ogni worker deve essere vincolato a un core della CPU
+        bool pin_threads;
+        /// Frasi da indovinare, caricate una sola volta e condivise da tutti i worker
+        std::shared_ptr<const PhraseCorpus> corpus;
+
+        /**
+         * Calcola il worker proprietario di una stanza con un nome
+         * @param room_name Il nome della stanza
+         * @return L'indice del worker
+         */
+        size_t _owner_of(const string &room_name) const;
+
+        /**
+         * Vincola il thread chiamante a un core della CPU
+         * @param index L'indice del worker, usato per scegliere il core
+         */
+        static void _pin_current_thread(size_t index);
+
+    public:
+        /**
+         * Costruttore della classe HangmanServerPool
+         * @param _ip L'indirizzo IP del server (se lasciato come default usa tutte le interfacce disponibili)
+         * @param _port La porta del server
+         * @param workers_count Il numero di worker (0 per usarne uno per ogni core)
+         * @param _pin_threads Se ogni worker deve essere vincolato a un core della CPU
+         * @param backend Il meccanismo usato dai worker per le operazioni sui socket
+         * @throws std::runtime_error Se non è possibile creare i socket
+         */
+        explicit HangmanServerPool(const string &_ip = "0.0.0.0", uint16_t _port = 9090, unsigned int workers_count = 0,
+                                   bool _pin_threads = false, IoBackend backend = IO_BACKEND_EPOLL);
+
+        /**
+         * Avvia tutti i worker
+         * @param _max_errors Il numero massimo di errori prima che la partita sia persa
+         * @param _start_blocked_letters Le lettere che non si possono indovinare all'inizio
+         * @param _blocked_attempts Il numero di tentativi che devono essere fatti prima di poter usare le lettere bloccate
+         * @param _filename Il nome del file da cui caricare le frasi, se non sono state impostate con set_corpus()
+         * @throws std::runtime_error Se uno dei worker non è stato avviato
+         */
+        void start(uint8_t _max_errors = 10, const string &_start_blocked_letters = "AEIOU",
+                   uint8_t _blocked_attempts = 3, const string &_filename = "data/data.txt");
+
+        /**
+         * Esegue tutti i worker e stampa periodicamente un resoconto del loro carico
+         * @param verbose Se deve stampare un resoconto dello stato dei worker
+         */
+        void run(bool verbose = true);
+
+        /**
+         * Imposta la lunghezza massima della coda delle connessioni in attesa di ogni worker
+         * @note Deve essere chiamata prima di start()
+         * @param backlog Il valore passato a listen() (il kernel lo limita a net.core.somaxconn)
+         */
+        void set_listen_backlog(int backlog);
+
+        /**
+         * Imposta le frasi da indovinare di tutti i worker, al posto di quelle caricate da start()
+         * @note Deve essere chiamata prima di start()
+         * @param _corpus Le frasi
+         */
+        void set_corpus(std::shared_ptr<const PhraseCorpus> _corpus) { corpus = std::move(_corpus); }
+
+        /**
+         * Sostituisce le frasi da indovinare di tutti i worker mentre sono in esecuzione
+         * @note Può essere chiamata da un thread diverso da quelli dei worker
+         * @param _corpus Le nuove frasi
+         */
+        void replace_corpus(const std::shared_ptr<const PhraseCorpus> &_corpus);
+
+        /**
+         * Imposta i criteri con cui le nuove stanze di tutti i worker scelgono le frasi da indovinare
+         * @note Deve essere chiamata prima di start()
+         * @param filter I criteri di scelta
+         */
+        void set_phrase_filter(const PhraseFilter &filter);
+
+        /**
+         * Imposta il seme da cui derivano i semi delle stanze di tutti i worker
+         * @note Deve essere chiamata prima di start(); le stanze di un worker dipendono anche da quali giocatori gli
+         * assegna il kernel, quindi solo con un worker le partite sono riproducibili
+         * @param seed Il seme
+         */
+        void set_seed(uint64_t seed);
+
+        /**
+         * Stampa il numero di stanze, connessioni e chiamate di sistema di un worker
+         * @param out Lo stream su cui stampare
+         * @param worker L'indice del worker
+         */
+        void report(std::ostream &out, size_t worker) const;
+
+        /**
+         * @return Il numero di worker
+         */
+        size_t get_workers_count() const { return workers.size(); }
+
+        /**
+         * @return Le metriche di ogni worker, da esporre con MetricsServer
+         */
+        std::vector<const Metrics *> get_metrics() const;
+    };
+}
+
+
+#endif  // SERVER_POOL_H
@@ -0,0 +1,348 @@
+#include "simd.h"
+
+#include <bit>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace Simd {
+    namespace {
+        /// Implementazione di tutte le funzioni per un certo insieme di istruzioni
+        struct Kernels {
+            const char *name;
+            void (*to_upper)(char *, size_t);
+            void (*mask_phrase)(const char *, char *, size_t, uint64_t *);
+            bool (*equals_upper)(const char *, const char *, size_t);
+            size_t (*leading_spaces)(const char *, size_t);
+            size_t (*trailing_spaces)(const char *, size_t);
+        } typedef Kernels;
+
+        inline char upper(char c) {
+            return c >= 'a' && c <= 'z' ? (char) (c - ('a' - 'A')) : c;
+        }
+
+        inline bool is_space(char c) {
+            return c == ' ' || (c >= '\t' && c <= '\r');
+        }
+
+        inline void set_hidden(uint64_t *hidden, size_t i) {
+            hidden[i / 64] |= (uint64_t) 1 << (i % 64);
+        }
+
+        // Implementazione scalare, usata anche per i bytes che non riempiono un vettore
+
+        void to_upper_scalar(char *data, size_t size) {
+            for (size_t i = 0; i < size; i++)
+                data[i] = upper(data[i]);
+        }
+
+        void mask_phrase_from(const char *phrase, char *masked, size_t begin, size_t size, uint64_t *hidden) {
+            for (size_t i = begin; i < size; i++) {
+                if (phrase[i] == ' ' || phrase[i] == '\0') {
+                    masked[i] = phrase[i];
+                } else {
+                    masked[i] = '_';
+                    set_hidden(hidden, i);
+                }
+            }
+        }
+
+        void mask_phrase_scalar(const char *phrase, char *masked, size_t size, uint64_t *hidden) {
+            for (size_t i = 0; i < (size + 63) / 64; i++)
+                hidden[i] = 0;
+
+            mask_phrase_from(phrase, masked, 0, size, hidden);
+        }
+
+        /// Confronta le stringhe a partire dal byte begin, quelli precedenti devono essere già risultati uguali
+        bool equals_upper_from(const char *a, const char *b, size_t begin, size_t size) {
+            for (size_t i = begin; i < size; i++) {
+                if (upper(a[i]) != upper(b[i]))
+                    return false;
+                if (a[i] == '\0')
+                    return true;
+            }
+
+            return true;
+        }
+
+        bool equals_upper_scalar(const char *a, const char *b, size_t size) {
+            return equals_upper_from(a, b, 0, size);
+        }
+
+        size_t leading_spaces_scalar(const char *data, size_t size) {
+            size_t i = 0;
+            while (i < size && is_space(data[i]))
+                i++;
+            return i;
+        }
+
+        size_t trailing_spaces_scalar(const char *data, size_t size) {
+            size_t i = 0;
+            while (i < size && is_space(data[size - 1 - i]))
+                i++;
+            return i;
+        }
+
+        const Kernels scalar_kernels{"scalar", to_upper_scalar, mask_phrase_scalar,
+                                                      equals_upper_scalar, leading_spaces_scalar,
+                                                      trailing_spaces_scalar};
+
+#ifdef SIMD_X86
+        // Le lettere minuscole si riconoscono con un solo confronto con segno: spostando 'a' su -128 l'intervallo
+        // 'a'..'z' diventa -128..-103, e tutti gli altri bytes finiscono sopra
+
+        // Implementazione SSE2, 16 bytes per istruzione
+
+        inline __m128i upper_sse2(__m128i v) {
+            __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char) (-128 - 'a')));
+            __m128i lower = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char) (-128 + 26)));
+            return _mm_sub_epi8(v, _mm_and_si128(lower, _mm_set1_epi8('a' - 'A')));
+        }
+
+        inline __m128i space_sse2(__m128i v) {
+            __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char) (-128 - '\t')));
+            __m128i control = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char) (-128 + 5)));
+            return _mm_or_si128(control, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        }
+
+        void to_upper_sse2(char *data, size_t size) {
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (data + i));
+                _mm_storeu_si128((__m128i *) (data + i), upper_sse2(v));
+            }
+
+            to_upper_scalar(data + i, size - i);
+        }
+
+        void mask_phrase_sse2(const char *phrase, char *masked, size_t size, uint64_t *hidden) {
+            for (size_t i = 0; i < (size + 63) / 64; i++)
+                hidden[i] = 0;
+
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (phrase + i));
+                __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+                __m128i kept = _mm_or_si128(space, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+
+                // Gli spazi e i terminatori restano com'erano, il resto diventa '_'
+                __m128i out = _mm_or_si128(_mm_and_si128(kept, v), _mm_andnot_si128(kept, _mm_set1_epi8('_')));
+                _mm_storeu_si128((__m128i *) (masked + i), out);
+
+                auto bits = (uint64_t) (uint16_t) ~_mm_movemask_epi8(kept);
+                hidden[i / 64] |= bits << (i % 64);
+            }
+
+            mask_phrase_from(phrase, masked, i, size, hidden);
+        }
+
+        bool equals_upper_sse2(const char *a, const char *b, size_t size) {
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+                __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+
+                auto diff = (uint32_t) (uint16_t) ~_mm_movemask_epi8(_mm_cmpeq_epi8(upper_sse2(va), upper_sse2(vb)));
+                auto end = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(va, _mm_setzero_si128()));
+
+                // Il primo byte diverso o il primo terminatore decide il risultato
+                if (diff | end)
+                    return !((diff >> std::countr_zero(diff | end)) & 1);
+            }
+
+            return equals_upper_from(a, b, i, size);
+        }
+
+        size_t leading_spaces_sse2(const char *data, size_t size) {
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                auto text = (uint32_t) (uint16_t) ~_mm_movemask_epi8(
+                        space_sse2(_mm_loadu_si128((const __m128i *) (data + i))));
+                if (text)
+                    return i + std::countr_zero(text);
+            }
+
+            return i + leading_spaces_scalar(data + i, size - i);
+        }
+
+        size_t trailing_spaces_sse2(const char *data, size_t size) {
+            size_t i = 0;
+            for (; i + 16 <= size; i += 16) {
+                auto text = (uint16_t) ~_mm_movemask_epi8(
+                        space_sse2(_mm_loadu_si128((const __m128i *) (data + size - i - 16))));
+                if (text)
+                    return i + std::countl_zero(text);
+            }
+
+            return i + trailing_spaces_scalar(data, size - i);
+        }
+
+        const Kernels sse2_kernels{"sse2", to_upper_sse2, mask_phrase_sse2, equals_upper_sse2, leading_spaces_sse2,
+                                   trailing_spaces_sse2};
+
+        // Implementazione AVX2, 32 bytes per istruzione, compilata solo per le CPU che la supportano
+
+#define SIMD_AVX2 __attribute__((target("avx2")))
+
+        SIMD_AVX2 inline __m256i upper_avx2(__m256i v) {
+            __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char) (-128 - 'a')));
+            __m256i lower = _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (-128 + 26)), shifted);
+            return _mm256_sub_epi8(v, _mm256_and_si256(lower, _mm256_set1_epi8('a' - 'A')));
+        }
+
+        SIMD_AVX2 inline __m256i space_avx2(__m256i v) {
+            __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char) (-128 - '\t')));
+            __m256i control = _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (-128 + 5)), shifted);
+            return _mm256_or_si256(control, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        }
+
+        SIMD_AVX2 void to_upper_avx2(char *data, size_t size) {
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32) {
+                __m256i v = _mm256_loadu_si256((const __m256i *) (data + i));
+                _mm256_storeu_si256((__m256i *) (data + i), upper_avx2(v));
+            }
+
+            to_upper_sse2(data + i, size - i);
+        }
+
+        SIMD_AVX2 void mask_phrase_avx2(const char *phrase, char *masked, size_t size, uint64_t *hidden) {
+            for (size_t i = 0; i < (size + 63) / 64; i++)
+                hidden[i] = 0;
+
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32) {
+                __m256i v = _mm256_loadu_si256((const __m256i *) (phrase + i));
+                __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+                __m256i kept = _mm256_or_si256(space, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+
+                __m256i out = _mm256_blendv_epi8(_mm256_set1_epi8('_'), v, kept);
+                _mm256_storeu_si256((__m256i *) (masked + i), out);
+
+                auto bits = (uint64_t) (uint32_t) ~_mm256_movemask_epi8(kept);
+                hidden[i / 64] |= bits << (i % 64);
+            }
+
+            mask_phrase_from(phrase, masked, i, size, hidden);
+        }
+
+        SIMD_AVX2 bool equals_upper_avx2(const char *a, const char *b, size_t size) {
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32) {
+                __m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+                __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+
+                auto diff = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(upper_avx2(va), upper_avx2(vb)));
+                auto end = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, _mm256_setzero_si256()));
+
+                if (diff | end)
+                    return !((diff >> std::countr_zero(diff | end)) & 1);
+            }
+
+            return equals_upper_from(a, b, i, size);
+        }
+
+        SIMD_AVX2 size_t leading_spaces_avx2(const char *data, size_t size) {
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32) {
+                auto text = ~(uint32_t) _mm256_movemask_epi8(
+                        space_avx2(_mm256_loadu_si256((const __m256i *) (data + i))));
+                if (text)
+                    return i + std::countr_zero(text);
+            }
+
+            return i + leading_spaces_scalar(data + i, size - i);
+        }
+
+        SIMD_AVX2 size_t trailing_spaces_avx2(const char *data, size_t size) {
+            size_t i = 0;
+            for (; i + 32 <= size; i += 32) {
+                auto text = ~(uint32_t) _mm256_movemask_epi8(
+                        space_avx2(_mm256_loadu_si256((const __m256i *) (data + size - i - 32))));
+                if (text)
+                    return i + std::countl_zero(text);
+            }
+
+            return i + trailing_spaces_scalar(data, size - i);
+        }
+
+#undef SIMD_AVX2
+
+        const Kernels avx2_kernels{"avx2", to_upper_avx2, mask_phrase_avx2, equals_upper_avx2, leading_spaces_avx2,
+                                   trailing_spaces_avx2};
+#endif
+
+        /**
+         * @param name Il nome di un'implementazione
+         * @return L'implementazione, nullptr se non esiste o la CPU non la supporta
+         */
+        const Kernels *find_kernels(const char *name) {
+#ifdef SIMD_X86
+            __builtin_cpu_init();
+            if (strcmp(name, avx2_kernels.name) == 0)
+                return __builtin_cpu_supports("avx2") ? &avx2_kernels : nullptr;
+            if (strcmp(name, sse2_kernels.name) == 0)
+                return &sse2_kernels;
+#endif
+            return strcmp(name, scalar_kernels.name) == 0 ? &scalar_kernels : nullptr;
+        }
+
+        /// L'implementazione in uso, scelta alla prima chiamata in base alla CPU su cui gira il processo
+        const Kernels *&chosen_kernels() {
+            static const Kernels *chosen = []() -> const Kernels * {
+#ifdef SIMD_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2"))
+                    return &avx2_kernels;
+                return &sse2_kernels;
+#else
+                return &scalar_kernels;
+#endif
+            }();
+
+            return chosen;
+        }
+
+        inline const Kernels &kernels() {
+            return *chosen_kernels();
+        }
+    }
+
+    void to_upper(char *data, size_t size) {
+        kernels().to_upper(data, size);
+    }
+
+    void mask_phrase(const char *phrase, char *masked, size_t size, uint64_t *hidden) {
+        kernels().mask_phrase(phrase, masked, size, hidden);
+    }
+
+    bool equals_upper(const char *a, const char *b, size_t size) {
+        return kernels().equals_upper(a, b, size);
+    }
+
+    size_t leading_spaces(const char *data, size_t size) {
+        return kernels().leading_spaces(data, size);
+    }
+
+    size_t trailing_spaces(const char *data, size_t size) {
+        return kernels().trailing_spaces(data, size);
+    }
+
+    const char *implementation() {
+        return kernels().name;
+    }
+
+    bool use_implementation(const char *name) {
+        const Kernels *found = find_kernels(name);
+        if (found == nullptr)
+            return false;
+
+        chosen_kernels() = found;
+        return true;
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * Funzioni vettoriali per le stringhe della partita
+ *
+ * Lavorano su buffer di dimensione fissa (come le frasi da 123 bytes dei messaggi) elaborando 16 o 32 bytes per
+ * istruzione. L'implementazione viene scelta una sola volta all'avvio in base alla CPU: AVX2 se disponibile, altrimenti
+ * SSE2 (sempre presente su x86-64), altrimenti dei semplici cicli sui bytes. Tutte le implementazioni danno gli stessi
+ * risultati e considerano solo i caratteri ASCII, come le funzioni di <cctype> nella locale "C".
+ */
+namespace Simd {
+    /**
+     * Converte in maiuscolo le lettere ASCII di un buffer
+     * @param data Il buffer da modificare
+     * @param size Il numero di bytes
+     */
+    void to_upper(char *data, size_t size);
+
+    /**
+     * Maschera una frase: gli spazi e i terminatori restano, ogni altro carattere diventa '_'
+     * @param phrase La frase da mascherare
+     * @param masked Dove scrivere la frase mascherata, almeno size bytes
+     * @param size Il numero di bytes
+     * @param hidden Dove scrivere le posizioni mascherate, (size + 63) / 64 parole con la posizione i nel bit i % 64
+     * della parola i / 64
+     */
+    void mask_phrase(const char *phrase, char *masked, size_t size, uint64_t *hidden);
+
+    /**
+     * Confronta due stringhe ignorando il case delle lettere ASCII
+     * @brief Ha la stessa semantica di strncmp() sulle stringhe convertite in maiuscolo: il confronto si ferma al primo
+     * terminatore comune o dopo size bytes
+     * @param a La prima stringa
+     * @param b La seconda stringa
+     * @param size Il numero massimo di bytes da confrontare
+     * @return Se le stringhe sono uguali
+     */
+    bool equals_upper(const char *a, const char *b, size_t size);
+
+    /**
+     * @param data Il buffer
+     * @param size Il numero di bytes
+     * @return Il numero di spazi bianchi (come std::isspace) all'inizio del buffer
+     */
+    size_t leading_spaces(const char *data, size_t size);
+
+    /**
+     * @param data Il buffer
+     * @param size Il numero di bytes
+     * @return Il numero di spazi bianchi (come std::isspace) alla fine del buffer
+     */
+    size_t trailing_spaces(const char *data, size_t size);
+
+    /**
+     * @return Il nome dell'implementazione scelta per questa CPU ("avx2", "sse2" o "scalar")
+     */
+    const char *implementation();
+
+    /**
+     * Sostituisce l'implementazione scelta all'avvio, per confrontare tra loro tutte quelle disponibili
+     * @param name Il nome dell'implementazione ("avx2", "sse2" o "scalar")
+     * @return Se l'implementazione esiste ed è supportata da questa CPU, altrimenti resta quella in uso
+     * @note Non va chiamata mentre altri thread usano queste funzioni
+     */
+    bool use_implementation(const char *name);
+}
+
+
+#endif  // SIMD_H
@@ -1,24 +1,20 @@
 #ifndef STRING_UTILS_H
 #define STRING_UTILS_H
 
-#include <algorithm>
-#include <cctype>
 #include <cstring>
 #include <string>
 
+#include "simd.h"
+
 
 // trim from start (in place)
 static inline void ltrim(std::string &s) {
-    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    }));
+    s.erase(0, Simd::leading_spaces(s.data(), s.size()));
 }
 
 // trim from end (in place)
 static inline void rtrim(std::string &s) {
-    s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    }).base(), s.end());
+    s.erase(s.size() - Simd::trailing_spaces(s.data(), s.size()));
 }
 
 /**
@@ -36,7 +32,7 @@ inline void trim(std::string &s) {
  * @param str La stringa da modificare
  */
 inline void str_to_upper(char *str) {
-    std::transform(str, str + strlen(str), str, ::toupper);
+    Simd::to_upper(str, strlen(str));
 }
 
 /**
@@ -44,7 +40,7 @@ inline void str_to_upper(char *str) {
  * @param str La stringa da modificare
  */
 inline void str_to_upper(std::string &str) {
-    std::transform(str.begin(), str.end(), str.begin(), ::toupper);
+    Simd::to_upper(str.data(), str.size());
 }
 
 #endif  // STRING_UTILS_H
@@ -0,0 +1,210 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+#include "trace.h"
+
+
+/// Numero di tick coperti dall'intera ruota
+#define TIMER_WHEEL_SPAN (1ULL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+
+namespace Server {
+    TimerWheel::TimerWheel(Clock::duration _resolution) : resolution(_resolution), origin(Clock::now()) {
+        for (auto &level: heads) {
+            for (auto &head: level) {
+                head = -1;
+            }
+        }
+    }
+
+    uint64_t TimerWheel::_to_tick(Clock::time_point time) const {
+        if (time <= origin)
+            return 0;
+
+        return (uint64_t) ((time - origin + resolution - Clock::duration(1)) / resolution);
+    }
+
+    void TimerWheel::_link(int32_t index) {
+        Node &node = nodes[index];
+        uint64_t delta = node.expires - current;
+
+        // Sceglie il livello più basso che copre la scadenza
+        int level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << (TIMER_WHEEL_SLOT_BITS * (level + 1))))
+            level++;
+
+        auto slot = (uint8_t) ((node.expires >> (TIMER_WHEEL_SLOT_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+
+        node.level = level;
+        node.slot = slot;
+        node.prev = -1;
+        node.next = heads[level][slot];
+        if (node.next >= 0)
+            nodes[node.next].prev = index;
+
+        heads[level][slot] = index;
+        occupied[level] |= 1ULL << slot;
+    }
+
+    void TimerWheel::_unlink(int32_t index) {
+        Node &node = nodes[index];
+
+        if (node.prev >= 0)
+            nodes[node.prev].next = node.next;
+        else
+            heads[node.level][node.slot] = node.next;
+
+        if (node.next >= 0)
+            nodes[node.next].prev = node.prev;
+
+        if (heads[node.level][node.slot] < 0)
+            occupied[node.level] &= ~(1ULL << node.slot);
+
+        node.prev = -1;
+        node.next = -1;
+    }
+
+    TimerId TimerWheel::schedule(Clock::duration delay, std::function<void()> callback) {
+        int32_t index;
+        if (!free_nodes.empty()) {
+            index = free_nodes.back();
+            free_nodes.pop_back();
+        } else {
+            index = (int32_t) nodes.size();
+            nodes.emplace_back();
+        }
+
+        // Il loop non fa avanzare una ruota vuota, perché attende senza timeout: dopo una lunga inattività current è
+        // rimasto indietro e la scadenza verrebbe anticipata al limite della ruota, magari già nel passato
+        Clock::time_point now = Clock::now();
+        if (active_count == 0 && now > origin)
+            current = std::max<uint64_t>(current, (now - origin) / resolution);
+
+        Node &node = nodes[index];
+        node.expires = _to_tick(now + delay);
+
+        // Un timer non può scadere nel tick già elaborato, né oltre il limite della ruota
+        if (node.expires <= current)
+            node.expires = current + 1;
+        if (node.expires - current >= TIMER_WHEEL_SPAN)
+            node.expires = current + TIMER_WHEEL_SPAN - 1;
+
+        node.active = true;
+        node.callback = std::move(callback);
+        _link(index);
+        active_count++;
+
+        return ((TimerId) node.generation << 32) | (uint32_t) (index + 1);
+    }
+
+    bool TimerWheel::cancel(TimerId id) {
+        if (id == 0)
+            return false;
+
+        auto index = (int32_t) ((id & 0xFFFFFFFF) - 1);
+        auto generation = (uint32_t) (id >> 32);
+        if (index < 0 || index >= (int32_t) nodes.size())
+            return false;
+
+        Node &node = nodes[index];
+        if (!node.active || node.generation != generation)
+            return false;
+
+        _unlink(index);
+        node.active = false;
+        node.generation++;
+        node.callback = nullptr;
+        free_nodes.push_back(index);
+        active_count--;
+
+        return true;
+    }
+
+    void TimerWheel::_cascade(int level) {
+        auto slot = (uint8_t) ((current >> (TIMER_WHEEL_SLOT_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+
+        // Prima fa scendere il livello superiore, che potrebbe riempire questo slot
+        if (slot == 0 && level + 1 < TIMER_WHEEL_LEVELS)
+            _cascade(level + 1);
+
+        // Ricollega i timer dello slot, che finiranno in un livello inferiore
+        while (heads[level][slot] >= 0) {
+            int32_t index = heads[level][slot];
+            _unlink(index);
+            _link(index);
+        }
+    }
+
+    uint64_t TimerWheel::_next_tick() const {
+        uint64_t next = UINT64_MAX;
+
+        for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            if (occupied[level] == 0)
+                continue;
+
+            int shift = TIMER_WHEEL_SLOT_BITS * level;
+            uint64_t base = (current >> shift) + 1;
+
+            // Cerca il primo slot occupato a partire da quello successivo a quello corrente
+            unsigned int start = base & (TIMER_WHEEL_SLOTS - 1);
+            uint64_t rotated = (occupied[level] >> start) | (start ? occupied[level] << (TIMER_WHEEL_SLOTS - start) : 0);
+            uint64_t distance = __builtin_ctzll(rotated);
+
+            // Lo slot viene raggiunto quando i livelli inferiori ripartono da zero
+            uint64_t tick = (base + distance) << shift;
+            if (tick < next)
+                next = tick;
+        }
+
+        return next;
+    }
+
+    void TimerWheel::advance(Clock::time_point now) {
+        TRACE_SCOPE("TimerWheel::advance");
+
+        // Un tick viene elaborato solo quando è trascorso per intero
+        if (now <= origin)
+            return;
+        auto target = (uint64_t) ((now - origin) / resolution);
+
+        while (current < target) {
+            // Salta direttamente al primo tick in cui succede qualcosa
+            uint64_t next = _next_tick();
+            if (next > target) {
+                current = target;
+                break;
+            }
+
+            current = next;
+
+            if ((current & (TIMER_WHEEL_SLOTS - 1)) == 0)
+                _cascade(1);
+
+            // Fa scadere i timer dello slot corrente del livello 0
+            auto slot = (uint8_t) (current & (TIMER_WHEEL_SLOTS - 1));
+            while (heads[0][slot] >= 0) {
+                int32_t index = heads[0][slot];
+                Node &node = nodes[index];
+
+                // Il nodo viene liberato prima della chiamata, che può programmare nuovi timer
+                std::function<void()> callback = std::move(node.callback);
+                _unlink(index);
+                node.active = false;
+                node.generation++;
+                node.callback = nullptr;
+                free_nodes.push_back(index);
+                active_count--;
+
+                callback();
+            }
+        }
+    }
+
+    int TimerWheel::timeout_ms() const {
+        if (active_count == 0)
+            return -1;
+
+        return timeout_until(origin + resolution * _next_tick());
+    }
+}
@@ -0,0 +1,149 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "event_loop.h"
+
+
+/// Numero di livelli della ruota
+#define TIMER_WHEEL_LEVELS 4
+/// Bit dell'indice di uno slot in un livello
+#define TIMER_WHEEL_SLOT_BITS 6
+/// Numero di slot di ogni livello
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+
+namespace Server {
+    /// Identificativo di un timer programmato, 0 non rappresenta nessun timer
+    typedef uint64_t TimerId;
+
+
+    /**
+     * Ruota dei timer gerarchica
+     *
+     * Il tempo è diviso in tick di durata fissa; ogni livello ha TIMER_WHEEL_SLOTS slot e copre un intervallo
+     * TIMER_WHEEL_SLOTS volte più lungo di quello precedente. Un timer viene inserito nello slot del livello più basso
+     * che copre la sua scadenza e, quando il livello inferiore compie un giro, scende di livello fino a scadere dal
+     * livello 0. Inserimento e cancellazione costano O(1); i nodi sono in un vettore riutilizzato, quindi a regime non
+     * servono allocazioni.
+     * Con 4 livelli da 64 slot e tick da 10 ms la ruota copre circa 46 ore, le scadenze più lontane vengono anticipate
+     * al limite della ruota.
+     * @note Questa classe non è thread-safe
+     */
+    class TimerWheel {
+    private:
+        /// Un timer programmato, collegato nella lista del proprio slot
+        struct Node {
+            /// Tick in cui il timer scade
+            uint64_t expires{};
+            /// Incrementato a ogni riuso del nodo, invalida gli identificativi vecchi
+            uint32_t generation{};
+            /// Nodi precedente e successivo nello slot (-1 se non presenti)
+            int32_t prev{-1}, next{-1};
+            /// Livello e slot in cui si trova il nodo
+            uint8_t level{}, slot{};
+            /// Se il nodo rappresenta un timer programmato
+            bool active{};
+            /// Funzione da chiamare alla scadenza
+            std::function<void()> callback;
+        } typedef Node;
+
+        /// Durata di un tick
+        Clock::duration resolution;
+        /// Istante corrispondente al tick 0
+        Clock::time_point origin;
+        /// Ultimo tick elaborato
+        uint64_t current{};
+        /// Tutti i nodi, attivi e liberi
+        std::vector<Node> nodes;
+        /// Indici dei nodi liberi
+        std::vector<int32_t> free_nodes;
+        /// Primo nodo di ogni slot (-1 se lo slot è vuoto)
+        int32_t heads[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]{};
+        /// Per ogni livello, un bit per ogni slot non vuoto
+        uint64_t occupied[TIMER_WHEEL_LEVELS]{};
+        /// Numero di timer programmati
+        size_t active_count{};
+
+        /**
+         * Converte un istante nel tick che lo contiene, arrotondando per eccesso
+         * @param time L'istante da convertire
+         * @return Il tick corrispondente
+         */
+        uint64_t _to_tick(Clock::time_point time) const;
+
+        /**
+         * Collega un nodo allo slot che copre la sua scadenza
+         * @param index L'indice del nodo
+         */
+        void _link(int32_t index);
+
+        /**
+         * Scollega un nodo dal suo slot
+         * @param index L'indice del nodo
+         */
+        void _unlink(int32_t index);
+
+        /**
+         * Sposta i timer di uno slot di un livello superiore nei livelli inferiori
+         * @param level Il livello da cui spostare i timer
+         */
+        void _cascade(int level);
+
+        /**
+         * Calcola il primo tick successivo a quello corrente in cui scade un timer o in cui uno slot deve scendere di livello
+         * @return Il tick trovato, oppure UINT64_MAX se la ruota è vuota
+         */
+        uint64_t _next_tick() const;
+
+    public:
+        /**
+         * Costruttore della classe TimerWheel
+         * @param _resolution La durata di un tick, cioè la precisione con cui scadono i timer
+         */
+        explicit TimerWheel(Clock::duration _resolution = std::chrono::milliseconds(10));
+
+        TimerWheel(const TimerWheel &) = delete;
+        TimerWheel &operator=(const TimerWheel &) = delete;
+
+        /**
+         * Programma un timer
+         * @param delay Il tempo dopo il quale chiamare la funzione
+         * @param callback La funzione da chiamare alla scadenza
+         * @return L'identificativo del timer, da usare per cancellarlo
+         */
+        TimerId schedule(Clock::duration delay, std::function<void()> callback);
+
+        /**
+         * Cancella un timer non ancora scaduto
+         * @param id L'identificativo del timer (0 viene ignorato)
+         * @return Se il timer è stato cancellato
+         */
+        bool cancel(TimerId id);
+
+        /**
+         * Fa scadere tutti i timer la cui scadenza è stata raggiunta
+         * @note Le funzioni chiamate possono programmare e cancellare altri timer
+         * @param now L'istante corrente
+         */
+        void advance(Clock::time_point now);
+
+        /**
+         * Calcola quanto il loop di eventi può attendere prima che la ruota debba avanzare
+         * @return Il timeout in millisecondi (-1 se non c'è nessun timer programmato)
+         */
+        int timeout_ms() const;
+
+        /**
+         * @return Il numero di timer programmati
+         */
+        size_t size() const { return active_count; }
+    };
+}
+
+
+#endif  // TIMER_WHEEL_H
@@ -0,0 +1,129 @@
+#include "trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+#include "logger.h"
+
+
+namespace Server {
+    namespace {
+        /// Protegge il registro dei buffer e i nomi dei thread
+        std::mutex registry_mutex;
+        /// I buffer di tutti i thread che hanno registrato almeno un evento
+        std::vector<std::unique_ptr<TraceBuffer>> registry;
+
+        /// Istante di riferimento delle tracce, in tick del contatore e in tempo reale, usato per convertire i tick
+        const uint64_t origin_ticks = Tracer::now();
+        const std::chrono::steady_clock::time_point origin_time = std::chrono::steady_clock::now();
+
+        /**
+         * Misura la frequenza del contatore confrontandolo con steady_clock dall'istante di riferimento
+         * @return Il numero di tick in un microsecondo
+         */
+        double ticks_per_microsecond() {
+            // Un intervallo troppo breve renderebbe la misura imprecisa
+            auto elapsed = std::chrono::steady_clock::now() - origin_time;
+            if (elapsed < std::chrono::milliseconds(10)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+            }
+
+            uint64_t ticks = Tracer::now();
+            elapsed = std::chrono::steady_clock::now() - origin_time;
+            return (double) (ticks - origin_ticks) /
+                   std::chrono::duration<double, std::micro>(elapsed).count();
+        }
+    }
+
+    TraceBuffer *Tracer::_register_thread() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<TraceBuffer>());
+        registry.back()->thread_id = registry.size();
+        return registry.back().get();
+    }
+
+    void Tracer::set_thread_name(const string &name) {
+        TraceBuffer &buffer = local();
+
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        buffer.thread_name = name;
+    }
+
+    void Tracer::write_chrome_json(std::ostream &out) {
+        double ticks_per_us = ticks_per_microsecond();
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        out << std::fixed << std::setprecision(3);
+
+        bool first = true;
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const auto &buffer: registry) {
+            if (!buffer->thread_name.empty()) {
+                out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                    << buffer->thread_id << ",\"args\":{\"name\":\"" << buffer->thread_name << "\"}}";
+                first = false;
+            }
+
+            // Se il buffer ha fatto il giro, i più vecchi potrebbero essere sovrascritti mentre vengono letti
+            uint64_t written = buffer->written.load(std::memory_order_acquire);
+            uint64_t begin = written > TRACE_BUFFER_EVENTS ? written - TRACE_BUFFER_EVENTS + TRACE_DUMP_SLACK : 0;
+            for (uint64_t i = begin; i < written; i++) {
+                const TraceEvent &event = buffer->events[i % TRACE_BUFFER_EVENTS];
+                const char *name = event.name.load(std::memory_order_relaxed);
+                uint64_t start = event.start.load(std::memory_order_relaxed);
+                uint64_t end = event.end.load(std::memory_order_relaxed);
+                if (name == nullptr || end < start || start < origin_ticks)
+                    continue;
+
+                out << (first ? "" : ",") << "\n{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    << buffer->thread_id << ",\"ts\":" << (double) (start - origin_ticks) / ticks_per_us
+                    << ",\"dur\":" << (double) (end - start) / ticks_per_us << "}";
+                first = false;
+            }
+        }
+
+        out << "\n]}\n";
+    }
+
+    bool Tracer::dump(const string &filename) {
+        std::ofstream file(filename, std::ios::trunc);
+        if (!file)
+            return false;
+
+        write_chrome_json(file);
+        return (bool) file;
+    }
+
+    void Tracer::dump_on_signal(int signal, const string &filename) {
+#ifndef _WIN32
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, signal);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        std::thread([signals, filename]() {
+            while (true) {
+                int received;
+                if (sigwait(&signals, &received) != 0)
+                    continue;
+
+                if (dump(filename))
+                    Log(LOG_LEVEL_INFO) << "Trace written to " << filename;
+                else
+                    Log(LOG_LEVEL_ERROR) << "Trace not written to " << filename;
+            }
+        }).detach();
+#else
+        (void) signal;
+        (void) filename;
+#endif
+    }
+}
@@ -0,0 +1,188 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define TRACE_USE_TSC 1
+#endif
+
+
+/// Numero di eventi conservati da ogni thread, i più vecchi vengono sovrascritti
+#define TRACE_BUFFER_EVENTS (1 << 16)
+/// Eventi più vecchi scartati da un'esportazione quando il buffer ha già fatto il giro, perché il thread potrebbe
+/// sovrascriverli mentre vengono letti
+#define TRACE_DUMP_SLACK 1024
+
+
+#ifdef HANGMAN_TRACING
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+/// Registra la durata del blocco corrente con il nome indicato, che deve essere una stringa letterale
+#define TRACE_SCOPE(name) Server::TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+/// Assegna un nome al thread corrente nelle tracce esportate
+#define TRACE_THREAD_NAME(name) Server::Tracer::set_thread_name(name)
+#else
+#define TRACE_SCOPE(name) ((void) 0)
+#define TRACE_THREAD_NAME(name) ((void) 0)
+#endif
+
+
+namespace Server {
+    using std::string;
+
+    /**
+     * Evento registrato da una traccia: un intervallo di tempo con un nome
+     * @note I campi sono atomici perché l'esportazione li legge mentre il thread proprietario continua a scriverli
+     */
+    struct TraceEvent {
+        /// Nome dell'evento, una stringa letterale
+        std::atomic<const char *> name{};
+        /// Istante di inizio, in tick del contatore di Tracer::now()
+        std::atomic<uint64_t> start{};
+        /// Istante di fine, in tick del contatore di Tracer::now()
+        std::atomic<uint64_t> end{};
+    } typedef TraceEvent;
+
+
+    /**
+     * Buffer circolare degli eventi di un thread
+     *
+     * È scritto solo dal proprio thread, senza lock, e letto dall'esportazione da qualsiasi thread.
+     */
+    struct TraceBuffer {
+        /// Gli eventi, il prossimo viene scritto in posizione written % TRACE_BUFFER_EVENTS
+        TraceEvent events[TRACE_BUFFER_EVENTS];
+        /// Numero di eventi scritti dalla creazione
+        std::atomic<uint64_t> written{};
+        /// Identificativo del thread nelle tracce esportate
+        uint32_t thread_id{};
+        /// Nome del thread nelle tracce esportate, protetto dal lock del registro
+        string thread_name;
+
+        /**
+         * Registra un evento, solo dal thread proprietario
+         * @param name Il nome dell'evento
+         * @param start L'istante di inizio
+         * @param end L'istante di fine
+         */
+        void record(const char *name, uint64_t start, uint64_t end) {
+            uint64_t index = written.load(std::memory_order_relaxed);
+            TraceEvent &event = events[index % TRACE_BUFFER_EVENTS];
+            event.name.store(name, std::memory_order_relaxed);
+            event.start.store(start, std::memory_order_relaxed);
+            event.end.store(end, std::memory_order_relaxed);
+            written.store(index + 1, std::memory_order_release);
+        }
+    } typedef TraceBuffer;
+
+
+    /**
+     * Raccoglie gli eventi di tutti i thread e li esporta nel formato JSON di Chrome (chrome://tracing e Perfetto)
+     *
+     * Ogni thread scrive nel proprio buffer circolare, creato al primo evento, quindi registrare un evento costa due
+     * letture del contatore dei tick e qualche scrittura in memoria. Sui processori x86-64 il contatore è il TSC,
+     * convertito in microsecondi solo dall'esportazione; sugli altri è steady_clock.
+     * Le tracce vengono registrate solo se il programma è compilato con HANGMAN_TRACING, altrimenti le macro
+     * TRACE_SCOPE e TRACE_THREAD_NAME non generano codice.
+     */
+    class Tracer {
+    public:
+        /**
+         * @return L'istante corrente, in tick del contatore
+         */
+        static uint64_t now() {
+#ifdef TRACE_USE_TSC
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+        /**
+         * @return Il buffer del thread corrente, creato e registrato al primo utilizzo
+         */
+        static TraceBuffer &local() {
+            thread_local TraceBuffer *buffer = _register_thread();
+            return *buffer;
+        }
+
+        /**
+         * Assegna un nome al thread corrente nelle tracce esportate
+         * @param name Il nome del thread
+         */
+        static void set_thread_name(const string &name);
+
+        /**
+         * @return Se il programma è stato compilato con HANGMAN_TRACING
+         */
+        static constexpr bool enabled() {
+#ifdef HANGMAN_TRACING
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        /**
+         * Scrive gli eventi di tutti i thread nel formato JSON di Chrome
+         * @brief Può essere chiamata da qualsiasi thread mentre gli altri continuano a registrare eventi
+         * @param out Lo stream su cui scrivere
+         */
+        static void write_chrome_json(std::ostream &out);
+
+        /**
+         * Scrive gli eventi di tutti i thread su un file nel formato JSON di Chrome
+         * @param filename Il nome del file
+         * @return Se il file è stato scritto
+         */
+        static bool dump(const string &filename);
+
+        /**
+         * Scrive la traccia su un file ogni volta che il processo riceve un segnale
+         * @brief Il segnale viene bloccato nel thread chiamante, e quindi in tutti i thread creati dopo, e atteso con
+         * sigwait() da un thread dedicato: la scrittura non avviene dentro un gestore di segnali e non interrompe i worker
+         * @note Deve essere chiamata prima di creare gli altri thread; su Windows non fa nulla
+         * @param signal Il segnale che richiede la scrittura (ad esempio SIGUSR2)
+         * @param filename Il file su cui scrivere la traccia, sovrascritto a ogni segnale
+         */
+        static void dump_on_signal(int signal, const string &filename);
+
+    private:
+        /**
+         * Crea il buffer del thread corrente e lo aggiunge al registro
+         * @return Il buffer, che non viene mai liberato per poter esportare anche gli eventi dei thread terminati
+         */
+        static TraceBuffer *_register_thread();
+    };
+
+
+    /**
+     * Registra la durata di un blocco di codice, dalla costruzione alla distruzione
+     * @brief Va usata attraverso la macro TRACE_SCOPE, che scompare se il tracciamento è disabilitato
+     */
+    class TraceScope {
+    private:
+        /// Nome dell'evento
+        const char *name;
+        /// Istante di inizio
+        uint64_t start;
+
+    public:
+        explicit TraceScope(const char *_name) : name(_name), start(Tracer::now()) {}
+
+        ~TraceScope() { Tracer::local().record(name, start, Tracer::now()); }
+
+        TraceScope(const TraceScope &) = delete;
+        TraceScope &operator=(const TraceScope &) = delete;
+    };
+}
+
+
+#endif  // TRACE_H
@@ -0,0 +1,253 @@
+#include "uring.h"
+
+#ifdef HANGMAN_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+namespace Server {
+    Uring::Uring() {
+        struct io_uring_params params{};
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+        // Con molte ricezioni multishot i completamenti possono essere molti più delle richieste
+        params.cq_entries = URING_ENTRIES * 8;
+
+        ring_fd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+        if (ring_fd < 0 && errno == EINVAL) {
+            // IORING_SETUP_COOP_TASKRUN è solo un'ottimizzazione, i kernel più vecchi non la conoscono
+            params = {};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = URING_ENTRIES * 8;
+            ring_fd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+        }
+        if (ring_fd < 0) {
+            throw std::runtime_error("io_uring non è disponibile");
+        }
+
+        unsigned required = IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_EXT_ARG;
+        if ((params.features & required) != required) {
+            ::close(ring_fd);
+            throw std::runtime_error("io_uring non supporta le funzionalità richieste");
+        }
+
+        // Mappa le code condivise con il kernel
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+
+        sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        cq_ptr = single_mmap ? sq_ptr : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             ring_fd, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = (struct io_uring_sqe *) mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            ring_fd, IORING_OFF_SQES);
+
+        if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+            _release();
+            throw std::runtime_error("Errore nella mappatura delle code di io_uring");
+        }
+
+        char *sq = (char *) sq_ptr;
+        sq_head = (unsigned *) (sq + params.sq_off.head);
+        sq_tail = (unsigned *) (sq + params.sq_off.tail);
+        sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+        sq_array = (unsigned *) (sq + params.sq_off.array);
+        sqe_tail = *sq_tail;
+
+        // Ogni posizione della coda usa sempre la richiesta con lo stesso indice
+        for (unsigned i = 0; i < params.sq_entries; i++) {
+            sq_array[i] = i;
+        }
+
+        char *cq = (char *) cq_ptr;
+        cq_head = (unsigned *) (cq + params.cq_off.head);
+        cq_tail = (unsigned *) (cq + params.cq_off.tail);
+        cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+        // La recv multishot è arrivata nello stesso kernel di IORING_OP_SEND_ZC (Linux 6.0), che si può verificare
+        std::vector<char> probe_memory(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+        auto *probe = (struct io_uring_probe *) probe_memory.data();
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+            probe->last_op < IORING_OP_SEND_ZC || !(probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED)) {
+            _release();
+            throw std::runtime_error("io_uring non supporta le ricezioni multishot");
+        }
+
+        try {
+            _setup_buffers();
+        } catch (const std::exception &) {
+            _release();
+            throw;
+        }
+    }
+
+    Uring::~Uring() {
+        _release();
+    }
+
+    void Uring::_release() {
+        if (buf_ring != nullptr && buf_ring != MAP_FAILED)
+            munmap(buf_ring, buf_ring_size);
+        if (sqes != nullptr && sqes != MAP_FAILED)
+            munmap(sqes, sqes_size);
+        if (cq_ptr != nullptr && cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+            munmap(cq_ptr, cq_size);
+        if (sq_ptr != nullptr && sq_ptr != MAP_FAILED)
+            munmap(sq_ptr, sq_size);
+        if (ring_fd >= 0)
+            ::close(ring_fd);
+
+        buf_ring = nullptr;
+        sqes = nullptr;
+        cq_ptr = sq_ptr = nullptr;
+        ring_fd = -1;
+    }
+
+    void Uring::_setup_buffers() {
+        // L'anello e i buffer stanno in un'unica area, l'anello all'inizio è allineato alla pagina
+        size_t ring_bytes = URING_BUFFERS * sizeof(struct io_uring_buf);
+        buf_ring_size = ring_bytes + (size_t) URING_BUFFERS * URING_BUFFER_SIZE;
+
+        void *memory = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::runtime_error("Errore nell'allocazione dei buffer di io_uring");
+        }
+
+        buf_ring = (struct io_uring_buf_ring *) memory;
+        buffers = (char *) memory + ring_bytes;
+
+        struct io_uring_buf_reg reg{};
+        reg.ring_addr = (uint64_t) memory;
+        reg.ring_entries = URING_BUFFERS;
+        reg.bgid = URING_BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            throw std::runtime_error("io_uring non supporta gli anelli di buffer");
+        }
+
+        for (uint16_t id = 0; id < URING_BUFFERS; id++) {
+            recycle(id);
+        }
+
+        _check_buffers();
+    }
+
+    void Uring::_check_buffers() {
+        // Alcuni kernel accettano la registrazione dell'anello ma non vi scelgono mai un buffer: lo si verifica subito
+        // con una ricezione su una coppia di socket, invece di scoprirlo quando i giocatori sono già connessi
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0) {
+            throw std::runtime_error("Errore nella verifica dei buffer di io_uring");
+        }
+
+        char byte = 0;
+        int res = -EIO;
+        if (::write(pair[1], &byte, 1) == 1) {
+            struct io_uring_sqe *sqe = get_sqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = pair[0];
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = URING_BUFFER_GROUP;
+
+            submit_and_wait(1000);
+            for_each_cqe([this, &res](const struct io_uring_cqe &cqe) {
+                res = cqe.res;
+                if (cqe.flags & IORING_CQE_F_BUFFER)
+                    recycle(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            });
+        }
+
+        ::close(pair[0]);
+        ::close(pair[1]);
+
+        if (res != 1) {
+            throw std::runtime_error("io_uring non riceve nei buffer forniti");
+        }
+    }
+
+    struct io_uring_sqe *Uring::get_sqe() {
+        // La coda è piena: le richieste accodate vengono inviate subito, senza attendere completamenti
+        if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) > sq_mask) {
+            _enter(0, 0);
+        }
+
+        struct io_uring_sqe *sqe = &sqes[sqe_tail & sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+
+        sqe_tail++;
+        to_submit++;
+        return sqe;
+    }
+
+    int Uring::_enter(unsigned wait_nr, int timeout_ms) {
+        // Il kernel legge le richieste solo dopo aver visto la nuova coda
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+
+        unsigned flags = 0;
+        struct __kernel_timespec ts{};
+        struct io_uring_getevents_arg arg{};
+        if (wait_nr > 0) {
+            flags |= IORING_ENTER_GETEVENTS;
+
+            if (timeout_ms >= 0) {
+                ts.tv_sec = timeout_ms / 1000;
+                ts.tv_nsec = (long long) (timeout_ms % 1000) * 1000000;
+                arg.ts = (uint64_t) &ts;
+                flags |= IORING_ENTER_EXT_ARG;
+            }
+        }
+
+        long res = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait_nr, flags,
+                           (flags & IORING_ENTER_EXT_ARG) ? &arg : nullptr, sizeof(arg));
+        enters++;
+
+        if (res < 0)
+            return -errno;
+
+        to_submit -= std::min((unsigned) res, to_submit);
+        return (int) res;
+    }
+
+    bool Uring::submit_and_wait(int timeout_ms) {
+        // Se ci sono già dei completamenti non serve attenderne altri
+        bool ready = *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned wait_nr = ready || timeout_ms == 0 ? 0 : 1;
+        if (wait_nr == 0 && to_submit == 0)
+            return false;
+
+        int res = _enter(wait_nr, timeout_ms);
+        if (res == -EINTR)
+            return true;
+
+        // Scadenza raggiunta oppure coda dei completamenti piena: in entrambi i casi si passa a consumarli
+        if (res < 0 && res != -ETIME && res != -EBUSY && res != -EAGAIN) {
+            throw std::runtime_error("Errore nell'attesa dei completamenti di io_uring");
+        }
+
+        return false;
+    }
+
+    void Uring::recycle(uint16_t id) {
+        struct io_uring_buf *buf = &buf_ring->bufs[buf_tail & (URING_BUFFERS - 1)];
+        buf->addr = (uint64_t) buffer(id);
+        buf->len = URING_BUFFER_SIZE;
+        buf->bid = id;
+
+        buf_tail++;
+        __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+    }
+}
+
+
+#endif  // HANGMAN_IO_URING
@@ -0,0 +1,183 @@
+#ifndef URING_H
+#define URING_H
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HANGMAN_IO_URING 1
+#endif
+
+#ifdef HANGMAN_IO_URING
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+
+/// Numero di richieste che possono essere accodate prima di essere inviate al kernel
+#define URING_ENTRIES 256
+/// Numero di buffer forniti al kernel per le ricezioni, deve essere una potenza di due
+#define URING_BUFFERS 512
+/// Dimensione (in bytes) di ogni buffer di ricezione
+#define URING_BUFFER_SIZE 2048
+/// Gruppo dei buffer di ricezione
+#define URING_BUFFER_GROUP 0
+
+
+namespace Server {
+    /**
+     * Accesso diretto a un'istanza di io_uring tramite le chiamate di sistema, senza liburing
+     *
+     * Le richieste vengono scritte nella coda di invio condivisa con il kernel e inviate tutte insieme da una sola
+     * io_uring_enter, che attende anche i completamenti. Per le ricezioni il kernel sceglie da sé un buffer libero da un
+     * anello di buffer forniti, quindi non serve riservare memoria per ogni connessione in attesa.
+     * @note Questa classe non è thread-safe
+     * @note Richiede Linux 6.0 o successivo (accept e recv multishot, anello di buffer forniti)
+     */
+    class Uring {
+    private:
+        /// Descrittore dell'istanza di io_uring
+        int ring_fd{-1};
+
+        /// Memoria condivisa della coda di invio
+        void *sq_ptr{};
+        /// Dimensione della memoria della coda di invio
+        size_t sq_size{};
+        /// Testa della coda di invio, avanzata dal kernel
+        unsigned *sq_head{};
+        /// Coda della coda di invio, avanzata da noi
+        unsigned *sq_tail{};
+        /// Maschera degli indici della coda di invio
+        unsigned sq_mask{};
+        /// Indici delle richieste nella coda di invio
+        unsigned *sq_array{};
+        /// Richieste da inviare
+        struct io_uring_sqe *sqes{};
+        /// Dimensione della memoria delle richieste
+        size_t sqes_size{};
+        /// Coda locale della coda di invio, pubblicata al kernel da _enter()
+        unsigned sqe_tail{};
+        /// Richieste scritte e non ancora inviate al kernel
+        unsigned to_submit{};
+
+        /// Memoria condivisa della coda dei completamenti (coincide con quella di invio se il kernel lo permette)
+        void *cq_ptr{};
+        /// Dimensione della memoria della coda dei completamenti
+        size_t cq_size{};
+        /// Testa della coda dei completamenti, avanzata da noi
+        unsigned *cq_head{};
+        /// Coda della coda dei completamenti, avanzata dal kernel
+        unsigned *cq_tail{};
+        /// Maschera degli indici della coda dei completamenti
+        unsigned cq_mask{};
+        /// Completamenti
+        struct io_uring_cqe *cqes{};
+
+        /// Anello dei buffer forniti al kernel
+        struct io_uring_buf_ring *buf_ring{};
+        /// Dimensione della memoria dell'anello e dei buffer
+        size_t buf_ring_size{};
+        /// Memoria dei buffer di ricezione, subito dopo l'anello
+        char *buffers{};
+        /// Coda locale dell'anello dei buffer, pubblicata al kernel da recycle()
+        uint16_t buf_tail{};
+
+        /// Numero di chiamate io_uring_enter
+        uint64_t enters{};
+
+        /**
+         * Invia al kernel le richieste accodate e, se richiesto, attende dei completamenti
+         * @param wait_nr Il numero minimo di completamenti da attendere
+         * @param timeout_ms Il tempo massimo di attesa in millisecondi (-1 per attendere all'infinito)
+         * @return Il valore restituito da io_uring_enter (-errno in caso di errore)
+         */
+        int _enter(unsigned wait_nr, int timeout_ms);
+
+        /**
+         * Rilascia la memoria condivisa e chiude l'istanza, anche se è stata creata solo in parte
+         */
+        void _release();
+
+        /**
+         * Registra l'anello dei buffer forniti
+         * @throws std::runtime_error Se il kernel non supporta gli anelli di buffer
+         */
+        void _setup_buffers();
+
+        /**
+         * Verifica che il kernel riceva davvero nei buffer dell'anello
+         * @throws std::runtime_error Se una ricezione di prova non ottiene un buffer
+         */
+        void _check_buffers();
+
+    public:
+        /**
+         * Costruttore della classe Uring
+         * @throws std::runtime_error Se io_uring non è disponibile o non supporta le operazioni necessarie
+         */
+        Uring();
+
+        /**
+         * Distruttore della classe Uring
+         * @brief Le operazioni ancora in corso vengono annullate dal kernel
+         */
+        ~Uring();
+
+        Uring(const Uring &) = delete;
+        Uring &operator=(const Uring &) = delete;
+
+        /**
+         * Restituisce una richiesta libera, già azzerata, da compilare
+         * @brief Se la coda è piena invia prima al kernel le richieste accodate
+         * @return La richiesta, valida fino al prossimo submit_and_wait()
+         */
+        struct io_uring_sqe *get_sqe();
+
+        /**
+         * Invia al kernel tutte le richieste accodate e attende almeno un completamento
+         * @param timeout_ms Il tempo massimo di attesa in millisecondi (0 per non attendere, -1 per attendere all'infinito)
+         * @return Se l'attesa è stata interrotta da un segnale
+         * @throws std::runtime_error Se io_uring_enter fallisce
+         */
+        bool submit_and_wait(int timeout_ms);
+
+        /**
+         * Consuma tutti i completamenti disponibili
+         * @tparam Handler Una funzione che riceve un const io_uring_cqe &
+         * @param handler La funzione chiamata per ogni completamento
+         */
+        template<typename Handler>
+        void for_each_cqe(Handler handler) {
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+            for (; head != tail; head++) {
+                handler(cqes[head & cq_mask]);
+            }
+
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        /**
+         * @param id L'indice del buffer indicato nel completamento
+         * @return Il buffer di ricezione
+         */
+        const char *buffer(uint16_t id) const { return buffers + (size_t) id * URING_BUFFER_SIZE; }
+
+        /**
+         * Restituisce un buffer di ricezione al kernel
+         * @param id L'indice del buffer indicato nel completamento
+         */
+        void recycle(uint16_t id);
+
+        /**
+         * @return Il numero di chiamate io_uring_enter fatte fino ad ora
+         */
+        uint64_t get_enters() const { return enters; }
+    };
+}
+
+
+#endif  // HANGMAN_IO_URING
+
+#endif  // URING_H
@@ -0,0 +1,357 @@
+#include "wire.h"
+
+#include <bit>
+#include <cstring>
+
+#include "trace.h"
+
+
+namespace Wire {
+    namespace {
+        /**
+         * Scrive una stringa senza terminatore
+         * @param out Dove scrivere, viene fatto avanzare
+         * @param text La stringa
+         * @param max_length La lunghezza massima da scrivere
+         */
+        void put_string(char *&out, const char *text, size_t max_length) {
+            size_t length = strnlen(text, max_length);
+            memcpy(out, text, length);
+            out += length;
+        }
+
+        /**
+         * Scrive una stringa preceduta dalla sua lunghezza (1 byte)
+         * @param out Dove scrivere, viene fatto avanzare
+         * @param text La stringa
+         * @param max_length La lunghezza massima da scrivere
+         */
+        void put_short_string(char *&out, const char *text, size_t max_length) {
+            size_t length = strnlen(text, max_length);
+            *out++ = (char) length;
+            memcpy(out, text, length);
+            out += length;
+        }
+
+        /**
+         * Scrive un numero a 32 bit in little-endian
+         * @param out Dove scrivere, viene fatto avanzare
+         * @param value Il numero
+         */
+        void put_u32(char *&out, uint32_t value) {
+            for (int i = 0; i < 4; i++) {
+                *out++ = (char) ((value >> (8 * i)) & 0xFF);
+            }
+        }
+
+        /**
+         * Legge un numero a 32 bit in little-endian
+         * @param in I bytes da leggere, almeno 4
+         * @return Il numero
+         */
+        uint32_t get_u32(const uint8_t *in) {
+            return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t) in[3] << 24);
+        }
+
+        /**
+         * Completa l'intestazione di un messaggio v2
+         * @param frame L'inizio del messaggio
+         * @param end La fine del messaggio
+         * @return La dimensione totale del messaggio
+         */
+        size_t finish_v2(char *frame, const char *end) {
+            auto length = (uint16_t) (end - frame - 2);
+            frame[0] = (char) (length & 0xFF);
+            frame[1] = (char) (length >> 8);
+            return end - frame;
+        }
+
+        /**
+         * Estrae dal buffer un messaggio v2 completo
+         * @param buffer Il buffer con i bytes ricevuti
+         * @param frame Dove copiare il messaggio, almeno WIRE_MAX_FRAME bytes
+         * @param size Dove scrivere la dimensione del messaggio, intestazione compresa
+         * @return 1 se estratto, 0 se incompleto, -1 se la lunghezza non è valida
+         */
+        int take_v2(FrameBuffer &buffer, uint8_t *frame, size_t &size) {
+            uint8_t header[2];
+            if (!buffer.peek(header, sizeof(header)))
+                return 0;
+
+            size_t length = header[0] | (header[1] << 8);
+            if (length < 1 || length > MessageSize)
+                return -1;
+
+            size = 2 + length;
+            if (!buffer.peek(frame, size))
+                return 0;
+
+            buffer.consume(size);
+            return 1;
+        }
+    }
+
+    size_t encode(const Server::Message &message, uint8_t version, char *out) {
+        TRACE_SCOPE("Wire::encode");
+
+        if (version < PROTOCOL_V2) {
+            memcpy(out, &message, MessageSize);
+            return MessageSize;
+        }
+
+        char *p = out + 2;
+        *p++ = (char) message.action;
+
+        switch (message.action) {
+            case Server::Action::UPDATE_SHORTPHRASE: {
+                auto packet = std::bit_cast<Server::UpdateShortPhraseMessage>(message);
+
+                *p++ = (char) packet.errors;
+                put_string(p, packet.short_phrase, SHORTPHRASE_LENGTH - 1);
+                break;
+            }
+            case Server::Action::UPDATE_USER: {
+                auto packet = std::bit_cast<Server::UpdateUserMessage>(message);
+
+                uint8_t count = packet.user_count > 3 ? 3 : packet.user_count;
+                *p++ = (char) count;
+                for (uint8_t i = 0; i < count; i++) {
+                    put_short_string(p, packet.usernames[i], USERNAME_LENGTH - 1);
+                }
+                break;
+            }
+            case Server::Action::UPDATE_ATTEMPTS: {
+                auto packet = std::bit_cast<Server::UpdateAttemptsMessage>(message);
+
+                *p++ = (char) packet.attempts;
+                *p++ = (char) packet.errors;
+                *p++ = (char) packet.max_errors;
+                put_u32(p, packet.sequence);
+                put_string(p, packet.attempts_list, sizeof(packet.attempts_list));
+                break;
+            }
+            case Server::Action::UPDATE_DELTA: {
+                auto packet = std::bit_cast<Server::UpdateDeltaMessage>(message);
+
+                put_u32(p, packet.sequence);
+                *p++ = packet.letter;
+                *p++ = (char) packet.errors;
+
+                // I bytes nulli in fondo alla maschera non vengono inviati
+                size_t mask_size = sizeof(packet.revealed);
+                while (mask_size > 0 && packet.revealed[mask_size - 1] == 0)
+                    mask_size--;
+                memcpy(p, packet.revealed, mask_size);
+                p += mask_size;
+                break;
+            }
+            case Server::Action::OTHER_TURN: {
+                auto packet = std::bit_cast<Server::OtherOneTurnMessage>(message);
+
+                put_string(p, packet.player_name, USERNAME_LENGTH - 1);
+                break;
+            }
+            default: {
+                // Le altre azioni non hanno dati
+                break;
+            }
+        }
+
+        return finish_v2(out, p);
+    }
+
+    size_t encode(const Client::Message &message, uint8_t version, char *out) {
+        TRACE_SCOPE("Wire::encode");
+
+        // Il messaggio di ingresso è sempre in formato v1, perché la versione non è ancora stata concordata
+        if (version < PROTOCOL_V2 || message.action == Client::Action::JOIN_GAME) {
+            memcpy(out, &message, MessageSize);
+            return MessageSize;
+        }
+
+        char *p = out + 2;
+        *p++ = (char) message.action;
+
+        switch (message.action) {
+            case Client::Action::LETTER: {
+                auto packet = std::bit_cast<Client::LetterMessage>(message);
+
+                *p++ = packet.letter;
+                break;
+            }
+            case Client::Action::SHORT_PHRASE: {
+                auto packet = std::bit_cast<Client::ShortPhraseMessage>(message);
+
+                put_string(p, packet.short_phrase, SHORTPHRASE_LENGTH - 1);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+
+        return finish_v2(out, p);
+    }
+
+    int decode(FrameBuffer &buffer, uint8_t version, Client::Message &message) {
+        TRACE_SCOPE("Wire::decode");
+
+        if (version < PROTOCOL_V2)
+            return buffer.next(&message, MessageSize) ? 1 : 0;
+
+        uint8_t frame[WIRE_MAX_FRAME];
+        size_t size = 0;
+        int res = take_v2(buffer, frame, size);
+        if (res <= 0)
+            return res;
+
+        const uint8_t *payload = frame + WIRE_V2_HEADER;
+        size_t payload_size = size - WIRE_V2_HEADER;
+
+        // I dati dipendono dall'azione, quindi un'azione sconosciuta non si può decodificare
+        if (frame[2] > Client::Action::RESYNC)
+            return -1;
+
+        message = Client::Message();
+        message.action = (Client::Action) frame[2];
+
+        switch (message.action) {
+            case Client::Action::LETTER: {
+                if (payload_size < 1)
+                    return -1;
+
+                Client::LetterMessage packet;
+                packet.letter = (char) payload[0];
+                message = std::bit_cast<Client::Message>(packet);
+                break;
+            }
+            case Client::Action::SHORT_PHRASE: {
+                if (payload_size > SHORTPHRASE_LENGTH - 1)
+                    return -1;
+
+                Client::ShortPhraseMessage packet;
+                memcpy(packet.short_phrase, payload, payload_size);
+                message = std::bit_cast<Client::Message>(packet);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+
+        return 1;
+    }
+
+    int decode(FrameBuffer &buffer, uint8_t version, Server::Message &message) {
+        TRACE_SCOPE("Wire::decode");
+
+        if (version < PROTOCOL_V2)
+            return buffer.next(&message, MessageSize) ? 1 : 0;
+
+        uint8_t frame[WIRE_MAX_FRAME];
+        size_t size = 0;
+        int res = take_v2(buffer, frame, size);
+        if (res <= 0)
+            return res;
+
+        const uint8_t *payload = frame + WIRE_V2_HEADER;
+        size_t payload_size = size - WIRE_V2_HEADER;
+
+        if (frame[2] > Server::Action::UPDATE_DELTA)
+            return -1;
+
+        message = Server::Message();
+        message.action = (Server::Action) frame[2];
+
+        switch (message.action) {
+            case Server::Action::UPDATE_SHORTPHRASE: {
+                if (payload_size < 1 || payload_size - 1 > SHORTPHRASE_LENGTH - 1)
+                    return -1;
+
+                Server::UpdateShortPhraseMessage packet;
+                packet.errors = payload[0];
+                memcpy(packet.short_phrase, payload + 1, payload_size - 1);
+                message = std::bit_cast<Server::Message>(packet);
+                break;
+            }
+            case Server::Action::UPDATE_USER: {
+                if (payload_size < 1 || payload[0] > 3)
+                    return -1;
+
+                Server::UpdateUserMessage packet;
+                packet.user_count = payload[0];
+
+                size_t offset = 1;
+                for (uint8_t i = 0; i < packet.user_count; i++) {
+                    if (offset >= payload_size)
+                        return -1;
+
+                    size_t length = payload[offset++];
+                    if (length > USERNAME_LENGTH - 1 || offset + length > payload_size)
+                        return -1;
+
+                    memcpy(packet.usernames[i], payload + offset, length);
+                    offset += length;
+                }
+
+                message = std::bit_cast<Server::Message>(packet);
+                break;
+            }
+            case Server::Action::UPDATE_ATTEMPTS: {
+                Server::UpdateAttemptsMessage packet;
+                if (payload_size < 7 || payload_size - 7 > sizeof(packet.attempts_list))
+                    return -1;
+
+                packet.attempts = payload[0];
+                packet.errors = payload[1];
+                packet.max_errors = payload[2];
+                packet.sequence = get_u32(payload + 3);
+                memcpy(packet.attempts_list, payload + 7, payload_size - 7);
+                message = std::bit_cast<Server::Message>(packet);
+                break;
+            }
+            case Server::Action::UPDATE_DELTA: {
+                Server::UpdateDeltaMessage packet;
+                if (payload_size < 6 || payload_size - 6 > sizeof(packet.revealed))
+                    return -1;
+
+                packet.sequence = get_u32(payload);
+                packet.letter = (char) payload[4];
+                packet.errors = payload[5];
+                memcpy(packet.revealed, payload + 6, payload_size - 6);
+                message = std::bit_cast<Server::Message>(packet);
+                break;
+            }
+            case Server::Action::OTHER_TURN: {
+                if (payload_size > USERNAME_LENGTH - 1)
+                    return -1;
+
+                Server::OtherOneTurnMessage packet;
+                memcpy(packet.player_name, payload, payload_size);
+                message = std::bit_cast<Server::Message>(packet);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+
+        return 1;
+    }
+
+    bool frame_ready(const FrameBuffer &buffer, uint8_t version) {
+        if (version < PROTOCOL_V2)
+            return buffer.size() >= MessageSize;
+
+        uint8_t header[2];
+        if (!buffer.peek(header, sizeof(header)))
+            return false;
+
+        // Un'intestazione non valida viene segnalata subito, la decodifica restituirà l'errore
+        size_t length = header[0] | (header[1] << 8);
+        if (length < 1 || length > MessageSize)
+            return true;
+
+        return buffer.size() >= 2 + length;
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+#include "frame_buffer.h"
+
+
+/// Bytes dell'intestazione di un messaggio v2: lunghezza (2 bytes little-endian) e azione (1 byte)
+#define WIRE_V2_HEADER 3
+/// Dimensione massima di un messaggio codificato, in qualsiasi versione
+#define WIRE_MAX_FRAME (MessageSize + WIRE_V2_HEADER)
+
+
+/**
+ * Codifica e decodifica dei messaggi nelle diverse versioni del protocollo
+ *
+ * Il gioco lavora sempre con le struct di protocol.h; queste funzioni le trasformano nei bytes inviati sul socket.
+ * - v1: la struct da 128 bytes viene inviata così com'è, con l'ordine dei bytes e il layout dell'host.
+ * - v2: ogni messaggio è preceduto dalla sua lunghezza (2 bytes little-endian, esclusa l'intestazione stessa) e
+ *   dall'azione (1 byte), seguiti solo dai campi che servono a quell'azione. Le stringhe non hanno terminatore e i
+ *   numeri sono little-endian, quindi il formato non dipende né dal compilatore né dall'architettura.
+ *
+ * La versione viene scelta dal client nel messaggio di ingresso, che è sempre in formato v1: un client che non la
+ * indica parla v1 per tutta la connessione.
+ */
+namespace Wire {
+    /**
+     * Sceglie la versione da usare con un client
+     * @param requested La versione indicata nel messaggio di ingresso (0 se il client non la conosce)
+     * @return La versione più recente supportata da entrambi
+     */
+    inline uint8_t negotiate(uint8_t requested) {
+        if (requested < PROTOCOL_V1)
+            return PROTOCOL_V1;
+
+        return requested < PROTOCOL_VERSION ? requested : PROTOCOL_VERSION;
+    }
+
+    /**
+     * Codifica un messaggio del server
+     * @param message Il messaggio da codificare, in una qualsiasi delle struct del server
+     * @param version La versione del protocollo del destinatario
+     * @param out Dove scrivere i bytes, almeno WIRE_MAX_FRAME
+     * @return Il numero di bytes scritti
+     */
+    size_t encode(const Server::Message &message, uint8_t version, char *out);
+
+    /**
+     * Codifica un messaggio del client
+     * @param message Il messaggio da codificare, in una qualsiasi delle struct del client
+     * @param version La versione del protocollo concordata con il server
+     * @param out Dove scrivere i bytes, almeno WIRE_MAX_FRAME
+     * @return Il numero di bytes scritti
+     */
+    size_t encode(const Client::Message &message, uint8_t version, char *out);
+
+    /**
+     * Estrae dal buffer un messaggio del client completo
+     * @param buffer Il buffer con i bytes ricevuti
+     * @param version La versione del protocollo del client
+     * @param message Dove scrivere il messaggio decodificato
+     * @return Il risultato della decodifica
+     * @retval 1 Il messaggio è stato estratto
+     * @retval 0 Il messaggio non è ancora completo
+     * @retval -1 Il messaggio non è valido (lunghezza fuori dai limiti, azione sconosciuta o campi troncati), la
+     * connessione va chiusa
+     */
+    int decode(FrameBuffer &buffer, uint8_t version, Client::Message &message);
+
+    /**
+     * Estrae dal buffer un messaggio del server completo
+     * @param buffer Il buffer con i bytes ricevuti
+     * @param version La versione del protocollo concordata con il server
+     * @param message Dove scrivere il messaggio decodificato
+     * @return Il risultato della decodifica
+     * @retval 1 Il messaggio è stato estratto
+     * @retval 0 Il messaggio non è ancora completo
+     * @retval -1 Il messaggio non è valido (lunghezza fuori dai limiti, azione sconosciuta o campi troncati), la
+     * connessione va chiusa
+     */
+    int decode(FrameBuffer &buffer, uint8_t version, Server::Message &message);
+
+    /**
+     * @param buffer Il buffer con i bytes ricevuti
+     * @param version La versione del protocollo
+     * @return Se il buffer contiene almeno un messaggio completo (o un'intestazione non valida)
+     */
+    bool frame_ready(const FrameBuffer &buffer, uint8_t version);
+}
+
+
+#endif  // WIRE_H
@@ -1,19 +1,154 @@
+#include <csignal>
 #include <iostream>
+#include <optional>
+#include <Hangman/corpus_watcher.h>
+#include <Hangman/logger.h>
+#include <Hangman/metrics.h>
 #include <Hangman/server.h>
+#include <Hangman/server_pool.h>
+#include <Hangman/trace.h>
+
+
+/**
+ * Legge un intervallo nella forma MIN-MAX (oppure un solo valore)
+ * @param text Il testo da leggere
+ * @param min Dove scrivere il minimo
+ * @param max Dove scrivere il massimo
+ */
+static void parse_range(const char *text, uint8_t &min, uint8_t &max) {
+    char *end;
+    min = (uint8_t) strtol(text, &end, 10);
+    max = *end == '-' ? (uint8_t) strtol(end + 1, nullptr, 10) : min;
+}
+
+
+/**
+ * Avvia l'endpoint delle metriche, se richiesto
+ * @param port La porta locale su cui rispondere (0 per non avviarlo)
+ * @param sources Le metriche dei worker
+ * @return L'endpoint avviato, nullptr se non è stato richiesto
+ */
+static std::unique_ptr<Server::MetricsServer> start_metrics(uint16_t port, std::vector<const Server::Metrics *> sources) {
+    if (port == 0)
+        return nullptr;
+
+    try {
+        auto metrics = std::make_unique<Server::MetricsServer>(port, std::move(sources));
+        Server::Log(Server::LOG_LEVEL_INFO) << "Metrics: http://127.0.0.1:" << port << "/metrics";
+        return metrics;
+    } catch (const std::exception &e) {
+        Server::Log(Server::LOG_LEVEL_ERROR) << e.what();
+        exit(EXIT_FAILURE);
+    }
+}
 
 
 int main(int argc, char *argv[]) {
-    Server::HangmanServer *server;
+    // Argomenti: [indirizzo ip] [porta] [numero di worker, 0 per uno per core] [opzioni]
+    // Opzioni: pin per vincolare i worker ai core, uring per usare io_uring (se non è disponibile viene usato epoll),
+    // backlog=N per la lunghezza della coda delle connessioni in attesa di essere accettate, phrases=FILE per il file delle
+    // frasi (di testo oppure compilato con corpus_compiler), che viene ricaricato quando cambia, length=MIN-MAX e
+    // difficulty=MIN-MAX per la lunghezza e la difficoltà delle frasi, vowels=N per la percentuale massima di vocali,
+    // seed=N per scegliere le frasi in modo riproducibile, metrics=PORT per esporre le metriche in formato Prometheus su
+    // http://127.0.0.1:PORT/metrics (e la traccia degli eventi su /trace), trace=FILE per scrivere la traccia degli eventi
+    // su FILE alla ricezione di SIGUSR2 (solo se compilato con HANGMAN_TRACING), log=FILE per scrivere i messaggi su FILE
+    // invece che sul terminale, loglevel=LEVEL per il livello minimo dei messaggi (debug, info, warning o error)
+    const char *ip = argc > 1 ? argv[1] : "0.0.0.0";
+    uint16_t port = argc > 2 ? strtol(argv[2], nullptr, 10) : 9090;
+    unsigned int workers = argc > 3 ? strtol(argv[3], nullptr, 10) : 1;
+    bool pin_threads = false;
+    Server::IoBackend backend = Server::IO_BACKEND_EPOLL;
+    int backlog = SOMAXCONN;
+    const char *phrases = "data/data.txt";
+    Server::PhraseFilter filter;
+    std::optional<uint64_t> seed;
+    uint16_t metrics_port = 0;
+    const char *trace_file = nullptr;
+    const char *log_file = nullptr;
+    Server::LogLevel log_level = Server::LOG_LEVEL_INFO;
+
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "pin") == 0)
+            pin_threads = true;
+        else if (strcmp(argv[i], "uring") == 0)
+            backend = Server::IO_BACKEND_URING;
+        else if (strncmp(argv[i], "backlog=", 8) == 0)
+            backlog = (int) strtol(argv[i] + 8, nullptr, 10);
+        else if (strncmp(argv[i], "phrases=", 8) == 0)
+            phrases = argv[i] + 8;
+        else if (strncmp(argv[i], "length=", 7) == 0)
+            parse_range(argv[i] + 7, filter.min_length, filter.max_length);
+        else if (strncmp(argv[i], "difficulty=", 11) == 0)
+            parse_range(argv[i] + 11, filter.min_difficulty, filter.max_difficulty);
+        else if (strncmp(argv[i], "vowels=", 7) == 0)
+            filter.max_vowel_percent = (uint8_t) strtol(argv[i] + 7, nullptr, 10);
+        else if (strncmp(argv[i], "seed=", 5) == 0)
+            seed = strtoull(argv[i] + 5, nullptr, 10);
+        else if (strncmp(argv[i], "metrics=", 8) == 0)
+            metrics_port = (uint16_t) strtol(argv[i] + 8, nullptr, 10);
+        else if (strncmp(argv[i], "trace=", 6) == 0)
+            trace_file = argv[i] + 6;
+        else if (strncmp(argv[i], "log=", 4) == 0)
+            log_file = argv[i] + 4;
+        else if (strncmp(argv[i], "loglevel=", 9) == 0 && !Server::Logger::parse_level(argv[i] + 9, log_level))
+            std::cerr << "Unknown log level " << argv[i] + 9 << std::endl;
+    }
+
+    // I messaggi vengono scritti da un thread dedicato, il loop di gioco non aspetta mai il terminale
+    Server::Logger::set_level(log_level);
+    if (log_file != nullptr) {
+        try {
+            Server::Logger::set_file(log_file);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    Server::Log(Server::LOG_LEVEL_INFO) << "Starting up server...";
+
+    // Il segnale va bloccato prima di creare gli altri thread, che altrimenti potrebbero riceverlo
+    if (trace_file != nullptr) {
+#ifdef SIGUSR2
+        if (Server::Tracer::enabled())
+            Server::Tracer::dump_on_signal(SIGUSR2, trace_file);
+        else
+            Server::Log(Server::LOG_LEVEL_WARNING) << "Tracing is not compiled in, rebuild with -DHANGMAN_TRACING=ON";
+#endif
+    }
+
+    std::shared_ptr<const Server::PhraseCorpus> corpus;
+    try {
+        corpus = std::make_shared<const Server::PhraseCorpus>(phrases);
+    } catch (const std::exception &e) {
+        Server::Log(Server::LOG_LEVEL_ERROR) << e.what();
+        return EXIT_FAILURE;
+    }
 
-    std::cout << "Starting up server..." << std::endl;
-    srand(time(nullptr)); // NOLINT(cert-msc51-cpp)
+    if (workers == 1) {
+        auto *server = new Server::HangmanServer(ip, port, false, backend);
+        server->set_listen_backlog(backlog);
+        server->set_corpus(corpus);
+        server->set_phrase_filter(filter);
+        if (seed)
+            server->set_seed(*seed);
 
-    if (argc == 3)
-        server = new Server::HangmanServer(argv[1], strtol(argv[2], nullptr, 10));
-    else if (argc == 2)
-        server = new Server::HangmanServer(argv[1]);
-    else
-        server = new Server::HangmanServer();
+        Server::CorpusWatcher watcher(phrases, [server](auto new_corpus) {
+            server->replace_corpus(std::move(new_corpus));
+        });
+        auto metrics = start_metrics(metrics_port, {&server->get_metrics()});
+        server->run(true);
+    } else {
+        auto *pool = new Server::HangmanServerPool(ip, port, workers, pin_threads, backend);
+        pool->set_listen_backlog(backlog);
+        pool->set_corpus(corpus);
+        pool->set_phrase_filter(filter);
+        if (seed)
+            pool->set_seed(*seed);
 
-    server->run(true);
+        Server::CorpusWatcher watcher(phrases, [pool](auto new_corpus) {
+            pool->replace_corpus(new_corpus);
+        });
+        auto metrics = start_metrics(metrics_port, pool->get_metrics());
+        pool->run(true);
+    }
 }
@@ -0,0 +1,26 @@
+#include <filesystem>
+#include <iostream>
+
+#include <Hangman/phrase_corpus.h>
+
+
+int main(int argc, char *argv[]) {
+    // Argomenti: [file di testo] [file compilato]
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <phrases.txt> <phrases.bin>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        uint32_t count = Server::PhraseCorpus::compile(argv[1], argv[2]);
+
+        // Riapre il risultato come farebbe il server, per verificare che sia valido
+        Server::PhraseCorpus corpus(argv[2]);
+        std::cout << "Compiled " << count << " distinct phrases into " << argv[2] << " ("
+                  << std::filesystem::file_size(argv[2]) << " bytes)" << std::endl;
+        return corpus.size() == count ? EXIT_SUCCESS : EXIT_FAILURE;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
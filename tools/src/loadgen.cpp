@@ -0,0 +1,94 @@
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <Hangman/load_generator.h>
+
+
+/// Impostato da SIGINT per terminare la prova e stampare comunque il resoconto
+static volatile sig_atomic_t interrupted = 0;
+
+
+/**
+ * Alza il limite dei descrittori aperti al massimo consentito, serve uno per ogni giocatore simulato
+ * @param needed Il numero di descrittori necessari
+ */
+static void raise_file_limit(unsigned int needed) {
+#ifndef _WIN32
+    struct rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur >= needed)
+        return;
+
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < needed)
+        std::cerr << "Warning: the file descriptor limit is " << limit.rlim_cur << ", some bots will not connect"
+                  << std::endl;
+#endif
+}
+
+
+int main(int argc, char *argv[]) {
+    // Argomenti: [porta] [numero di giocatori] [opzioni]
+    // Opzioni: address=IP per l'indirizzo del server (solo loopback), rate=N per le connessioni aperte al secondo
+    // durante l'avvio, duration=S per la durata della prova in secondi, think=MIN-MAX per il tempo di attesa in
+    // millisecondi prima di rispondere al server, strategy=frequency|random per la scelta delle lettere, version=N per
+    // la versione del protocollo richiesta (0 per un client v1), delta=0 per non chiedere gli aggiornamenti
+    // incrementali, room=NAME per entrare tutti nella stessa stanza, seed=N per rendere la prova riproducibile
+    Client::LoadSettings settings;
+    if (argc > 1)
+        settings.port = (uint16_t) strtol(argv[1], nullptr, 10);
+    if (argc > 2)
+        settings.bots = (unsigned int) strtoul(argv[2], nullptr, 10);
+
+    for (int i = 3; i < argc; i++) {
+        if (strncmp(argv[i], "address=", 8) == 0)
+            settings.address = argv[i] + 8;
+        else if (strncmp(argv[i], "rate=", 5) == 0)
+            settings.connect_rate = (unsigned int) strtoul(argv[i] + 5, nullptr, 10);
+        else if (strncmp(argv[i], "duration=", 9) == 0)
+            settings.duration = (unsigned int) strtoul(argv[i] + 9, nullptr, 10);
+        else if (strncmp(argv[i], "think=", 6) == 0) {
+            char *end;
+            settings.think_min_ms = (unsigned int) strtoul(argv[i] + 6, &end, 10);
+            settings.think_max_ms = *end == '-' ? (unsigned int) strtoul(end + 1, nullptr, 10) : settings.think_min_ms;
+        } else if (strcmp(argv[i], "strategy=frequency") == 0)
+            settings.strategy = Client::BOT_STRATEGY_FREQUENCY;
+        else if (strcmp(argv[i], "strategy=random") == 0)
+            settings.strategy = Client::BOT_STRATEGY_RANDOM;
+        else if (strncmp(argv[i], "version=", 8) == 0)
+            settings.version = (uint8_t) strtoul(argv[i] + 8, nullptr, 10);
+        else if (strcmp(argv[i], "delta=0") == 0)
+            settings.capabilities &= ~CAPABILITY_DELTA;
+        else if (strncmp(argv[i], "room=", 5) == 0)
+            settings.room = argv[i] + 5;
+        else if (strncmp(argv[i], "seed=", 5) == 0)
+            settings.seed = strtoull(argv[i] + 5, nullptr, 10);
+        else {
+            std::cerr << "Usage: " << argv[0] << " [port] [bots] [address=IP] [rate=N] [duration=S] [think=MIN-MAX] "
+                      << "[strategy=frequency|random] [version=N] [delta=0] [room=NAME] [seed=N]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Qualche descrittore in più per lo standard input/output e per il loop di eventi
+    raise_file_limit(settings.bots + 16);
+    signal(SIGINT, [](int) { interrupted = 1; });
+
+    try {
+        Client::LoadGenerator generator(settings);
+        generator.run(std::cout, &interrupted);
+
+        std::cout << std::endl;
+        generator.print_report(std::cout);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}